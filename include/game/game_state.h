@@ -11,7 +11,7 @@ typedef struct scene_t scene;
 typedef struct game_player_t game_player;
 typedef struct object_t object;
 
-int game_state_create(game_state *gs, int net_mode);
+int game_state_create(game_state *gs, settings *setting, int net_mode, uint32_t seed);
 void game_state_free(game_state *gs);
 int game_state_handle_event(game_state *gs, SDL_Event *event);
 void game_state_render(game_state *gs);
@@ -20,6 +20,7 @@ void game_state_dynamic_tick(game_state *gs);
 void game_state_tick_controllers(game_state *gs);
 unsigned int game_state_get_tick(game_state *gs);
 scene* game_state_get_scene(game_state *gs);
+settings* game_state_get_settings(game_state *gs);
 unsigned int game_state_is_running(game_state *gs);
 unsigned int game_state_is_paused(game_state *gs);
 void game_state_set_paused(game_state *gs, unsigned int paused);
@@ -40,6 +41,8 @@ void reconfigure_controller(game_state *gs);
 int game_state_rewind(game_state *gs, int rtt);
 void game_state_replay(game_state *gs, int rtt);
 
+object* game_state_alloc_object(game_state *gs);
+void game_state_release_object(game_state *gs, object *obj);
 int game_state_add_object(game_state *gs, object *obj, int layer);
 void game_state_del_object(game_state *gs, object *obj);
 void game_state_del_animation(game_state *gs, int anim_id);
@@ -47,4 +50,15 @@ void game_state_set_speed(game_state *gs, int speed);
 void game_state_get_projectiles(game_state *gs, vector *obj_proj);
 void game_state_clear_hazards_projectiles(game_state *gs);
 
+typedef struct collide_bench_result_t {
+    const char *name;
+    int objects;
+    double us_per_tick;
+    unsigned int calls_per_tick;
+} collide_bench_result;
+
+// Times the collision pass of the old pair loop against the broadphase, with
+// a few different amounts of objects. Returns the number of results written.
+int game_state_collide_bench(collide_bench_result *results, int max_results);
+
 #endif // _GAME_STATE_H
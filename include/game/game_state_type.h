@@ -2,6 +2,8 @@
 #define _GAME_STATE_TYPE_H
 
 #include "utils/vector.h"
+#include "utils/random.h"
+#include "utils/pool.h"
 
 enum {
     RENDER_LAYER_BOTTOM = 0,
@@ -23,6 +25,9 @@ enum {
 typedef struct scene_t scene;
 typedef struct game_player_t game_player;
 typedef struct ticktimer_t ticktimer;
+typedef struct settings_t settings;
+typedef struct preloader_t preloader;
+typedef struct particles_t particles;
 
 typedef struct game_state_t {
     unsigned int run;
@@ -42,10 +47,22 @@ typedef struct game_state_t {
     int next_wait_ticks;
     int this_wait_ticks;
 
-    int next_requires_refresh; // If next frame requires a texture refresh, this should be set to 1
     int net_mode; // NET_MODE_NONE, NET_MODE_CLIENT, NET_MODE_SERVER
+    int demo_fixed; // If set, demo play keeps the preselected pilots and HARs
+    float interp; // Render interpolation between the last two dynamic ticks, 0.0 - 1.0
+    settings *setting; // Settings used by this game; not necessarily the global ones
+    struct random_t rand_state; // All gameplay randomness comes from here
     scene *sc;
+    preloader *preload; // Loads the next scene in the background during crossfades
     vector objects;
+    particles *particles; // Scrap, oil and sparks; not objects of their own
+
+    // Objects and their userdata are allocated from these. Everything in them
+    // belongs to the current scene, and they are reset when the scene changes.
+    pool object_pool;
+    pool har_pool;
+    pool projectile_pool;
+
     game_player *players[2];
     ticktimer *tick_timer;
 } game_state;
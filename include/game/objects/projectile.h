@@ -6,6 +6,11 @@
 
 typedef struct har_t har;
 
+typedef struct projectile_local_t {
+    object *owner;
+    af *af_data;
+} projectile_local;
+
 int projectile_create(object *obj);
 af *projectile_get_af_data(object *obj);
 object *projectile_get_owner(object *obj);
@@ -1,8 +0,0 @@
-#ifndef _SCRAP_H
-#define _SCRAP_H
-
-#include "game/protos/object.h"
-
-int scrap_create(object *obj);
-
-#endif // _SCRAP_H
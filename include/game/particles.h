@@ -0,0 +1,81 @@
+#ifndef _PARTICLES_H
+#define _PARTICLES_H
+
+#include <stdint.h>
+#include "resources/animation.h"
+#include "utils/vec.h"
+
+// Most particles alive at once; any more are not created
+#define PARTICLES_MAX 1024
+
+enum {
+    PARTICLE_FACE_LEFT = 0x1,
+    PARTICLE_SHADOW = 0x2
+};
+
+typedef struct settings_t settings;
+
+/*
+ * Scrap metal, burning oil and block sparks. These only fly around and play
+ * an animation, so they are kept apart from the game objects. Every field is
+ * an array of its own, so that the movement loop runs over plain float arrays.
+ */
+typedef struct particles_t {
+    int count;
+    const settings *setting; // For sound volume
+
+    // Movement
+    float x[PARTICLES_MAX];
+    float y[PARTICLES_MAX];
+    float prev_x[PARTICLES_MAX];
+    float prev_y[PARTICLES_MAX];
+    float vel_x[PARTICLES_MAX];
+    float vel_y[PARTICLES_MAX];
+    float gravity[PARTICLES_MAX];
+    uint8_t resting[PARTICLES_MAX]; // On the floor; stops moving, and animation loops are no longer taken
+
+    // Animation
+    animation *ani[PARTICLES_MAX];
+    const char *stl[PARTICLES_MAX];
+    uint32_t ticks[PARTICLES_MAX];
+    int frame[PARTICLES_MAX]; // Current animation frame, or -1
+    uint8_t finished[PARTICLES_MAX];
+
+    // Rendering
+    sprite *spr[PARTICLES_MAX]; // NULL if nothing is shown
+    uint8_t blend[PARTICLES_MAX];
+    uint8_t flip[PARTICLES_MAX];
+    uint8_t flags[PARTICLES_MAX];
+    uint8_t pal_offset[PARTICLES_MAX];
+    uint8_t layer[PARTICLES_MAX];
+} particles;
+
+// What to emit; the same one is usually used for a whole burst
+typedef struct particle_def_t {
+    animation *ani;
+    const char *stl; // Sound translation table, may be NULL if the animation has no sounds
+    float gravity;
+    int layer; // RENDER_LAYER_*
+    int flags; // PARTICLE_*
+    int pal_offset;
+    int warmup; // Animation ticks to run right away
+} particle_def;
+
+typedef struct particle_bench_result_t {
+    int particles;
+    double us_per_tick;
+} particle_bench_result;
+
+void particles_create(particles *p, const settings *setting);
+void particles_clear(particles *p);
+int particles_count(particles *p);
+int particles_emit(particles *p, const particle_def *def, vec2f pos, vec2f vel);
+void particles_tick(particles *p);
+void particles_render(particles *p, int layer, float interp);
+void particles_render_shadows(particles *p, float interp);
+
+// Times particles_tick() with a few different amounts of particles.
+// Returns the number of results written.
+int particles_bench(particle_bench_result *results, int max_results);
+
+#endif // _PARTICLES_H
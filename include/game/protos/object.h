@@ -56,6 +56,8 @@ struct object_t {
     vec2f start;
     vec2f pos;
     vec2f vel;
+    vec2f prev_pos; // Position before the last object_move(), for render interpolation
+    int has_prev_pos;
     int8_t direction;
     int8_t group;
 
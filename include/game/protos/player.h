@@ -2,9 +2,9 @@
 #define _PLAYER_H
 
 #include "utils/vec.h"
+#include "resources/animation_frames.h"
 
 typedef struct object_t object;
-typedef struct sd_stringparser_t sd_stringparser;
 
 typedef void (*object_state_add_cb)(object *parent, int id, vec2i pos, int g, void *userdata);
 typedef void (*object_state_del_cb)(object *parent, int id, void *userdata);
@@ -48,7 +48,10 @@ typedef struct player_animation_state_t {
     uint32_t end_frame;
     int previous;
     int entered_frame;
-    sd_stringparser *parser;
+    const animation_frames *frames; // Shared with other objects, never modified
+    int frame_id; // Current frame, or -1 if not started
+    uint8_t animation_end;
+    animation_delay delay; // Extra ticks spread over the first frames by player_set_delay()
     uint8_t repeat;
     uint8_t reverse;
     uint8_t finished;
@@ -67,9 +70,12 @@ void player_reload(object *obj);
 void player_reload_with_str(object *obj, const char *str);
 const char* player_get_str(object *obj);
 void player_reset(object *obj);
-int player_frame_isset(object *obj, const char *tag);
-int player_frame_get(object *obj, const char *tag);
+int player_frame_isset(object *obj, int tag);
+int player_frame_get(object *obj, int tag);
+int player_is_final_frame(object *obj);
 void player_run(object *obj);
+// Plays the sound of a frame with the "s" tag, using the given sound translation table
+void player_play_frame_sound(const animation_frame *f, const char *stl, int sound_vol);
 void player_set_repeat(object *obj, int repeat);
 int player_get_repeat(object *obj);
 void player_set_end_frame(object *obj, int end_frame);
@@ -15,6 +15,13 @@ enum {
     TEXT_SHADOW_ALL = 0xF
 };
 
+// Text is kept drawn in a cache, so that it is only laid out again when it changes.
+// font_cache_frame_end() has to be called after each frame, since text drawn during
+// a frame must stay in the cache until the frame has been finished.
+// Text may only be drawn or measured from the rendering thread, since the cache is not locked.
+void font_cache_frame_end();
+void font_cache_clear();
+
 void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w, int *out_h);
 void font_render_char(font *font, char ch, int x, int y, color c);
 void font_render_char_shadowed(font *font, char ch, int x, int y, color c, int shadow_flags);
@@ -33,12 +33,16 @@ typedef struct settings_video_t {
     int screen_w;
     int screen_h;
     int vsync;
+    int target_fps;
     int fullscreen;
     int scaling;
     int instant_console;
     int crossfade_on;
     char *scaler;
     int scale_factor;
+    int frame_scaling;
+    int texture_cache_mb;
+    int texture_upload_kb;
 } settings_video;
 
 typedef struct settings_gameplay_t {
@@ -0,0 +1,29 @@
+#ifndef _PACER_H
+#define _PACER_H
+
+#include <stdint.h>
+
+typedef struct pacer_stats_t {
+    unsigned int frames; // Frames rendered since last reset
+    unsigned int missed; // Frames that were rendered later than a full frame after their deadline
+    float avg; // Frame time average, in milliseconds
+    float stddev; // Frame time standard deviation, in milliseconds
+} pacer_stats;
+
+// Target FPS 0 means that rendering is only paced by the simulation ticks
+void pacer_init(int target_fps);
+void pacer_set_target_fps(int target_fps);
+int pacer_get_target_fps();
+
+// Render deadline handling. All times are performance counter values.
+int pacer_render_due(uint64_t now);
+uint64_t pacer_render_deadline();
+void pacer_frame_rendered(uint64_t now);
+
+// Sleeps until deadline; the last fraction of a millisecond is spent spinning
+void pacer_sleep_until(uint64_t deadline);
+
+void pacer_get_stats(pacer_stats *stats);
+void pacer_reset_stats();
+
+#endif // _PACER_H
@@ -0,0 +1,53 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+// Phases of the main loop that are timed separately
+enum {
+    PROF_CONTROLLERS = 0,
+    PROF_STATIC_TICK,
+    PROF_DYNAMIC_TICK,
+    PROF_AUDIO,
+    PROF_RENDER,
+    PROF_RENDER_FINISH,
+    PROF_SLEEP,
+    PROF_FRAME, // Whole frame, from profiler_frame_begin() to profiler_frame_end()
+    PROF_PHASE_COUNT
+};
+
+// Things counted per frame
+enum {
+    PROF_COUNT_DRAW_CALLS = 0,
+    PROF_COUNT_SPRITES,
+    PROF_COUNT_REDRAWN_PIXELS, // Native pixels; 0 when the frame was unchanged
+    PROF_COUNTER_COUNT
+};
+
+typedef struct profiler_stats_t {
+    float min; // All values in milliseconds
+    float avg;
+    float p99;
+    float last;
+} profiler_stats;
+
+void profiler_init();
+void profiler_close();
+
+// Timing is only done while the overlay or the CSV dump is active
+int profiler_is_enabled();
+void profiler_set_overlay(int enabled);
+int profiler_overlay_enabled();
+int profiler_csv_open(const char *filename);
+void profiler_csv_close();
+
+void profiler_frame_begin();
+void profiler_frame_end();
+void profiler_begin(int phase);
+void profiler_end(int phase);
+void profiler_count(int counter, unsigned int n);
+
+const char* profiler_phase_name(int phase);
+void profiler_get_stats(int phase, profiler_stats *stats);
+unsigned int profiler_get_count(int counter); // Value for the last finished frame
+void profiler_render();
+
+#endif // _PROFILER_H
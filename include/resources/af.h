@@ -2,6 +2,7 @@
 #define _AF_H
 
 #include "resources/af_move.h"
+#include "video/atlas.h"
 
 typedef struct af_t {
     unsigned int id;
@@ -12,6 +13,7 @@ typedef struct af_t {
     int jump_speed;
     int fall_speed;
     af_move moves[70];
+    atlas sprites; // All move sprites, packed for rendering
     char sound_translation_table[30];
 } af;
 
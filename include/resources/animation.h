@@ -2,9 +2,11 @@
 #define _ANIMATION_H
 
 #include "resources/sprite.h"
+#include "resources/animation_frames.h"
 #include "utils/vec.h"
 #include "utils/vector.h"
 #include "utils/str.h"
+#include "video/atlas.h"
 
 // All HARs have these predefined animations
 enum {
@@ -39,6 +41,7 @@ typedef struct animation_t {
     vec2i start_pos;
     vector collision_coords;
     str animation_string;
+    animation_frames *frames; // Compiled animation_string
     uint8_t extra_string_count;
     vector extra_strings;
     vector sprites;
@@ -46,6 +49,8 @@ typedef struct animation_t {
 
 void animation_create(animation *ani, void *src, int id);
 sprite* animation_get_sprite(animation *ani, int sprite_id);
+void animation_add_to_atlas(animation *ani, atlas *a);
+void animation_add_sprite_bytes(animation *ani, int *bytes, int *unpacked_bytes);
 void animation_free(animation *ani);
 
 animation* create_animation_from_single(sprite *sp, vec2i pos);
@@ -0,0 +1,157 @@
+#ifndef _ANIMATION_FRAMES_H
+#define _ANIMATION_FRAMES_H
+
+#include <stdint.h>
+
+/*
+ * Animation strings compiled into a table of frames. This is done once per
+ * string, and the result is never changed afterwards, so all objects playing
+ * the same animation can share it.
+ */
+
+// Tags the game knows about. Anything else in the string is ignored.
+enum {
+    TAG_D = 0,
+    TAG_H,
+    TAG_UA,
+    TAG_M,
+    TAG_MRX,
+    TAG_MM,
+    TAG_MX,
+    TAG_MRY,
+    TAG_MY,
+    TAG_MG,
+    TAG_MD,
+    TAG_SMO,
+    TAG_SMF,
+    TAG_S,
+    TAG_SF,
+    TAG_L,
+    TAG_SB,
+    TAG_B1,
+    TAG_B2,
+    TAG_BB,
+    TAG_BE,
+    TAG_BF,
+    TAG_BH,
+    TAG_BL,
+    TAG_BM,
+    TAG_BJ,
+    TAG_BS,
+    TAG_BU,
+    TAG_BW,
+    TAG_BX,
+    TAG_BPD,
+    TAG_BPN,
+    TAG_BPS,
+    TAG_BPF,
+    TAG_BPP,
+    TAG_BPB,
+    TAG_BZ,
+    TAG_BC,
+    TAG_BD,
+    TAG_OX,
+    TAG_OY,
+    TAG_V,
+    TAG_Y_MINUS,
+    TAG_Y_PLUS,
+    TAG_X_MINUS,
+    TAG_X_PLUS,
+    TAG_Y,
+    TAG_E,
+    TAG_X_SET,
+    TAG_Y_SET,
+    TAG_AS,
+    TAG_Q,
+    TAG_AT,
+    TAG_AR,
+    TAG_BR,
+    TAG_R,
+    TAG_F,
+    TAG_ZZ,
+    TAG_ZL,
+    TAG_ZM,
+    TAG_ZH,
+    TAG_ZJ,
+    TAG_ZP,
+    TAG_UE,
+    TAG_UB,
+    TAG_AW,
+    TAG_BT,
+    TAG_JN,
+    TAG_JL,
+    TAG_JM,
+    TAG_JH,
+    TAG_JF,
+    TAG_JF2,
+    TAG_K,
+    TAG_COUNT
+};
+
+#define ANIMATION_TAG_WORDS 2
+
+typedef struct animation_frame_t {
+    int id;
+    char letter;
+    int duration;
+    int start_tick;
+    uint64_t tags[ANIMATION_TAG_WORDS];
+    const int *values; // Only for the tags that are set, in tag order
+} animation_frame;
+
+typedef struct animation_frames_t {
+    char *string;
+    int count;
+    int ticks_len;
+    animation_frame *frames;
+    int *values;
+} animation_frames;
+
+// Extra ticks spread over the first frames of an animation (see player_set_delay()).
+// The shared frame table is never changed; the delay is added when durations are looked up.
+typedef struct animation_delay_t {
+    int frames;
+    int per_frame;
+    int rem;
+} animation_delay;
+
+animation_frames* animation_frames_compile(const char *str);
+void animation_frames_free(animation_frames *af);
+
+// Compiled custom strings are kept around, since the same ones are used over and over
+animation_frames* animation_frames_get_custom(const char *str);
+void animation_frames_clear_custom();
+
+const animation_frame* animation_frames_get(const animation_frames *af, int frame_id);
+int animation_frames_next_with_tag(const animation_frames *af, int frame_id, int tag);
+const char* animation_frames_tag_name(int tag);
+
+void animation_delay_spread(animation_delay *d, const animation_frames *af, int frames, int delay);
+int animation_frames_duration(const animation_frames *af, const animation_delay *d, int frame_id);
+int animation_frames_start(const animation_frames *af, const animation_delay *d, int frame_id);
+
+static inline int animation_frame_isset(const animation_frame *f, int tag) {
+    return (f->tags[tag >> 6] >> (tag & 63)) & 1;
+}
+
+static inline int animation_bit_count(uint64_t x) {
+    x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    return (int)((x * UINT64_C(0x0101010101010101)) >> 56);
+}
+
+// Returns the value of a tag, or 0 if the tag is not set
+static inline int animation_frame_get(const animation_frame *f, int tag) {
+    if(!animation_frame_isset(f, tag)) {
+        return 0;
+    }
+    int word = tag >> 6;
+    int slot = animation_bit_count(f->tags[word] & ((UINT64_C(1) << (tag & 63)) - 1));
+    for(int i = 0; i < word; i++) {
+        slot += animation_bit_count(f->tags[i]);
+    }
+    return f->values[slot];
+}
+
+#endif // _ANIMATION_FRAMES_H
@@ -4,11 +4,13 @@
 #include "resources/bk_info.h"
 #include "utils/hashmap.h"
 #include "utils/vector.h"
+#include "video/atlas.h"
 
 typedef struct bk_t {
     int file_id;
     surface background;
     hashmap infos;
+    atlas sprites; // All animation sprites, packed for rendering
     vector palettes;
     char sound_translation_table[30];
 } bk;
@@ -1,6 +1,9 @@
 #ifndef _FONTS_H
 #define _FONTS_H
 
+#include "utils/vector.h"
+#include "video/surface.h"
+
 enum {
     FONT_UNDEFINED,
     FONT_BIG,
@@ -13,6 +16,9 @@ struct font_t {
     int size;
     int w,h;
     vector surfaces;
+
+    // All glyphs packed into one surface, so that they can be drawn from one texture
+    surface sheet;
 };
 
 extern font font_small;
@@ -21,4 +27,4 @@ extern font font_large;
 int fonts_init();
 void fonts_close();
 
-#endif // _FONTS_H
\ No newline at end of file
+#endif // _FONTS_H
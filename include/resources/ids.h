@@ -1,6 +1,8 @@
 #ifndef _IDS_H
 #define _IDS_H
 
+#include "utils/random.h"
+
 enum RESOURCE_ID {
     SCENE_INTRO = 0,
     SCENE_MENU,
@@ -63,6 +65,6 @@ int is_scene(int id);
 int is_har(int id);
 int is_music(int id);
 
-int rand_arena();
+int rand_arena(struct random_t *r);
 
 #endif // _IDS_H
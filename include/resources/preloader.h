@@ -0,0 +1,33 @@
+#ifndef _PRELOADER_H
+#define _PRELOADER_H
+
+#include <SDL2/SDL.h>
+#include "resources/bk.h"
+#include "resources/af.h"
+
+/*
+ * Loads the BK and AF files of an upcoming scene on a worker thread.
+ * The scene code then takes the loaded data with preloader_take_bk() and
+ * preloader_take_af(), which wait for the worker if it is still running.
+ * If the preloader has nothing for the requested id, the caller should
+ * load the file synchronously as usual.
+ */
+typedef struct preloader_t {
+    SDL_Thread *thread;
+    SDL_atomic_t done;
+    int scene_id; // SCENE_NONE if nothing is preloaded
+    int har_id[2]; // -1 if not preloaded
+    int bk_ok;
+    bk bk_data;
+    af *af_data[2];
+    uint64_t start;
+    uint64_t end;
+} preloader;
+
+void preloader_init(preloader *p);
+int preloader_start(preloader *p, int scene_id, int har_id_a, int har_id_b);
+int preloader_take_bk(preloader *p, int scene_id, bk *b);
+af* preloader_take_af(preloader *p, int har_id);
+void preloader_clear(preloader *p); // Waits for the worker, and frees anything that was not taken
+
+#endif // _PRELOADER_H
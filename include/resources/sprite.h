@@ -17,5 +17,6 @@ void sprite_free(sprite *sp);
 
 vec2i sprite_get_size(sprite *s);
 sprite* sprite_copy(sprite *src);
+sprite* sprite_ref(sprite *src);
 
 #endif // _SPRITE_H
@@ -0,0 +1,37 @@
+#ifndef _SIMULATOR_H
+#define _SIMULATOR_H
+
+#include <stdint.h>
+
+typedef struct sim_config_t {
+    uint32_t seed;
+    int har_id[2]; // HAR_JAGUAR to HAR_NOVA, -1 for random
+    int pilot_id[2]; // 0 to 9, -1 for random
+    int arena_id; // SCENE_ARENA0 to SCENE_ARENA4, -1 for random
+    unsigned int max_ticks; // Dynamic tick limit per match, 0 for no limit
+    unsigned int matches; // Number of matches to run, seed is incremented for each
+    unsigned int threads; // Number of matches to run in parallel, 0 for one per CPU core
+} sim_config;
+
+typedef struct sim_result_t {
+    uint32_t seed;
+    int har_id[2];
+    int pilot_id[2];
+    int arena_id;
+    int winner; // 0 or 1, -1 if the match did not finish
+    int rounds[2];
+    int health[2];
+    int score[2];
+    unsigned int ticks; // Dynamic ticks simulated
+    double secs; // Wall clock time spent on the match
+    int failed; // 1 if the match could not be set up
+} sim_result;
+
+void sim_config_defaults(sim_config *cfg);
+int sim_parse_args(sim_config *cfg, int argc, char **argv);
+void sim_print_help();
+
+int sim_run_match(const sim_config *cfg, uint32_t seed, sim_result *res);
+int sim_run(const sim_config *cfg); // Runs all matches and prints results
+
+#endif // _SIMULATOR_H
@@ -0,0 +1,25 @@
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+// Startup stage timing and background loading.
+// Stages are identified by the index returned from startup_begin() or startup_spawn().
+
+#define STARTUP_MAX_STAGES 16
+
+typedef int (*startup_func)();
+
+// Times a stage run on the calling thread
+int startup_begin(const char *name);
+void startup_end(int stage, int ret);
+
+// Runs func on a worker thread. If the thread cannot be created, func is run right away.
+int startup_spawn(const char *name, startup_func func);
+
+// Waits for a spawned stage to finish, and returns its return value.
+// May be called several times, and for stages run on the calling thread.
+int startup_wait(int stage);
+
+// Logs how long each stage took, and when it started relative to the first stage
+void startup_report();
+
+#endif // _STARTUP_H
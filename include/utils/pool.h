@@ -0,0 +1,31 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stddef.h>
+#include "utils/vector.h"
+
+/*
+ * Hands out blocks of one size from bigger slabs. Released blocks are reused
+ * before new slabs are allocated, and slabs are only freed by pool_free(), so
+ * a pool that has grown to its working size allocates nothing more.
+ */
+typedef struct pool_t {
+    size_t block_size;
+    unsigned int blocks_per_slab;
+    vector slabs;
+    void *free_head;
+    unsigned int used;
+} pool;
+
+void pool_create(pool *p, size_t block_size, unsigned int blocks_per_slab);
+void pool_free(pool *p);
+void* pool_alloc(pool *p);
+void pool_release(pool *p, void *ptr);
+
+// Marks every block as free, keeping the slabs
+void pool_reset(pool *p);
+
+unsigned int pool_used(pool *p);
+unsigned int pool_capacity(pool *p);
+
+#endif // _POOL_H
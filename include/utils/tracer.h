@@ -0,0 +1,33 @@
+#ifndef _TRACER_H
+#define _TRACER_H
+
+#include <stdint.h>
+
+/*
+ * Timeline tracer. Records complete spans into an in-memory ring buffer,
+ * and writes them out as Chrome trace-event JSON (chrome://tracing, Perfetto)
+ * when flushed. While stopped, tracer_begin() is a single flag check.
+ *
+ * Usage:
+ *   uint64_t t = tracer_begin();
+ *   ... work ...
+ *   tracer_end("video", "tcache_miss", t);
+ *
+ * Category and name must be string literals (or otherwise outlive the tracer).
+ */
+
+#define TRACER_DEFAULT_EVENTS 65536
+
+int tracer_start(unsigned int max_events);
+void tracer_stop();
+int tracer_is_enabled();
+unsigned int tracer_event_count();
+
+uint64_t tracer_begin();
+void tracer_end(const char *cat, const char *name, uint64_t start);
+void tracer_span(const char *cat, const char *name, uint64_t start, uint64_t end);
+
+int tracer_flush(const char *filename);
+void tracer_close();
+
+#endif // _TRACER_H
@@ -0,0 +1,19 @@
+#ifndef _WORKERS_H
+#define _WORKERS_H
+
+/*
+ * Small persistent worker pool for splitting work into ranges.
+ * workers_run() splits [0, count) into chunks of at least min_chunk items,
+ * runs them on the pool and the calling thread, and returns once all are done.
+ * Only one job runs at a time; other callers wait for their turn.
+ * Without a pool (not initialized, or no threads), everything runs on the caller.
+ */
+
+typedef void (*workers_func)(void *userdata, int start, int end);
+
+int workers_init(int threads); // 0 = one less than the CPU count
+void workers_run(workers_func func, void *userdata, int count, int min_chunk);
+int workers_count(); // Threads that share a job, including the caller
+void workers_close();
+
+#endif // _WORKERS_H
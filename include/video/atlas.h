@@ -0,0 +1,33 @@
+#ifndef _ATLAS_H
+#define _ATLAS_H
+
+#include "video/surface.h"
+#include "utils/vector.h"
+
+// Size of one atlas page, before scaling
+#define ATLAS_PAGE_SIZE 512
+
+/*
+ * Packs paletted surfaces into a few large page surfaces, so that the
+ * renderer can draw them as sub-rectangles of a single texture per page.
+ * Packed surfaces keep their own data; they just get a reference to their page
+ * and their position in it (see surface.atlas_page). The atlas holds a reference
+ * to every packed surface, so that the ones still in use when the atlas is freed
+ * can be told that their page is gone.
+ * Pages list the area and palette indices of every packed surface (see
+ * surface.regions), so that palette animation on some sprites doesn't
+ * redraw the whole page texture.
+ */
+typedef struct atlas_t {
+    vector pending; // surface*, added but not yet packed
+    vector packed; // surface*
+    vector pages; // surface*
+} atlas;
+
+void atlas_create(atlas *a);
+void atlas_add(atlas *a, surface *sur);
+void atlas_pack(atlas *a); // Packs all surfaces added since last pack
+unsigned int atlas_page_count(atlas *a);
+void atlas_free(atlas *a);
+
+#endif // _ATLAS_H
@@ -0,0 +1,55 @@
+#ifndef _DRAWLIST_H
+#define _DRAWLIST_H
+
+#include <SDL2/SDL.h>
+#include "video/surface.h"
+#include "video/color.h"
+#include "utils/vector.h"
+
+// Above this many changed areas, the whole frame is redrawn
+#define DRAWLIST_MAX_RECTS 8
+
+/*
+ * Draws of one frame, recorded so that they can be compared to the ones of
+ * the previous frame. A surface is identified by its address and version,
+ * so old entries are only compared, never dereferenced.
+ */
+typedef struct drawlist_entry_t {
+    surface *sur;
+    unsigned int sur_version;
+    SDL_Rect dst;
+    SDL_BlendMode blend_mode;
+    int pal_offset;
+    SDL_RendererFlip flip;
+    uint8_t opacity;
+    color tint;
+    int background;
+    int priority; // Texture upload priority, see video.h
+} drawlist_entry;
+
+typedef struct drawlist_t {
+    vector entries;
+} drawlist;
+
+void drawlist_create(drawlist *dl);
+void drawlist_free(drawlist *dl);
+void drawlist_clear(drawlist *dl);
+void drawlist_add(drawlist *dl,
+                  surface *sur,
+                  SDL_Rect *dst,
+                  SDL_BlendMode blend_mode,
+                  int pal_offset,
+                  SDL_RendererFlip flip,
+                  uint8_t opacity,
+                  color tint,
+                  int background,
+                  int priority);
+unsigned int drawlist_size(drawlist *dl);
+drawlist_entry* drawlist_get(drawlist *dl, unsigned int idx);
+
+// Finds the areas (in native coordinates) that differ between two frames.
+// Returns the number of rects written; 0 if the frames are the same, and -1 if
+// everything should be redrawn.
+int drawlist_diff(drawlist *prev, drawlist *cur, SDL_Rect *rects, int max_rects);
+
+#endif // _DRAWLIST_H
@@ -0,0 +1,36 @@
+#ifndef _PAL_CONVERT_H
+#define _PAL_CONVERT_H
+
+#include <stdint.h>
+#include "video/screen_palette.h"
+
+/*
+ * Paletted to RGBA conversion. The palette, remap table and pal_offset are
+ * first folded into a single 256 entry lookup table, so that the kernels only
+ * need to do a table lookup and apply the stencil to each pixel.
+ * Output pixels are in R,G,B,A byte order (SDL_PIXELFORMAT_ABGR8888).
+ */
+
+typedef void (*pal_convert_func)(uint32_t *dst,
+                                 const uint8_t *src,
+                                 const uint8_t *stencil,
+                                 int count,
+                                 const uint32_t *lut);
+
+typedef struct pal_bench_result_t {
+    const char *name;
+    double mpix_s; // Megapixels per second
+} pal_bench_result;
+
+// Picks the fastest kernel the CPU supports. Called automatically on first use.
+void pal_convert_init();
+const char* pal_convert_kernel_name();
+
+void pal_build_lut(uint32_t *lut, const screen_palette *pal, const char *remap_table, uint8_t pal_offset);
+void pal_convert(uint32_t *dst, const uint8_t *src, const uint8_t *stencil, int count, const uint32_t *lut);
+
+// Measures the throughput of the old per-pixel loop and each supported kernel.
+// Returns the number of results written.
+int pal_convert_bench(pal_bench_result *results, int max_results);
+
+#endif // _PAL_CONVERT_H
@@ -0,0 +1,35 @@
+#ifndef _SCALERS_H
+#define _SCALERS_H
+
+#include <SDL2/SDL.h>
+#include "utils/list.h"
+#include "plugins/scaler_plugin.h"
+
+/*
+ * Built-in scalers: "Nearest", "HQX" (hqx-style) and "XBR" (xBR-style).
+ * They use the same interface as the scaler plugins, and take RGBA pixels.
+ * Large images are split into row bands that run on the worker pool.
+ */
+
+typedef struct scaler_bench_result_t {
+    const char *name;
+    int factor;
+    double mpix_s; // Output megapixels per second
+} scaler_bench_result;
+
+// Returns 0 and fills in the scaler if a built-in one has the name
+int scalers_get(scaler_plugin *scaler, const char *name);
+
+// Appends base_plugin pointers for the built-in scalers
+int scalers_get_list(list *tlist);
+
+// Scales a 320x200 image with every built-in scaler and factor.
+// Returns the number of results written.
+int scalers_bench(scaler_bench_result *results, int max_results);
+
+// Scales w x h RGBA pixels into a streaming texture of the scaled size. The pixels are
+// scaled straight into the texture when its rows are not padded, otherwise into tmp
+// (which must hold the scaled image) and copied over. A factor of 1 only copies.
+int scaler_scale_to_texture(scaler_plugin *scaler, SDL_Texture *tex, const char *in, int w, int h, int factor, char *tmp);
+
+#endif // _SCALERS_H
@@ -3,9 +3,48 @@
 
 #include <stdint.h>
 
+// How many past versions remember which palette entries they changed
+#define SCREEN_PALETTE_HISTORY 32
+
+// One bit per palette index
+#define PAL_SET_WORDS 8
+#define PAL_SET_ADD(set, idx) ((set)[(uint8_t)(idx) >> 5] |= 1u << ((uint8_t)(idx) & 31))
+
 typedef struct {
     uint8_t data[256][3];
     unsigned int version;
+
+    // Palette contents as of the current version, and the range of
+    // entries that each of the recent versions changed.
+    uint8_t committed[256][3];
+    uint8_t changed_first[SCREEN_PALETTE_HISTORY];
+    uint8_t changed_last[SCREEN_PALETTE_HISTORY];
 } screen_palette;
 
+void screen_palette_init(screen_palette *pal);
+
+// Compares data against the last committed version. If any entries differ,
+// a new version is made, and the changed range is recorded for it.
+// Returns 1 if the version changed, 0 otherwise.
+int screen_palette_commit(screen_palette *pal);
+
+// Makes a new version where all entries count as changed
+void screen_palette_invalidate(screen_palette *pal);
+
+// Fills in the set of entries changed since the given version.
+// Returns 1 if the version is too old to tell, 0 otherwise.
+int screen_palette_get_changes(const screen_palette *pal, unsigned int version, uint32_t *changed);
+
+// Checks whether any entry in the used set is in the changed set.
+// Indices below 48 are shifted by pal_offset, the same way as in surface_to_rgba().
+int screen_palette_uses_changed(const uint32_t *changed, const uint32_t *used, uint8_t pal_offset);
+
+// Checks whether any entry in the used set has changed since the given version.
+// Indices below 48 are shifted by pal_offset, the same way as in surface_to_rgba().
+// A NULL set means that every entry is used.
+int screen_palette_changed_since(const screen_palette *pal,
+                                 unsigned int version,
+                                 const uint32_t *used,
+                                 uint8_t pal_offset);
+
 #endif // _SCREEN_PALETTE
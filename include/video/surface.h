@@ -6,13 +6,68 @@
 #include "video/screen_palette.h"
 #include "resources/palette.h"
 
-typedef struct {
+typedef struct surface_t surface;
+
+// One run of opaque pixels on a row of a run-length encoded surface
+typedef struct surface_span_t {
+    uint16_t x;
+    uint16_t len;
+    uint32_t pixels; // Offset of the run's first pixel in surface_rle.pixels
+} surface_span;
+
+// Run-length encoded paletted surface. Only opaque pixels are kept.
+// The whole thing is a single allocation.
+typedef struct surface_rle_t {
+    uint32_t *rows; // h + 1 entries; spans of row y are rows[y] .. rows[y + 1] - 1
+    surface_span *spans;
+    uint8_t *pixels;
+    int bytes;
+} surface_rle;
+
+// Part of a surface, and the palette indices used in it; see surface.regions
+typedef struct surface_region_t {
+    int x;
+    int y;
+    int w;
+    int h;
+    uint32_t pal_used[PAL_SET_WORDS];
+} surface_region;
+
+struct surface_t {
     int w;
     int h;
     int type;
     char *data;
     char *stencil;
-} surface;
+
+    // If set, a copy of this surface is packed into an atlas page at atlas_x, atlas_y
+    surface *atlas_page;
+    int atlas_x;
+    int atlas_y;
+
+    // Palette indices that appear in data. Surfaces that are drawn to after
+    // creation have every bit set, since their contents are not tracked.
+    uint32_t pal_used[PAL_SET_WORDS];
+
+    // Atlas pages list the area of each surface packed into them, so that
+    // a palette change only needs to redraw the areas that use the changed entries.
+    surface_region *regions;
+    int region_count;
+
+    // If set, the surface is run-length encoded, and data and stencil are NULL.
+    // Functions that modify the surface unpack it first.
+    surface_rle *rle;
+
+    // Changes whenever the contents do; unique across all surfaces
+    unsigned int version;
+
+    // Texture cache slot, valid only while the slot generation still matches
+    int tcache_slot;
+    unsigned int tcache_gen;
+
+    // Number of holders of a malloc'd surface; see surface_ref() and surface_release()
+    int refs;
+};
 
 enum {
     SURFACE_TYPE_RGBA,
@@ -30,6 +85,8 @@ void surface_create_from_data(surface *sur, int type, int w, int h, const char *
 void surface_copy(surface *dst, surface *src);
 void surface_copy_ex(surface *dst, surface *src);
 void surface_free(surface *sur);
+surface* surface_ref(surface *sur);
+void surface_release(surface *sur);
 void surface_clear(surface *sur);
 void surface_fill(surface *sur, color c);
 void surface_sub(surface *dst,
@@ -38,6 +95,11 @@ void surface_sub(surface *dst,
                  int src_x, int src_y,
                  int w, int h,
                  int method);
+void surface_rle_pack(surface *sur);
+void surface_rle_unpack(surface *sur);
+void surface_rle_decode(surface *sur, char *data, char *stencil, int pitch);
+int surface_get_stencil(surface *sur, int x, int y);
+int surface_get_bytes(surface *sur);
 void surface_convert_to_rgba(surface *sur, screen_palette *pal, int pal_offset);
 int surface_get_type(surface *sur);
 void surface_to_rgba(surface *sur,
@@ -45,6 +107,12 @@ void surface_to_rgba(surface *sur,
                      screen_palette *pal,
                      char *remap_table,
                      uint8_t pal_offset);
+void surface_to_rgba_rect(surface *sur,
+                          char *dst,
+                          const SDL_Rect *rect,
+                          screen_palette *pal,
+                          char *remap_table,
+                          uint8_t pal_offset);
 void surface_additive_blit(surface *dst,
                            surface *src,
                            int dst_x, int dst_y,
@@ -54,6 +122,13 @@ void surface_alpha_blit(surface *dst,
                         surface *src,
                         int dst_x, int dst_y,
                         SDL_RendererFlip flip);
+void surface_blend_blit(surface *dst,
+                        surface *src,
+                        int dst_x, int dst_y,
+                        SDL_RendererFlip flip,
+                        uint8_t opacity,
+                        color color_mod);
+void surface_blend_scaled(char *dst, int dst_pitch, surface *src, int factor);
 int surface_to_texture(surface *src,
                        SDL_Texture *tex,
                        screen_palette *pal,
@@ -6,14 +6,62 @@
 #include "video/screen_palette.h"
 #include "plugins/scaler_plugin.h"
 
+typedef struct tcache_stats_t {
+    // Last finished frame
+    unsigned int frame_hits;
+    unsigned int frame_misses;
+    unsigned int frame_evictions;
+    unsigned int frame_deferred;
+    size_t frame_upload_bytes;
+
+    // Totals since init
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictions;
+    unsigned int deferred;
+    unsigned int overruns; // Frames that wanted to upload more than the upload budget
+
+    unsigned int entries;
+    unsigned int queued; // Uploads waiting for a later frame
+    size_t resident_bytes;
+    size_t budget_bytes;
+    size_t upload_budget_bytes;
+} tcache_stats;
+
+// Deferred uploads are done in priority order. Required textures are never deferred.
+enum TCACHE_PRIORITY {
+    TCACHE_PRIORITY_NORMAL = 0,
+    TCACHE_PRIORITY_HIGH,
+    TCACHE_PRIORITY_REQUIRED,
+};
+
 void tcache_init(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler);
 void tcache_reinit(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler);
 void tcache_close();
 void tcache_clear();
+
+// Returns the texture of the surface. If the upload budget of the frame has been spent,
+// the upload is queued instead, and the old texture returned; or NULL, if there is none yet.
 SDL_Texture* tcache_get(surface *sur,
                         screen_palette *pal,
                         char *remap_table,
-                        uint8_t pal_offset);
-void tcache_tick();
+                        uint8_t pal_offset,
+                        int priority);
+
+// Frees the texture of a surface, if it has one
+void tcache_release(surface *sur);
+
+// Least recently used textures are evicted to keep texture memory under the budget.
+// Textures used in the current frame are never evicted.
+void tcache_set_budget(size_t bytes);
+
+// Limits how many bytes of textures are converted and uploaded per frame. 0 means no limit.
+void tcache_set_upload_budget(size_t bytes);
+
+// Call once per rendered frame, after all drawing is done. Queued uploads are done here,
+// as far as the budget of the next frame allows. Returns 1 if any texture was updated.
+int tcache_frame_end();
+
+void tcache_get_stats(tcache_stats *stats);
 
 #endif // _TCACHE_H
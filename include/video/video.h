@@ -21,6 +21,13 @@ enum VIDEO_FLIP_MODE {
     FLIP_VERTICAL = 0x2,
 };
 
+// Sprites drawn with high priority get their textures updated first,
+// if there is more to upload than fits in one frame.
+enum VIDEO_RENDER_PRIORITY {
+    VIDEO_PRIORITY_NORMAL = 0,
+    VIDEO_PRIORITY_HIGH,
+};
+
 enum VIDEO_RENDERER {
     VIDEO_RENDERER_QUIRKS = 0,
     VIDEO_RENDERER_HW,
@@ -39,8 +46,10 @@ int video_reinit(int window_w,
                  const char* scaler_name,
                  int scale_factor);
 void video_reinit_renderer();
+void video_render_reset();
 void video_get_state(int *w, int *h, int *fs, int *vsync);
 void video_move_target(int x, int y);
+void video_set_render_priority(int priority);
 
 void video_render_sprite(
     surface *sur,
@@ -92,7 +101,7 @@ void video_render_sprite_flip_scale_opacity_tint(
     color tint);
 
 void video_select_renderer(int renderer);
-void video_tick();
+void video_set_frame_scaling(int enabled); // Scale whole frames instead of each sprite
 void video_render_background(surface *sur);
 void video_render_prepare();
 void video_render_finish();
@@ -11,6 +11,7 @@ typedef void (*render_close_cb)(video_state *state);
 typedef void (*render_reinit_cb)(video_state *state);
 typedef void (*render_prepare_cb)(video_state *state);
 typedef void (*render_finish_cb)(video_state *state);
+typedef void (*render_flush_cb)(video_state *state); // Submits any queued draws to the renderer
 
 typedef void (*render_background_cb)(
                     video_state *state,
@@ -31,6 +32,7 @@ typedef struct video_render_cbs_t {
     render_reinit_cb render_reinit;
     render_prepare_cb render_prepare;
     render_finish_cb render_finish;
+    render_flush_cb render_flush;
     render_sprite_fsot_cb render_fsot;
     render_background_cb render_background;
 } video_render_cbs;
@@ -5,11 +5,13 @@
 #include "resources/palette.h"
 #include "video/screen_palette.h"
 #include "video/video_ops.h"
+#include "video/drawlist.h"
 #include "plugins/scaler_plugin.h"
 
 typedef struct video_state_t {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    unsigned int renderer_gen; // Bumped when the renderer, and so all its textures, is recreated
     int w;
     int h;
     int fs;
@@ -19,6 +21,15 @@ typedef struct video_state_t {
     scaler_plugin scaler;
     char scaler_name[16];
 
+    // With frame scaling, everything is drawn at native size (render_scale 1),
+    // and the finished frame is scaled by scale_factor into post_tex on the CPU.
+    // Otherwise render_scale equals scale_factor, and each sprite is scaled on its own.
+    int frame_scaling;
+    int render_scale;
+    SDL_Texture *post_tex;
+    char *post_in;
+    char *post_out;
+
     float fade;
     int target_move_x;
     int target_move_y;
@@ -30,6 +41,17 @@ typedef struct video_state_t {
     palette *base_palette;
     screen_palette *cur_palette;
 
+    // Draws are recorded during the frame, and only drawn at the end if they differ
+    // from the last frame's. With redraw set, the next frame is drawn in full.
+    drawlist draws[2];
+    int cur_draws;
+    int redraw;
+    unsigned int drawn_pal_version;
+
+    // Texture upload priority of new draws, and of the draw being replayed
+    int render_priority;
+    int draw_priority;
+
     // Renderer
     video_render_cbs cb;
     void *userdata;
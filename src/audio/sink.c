@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include "audio/sink.h"
 #include "utils/log.h"
+#include "utils/tracer.h"
 
 unsigned int _sink_global_id = 1;
 
@@ -59,6 +60,7 @@ void sink_stop(audio_sink *sink, unsigned int sid) {
 }
 
 void sink_render(audio_sink *sink) {
+    uint64_t trace_start = tracer_begin();
     iterator it;
     hashmap_iter_begin(&sink->streams, &it);
     hashmap_pair *pair;
@@ -74,6 +76,7 @@ void sink_render(audio_sink *sink) {
             hashmap_delete(&sink->streams, &it);
         }
     }
+    tracer_end("audio", "sink_render", trace_start);
 }
 
 void sink_free(audio_sink *sink) {
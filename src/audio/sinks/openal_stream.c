@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include "audio/sinks/openal_stream.h"
 #include "utils/log.h"
+#include "utils/tracer.h"
 
 #define AUDIO_BUFFER_COUNT 2
 #define AUDIO_BUFFER_SIZE 32768
@@ -82,6 +83,7 @@ void openal_stream_update(audio_stream *stream) {
     ALuint n;
     while(val--) {
         // Fill buffer & re-queue
+        uint64_t trace_start = tracer_begin();
         int ret = source_update(stream->src, buf, AUDIO_BUFFER_SIZE);
         if(ret > 0) {
             alSourceUnqueueBuffers(local->source, 1, &n);
@@ -93,6 +95,7 @@ void openal_stream_update(audio_stream *stream) {
             if(err != AL_NO_ERROR) {
                 PERROR("OpenAL Stream: Error %d while buffering!", err);
             }
+            tracer_end("audio", "buffer_refill", trace_start);
         } else {
             stream_set_finished(stream);
             break;
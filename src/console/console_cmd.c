@@ -1,9 +1,16 @@
 #include <stdio.h>
 #include "game/scenes/arena.h"
+#include "game/particles.h"
 #include "console/console.h"
 #include "console/console_type.h"
 #include "resources/ids.h"
 #include "video/video.h"
+#include "video/tcache.h"
+#include "video/pal_convert.h"
+#include "video/scalers.h"
+#include "profiler.h"
+#include "pacer.h"
+#include "utils/tracer.h"
 
 // utils
 int strtoint(char *input, int *output) {
@@ -101,7 +108,7 @@ int console_cmd_har(game_state *gs, void *userdata, int argc, char **argv) {
             game_player *player = game_state_get_player(gs, 0);
 
             object *har_obj = game_player_get_har(player);
-            object *obj = malloc(sizeof(object));
+            object *obj = game_state_alloc_object(gs);
             vec2i pos = object_get_pos(har_obj);
             int hd = object_get_direction(har_obj);
             object_create(obj, gs, pos, vec2f_create(0,0));
@@ -188,6 +195,19 @@ int console_cmd_renderer(game_state *gs, void *userdata, int argc, char **argv)
 }
 
 
+int console_cmd_frame_scaling(game_state *gs, void *userdata, int argc, char **argv) {
+    if(argc == 2) {
+        int i;
+        if(strtoint(argv[1], &i)) {
+            if(i == 0 || i == 1) {
+                video_set_frame_scaling(i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
 int console_cmd_god(game_state *gs, void *userdata, int argc, char **argv) {
     for(int i = 0;i < game_state_num_players(gs);i++) {
         game_player *gp = game_state_get_player(gs, i);
@@ -222,6 +242,178 @@ int console_cmd_ez_destruct(game_state *gs, void *userdata, int argc, char **arg
     return 0;
 }
 
+int console_cmd_prof(game_state *gs, void *userdata, int argc, char **argv) {
+    char buf[64];
+    if(argc == 1) {
+        profiler_set_overlay(!profiler_overlay_enabled());
+        if(profiler_overlay_enabled()) {
+            console_output_addline("Profiler overlay ON");
+        } else {
+            console_output_addline("Profiler overlay OFF");
+        }
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "stats") == 0) {
+        if(!profiler_is_enabled()) {
+            console_output_addline("Profiler is not running");
+            return 0;
+        }
+        for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+            profiler_stats s;
+            profiler_get_stats(i, &s);
+            snprintf(buf, sizeof(buf), "%s: %.2f/%.2f/%.2f ms",
+                     profiler_phase_name(i), s.min, s.avg, s.p99);
+            console_output_addline(buf);
+        }
+        snprintf(buf, sizeof(buf), "draw calls: %u, sprites: %u",
+                 profiler_get_count(PROF_COUNT_DRAW_CALLS), profiler_get_count(PROF_COUNT_SPRITES));
+        console_output_addline(buf);
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "csv") == 0) {
+        profiler_csv_close();
+        console_output_addline("Profiler CSV dump OFF");
+        return 0;
+    } else if(argc == 3 && strcmp(argv[1], "csv") == 0) {
+        if(profiler_csv_open(argv[2])) {
+            return 1;
+        }
+        console_output_addline("Profiler CSV dump ON");
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_trace(game_state *gs, void *userdata, int argc, char **argv) {
+    char buf[64];
+    if(argc >= 2 && strcmp(argv[1], "start") == 0) {
+        int events = TRACER_DEFAULT_EVENTS;
+        if(argc == 3 && (!strtoint(argv[2], &events) || events <= 0)) {
+            return 1;
+        }
+        if(tracer_start(events)) {
+            return 1;
+        }
+        console_output_addline("Tracer ON");
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "stop") == 0) {
+        tracer_stop();
+        snprintf(buf, sizeof(buf), "Tracer OFF, %u events buffered", tracer_event_count());
+        console_output_addline(buf);
+        return 0;
+    } else if(argc == 3 && strcmp(argv[1], "dump") == 0) {
+        if(tracer_flush(argv[2])) {
+            return 1;
+        }
+        snprintf(buf, sizeof(buf), "Wrote %u events", tracer_event_count());
+        console_output_addline(buf);
+        return 0;
+    }
+    return 1;
+}
+
+int console_cmd_pacer(game_state *gs, void *userdata, int argc, char **argv) {
+    char buf[64];
+    if(argc == 1) {
+        pacer_stats s;
+        pacer_get_stats(&s);
+        snprintf(buf, sizeof(buf), "Target %d FPS, %u frames, %u missed", pacer_get_target_fps(), s.frames, s.missed);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "Frame time %.2f ms, stddev %.2f ms", s.avg, s.stddev);
+        console_output_addline(buf);
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "reset") == 0) {
+        pacer_reset_stats();
+        return 0;
+    } else if(argc == 2) {
+        int fps;
+        if(strtoint(argv[1], &fps) && fps >= 0) {
+            pacer_set_target_fps(fps);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int console_cmd_tcache(game_state *gs, void *userdata, int argc, char **argv) {
+    char buf[80];
+    if(argc == 1) {
+        tcache_stats s;
+        tcache_get_stats(&s);
+        snprintf(buf, sizeof(buf), "Last frame: %u hits, %u misses, %u evictions",
+                 s.frame_hits, s.frame_misses, s.frame_evictions);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "Total: %u hits, %u misses, %u evictions",
+                 s.hits, s.misses, s.evictions);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "%u textures, %u/%u kB",
+                 s.entries, (unsigned int)(s.resident_bytes / 1024), (unsigned int)(s.budget_bytes / 1024));
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "Uploads: %u/%u kB last frame, %u deferred, %u queued",
+                 (unsigned int)(s.frame_upload_bytes / 1024), (unsigned int)(s.upload_budget_bytes / 1024),
+                 s.frame_deferred, s.queued);
+        console_output_addline(buf);
+        snprintf(buf, sizeof(buf), "Total: %u deferred, %u frames over budget", s.deferred, s.overruns);
+        console_output_addline(buf);
+        return 0;
+    } else if(argc == 3 && strcmp(argv[1], "budget") == 0) {
+        int mb;
+        if(strtoint(argv[2], &mb) && mb > 0) {
+            tcache_set_budget((size_t)mb * 1024 * 1024);
+            return 0;
+        }
+    } else if(argc == 3 && strcmp(argv[1], "upload") == 0) {
+        int kb;
+        if(strtoint(argv[2], &kb) && kb >= 0) {
+            tcache_set_upload_budget((size_t)kb * 1024);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int console_cmd_bench(game_state *gs, void *userdata, int argc, char **argv) {
+    char buf[64];
+    if(argc == 2 && strcmp(argv[1], "pal") == 0) {
+        pal_bench_result results[8];
+        int n = pal_convert_bench(results, 8);
+        snprintf(buf, sizeof(buf), "Palette conversion, using %s:", pal_convert_kernel_name());
+        console_output_addline(buf);
+        for(int i = 0; i < n; i++) {
+            snprintf(buf, sizeof(buf), " %-10s %8.1f MP/s", results[i].name, results[i].mpix_s);
+            console_output_addline(buf);
+        }
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "scale") == 0) {
+        scaler_bench_result results[16];
+        int n = scalers_bench(results, 16);
+        console_output_addline("Scalers, 320x200 source, output MP/s:");
+        for(int i = 0; i < n; i++) {
+            snprintf(buf, sizeof(buf), " %-8s x%d %8.1f MP/s", results[i].name, results[i].factor, results[i].mpix_s);
+            console_output_addline(buf);
+        }
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "collide") == 0) {
+        collide_bench_result results[8];
+        int n = game_state_collide_bench(results, 8);
+        console_output_addline("Collision pass, per tick:");
+        for(int i = 0; i < n; i++) {
+            snprintf(buf, sizeof(buf), " %-10s %3d objects %8.2f us %4u calls",
+                     results[i].name, results[i].objects, results[i].us_per_tick, results[i].calls_per_tick);
+            console_output_addline(buf);
+        }
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "particles") == 0) {
+        particle_bench_result results[8];
+        int n = particles_bench(results, 8);
+        console_output_addline("Particle update, per tick:");
+        for(int i = 0; i < n; i++) {
+            snprintf(buf, sizeof(buf), " %4d particles %8.2f us", results[i].particles, results[i].us_per_tick);
+            console_output_addline(buf);
+        }
+        return 0;
+    }
+    return 1;
+}
+
 void console_init_cmd() {
     // Add console commands
     console_add_cmd("h",     &console_cmd_history,  "show command history");
@@ -237,7 +429,13 @@ void console_init_cmd() {
     console_add_cmd("stun",  &console_cmd_stun,   "Stun the other player");
     console_add_cmd("rein",  &console_cmd_rein,   "R-E-I-N!");
     console_add_cmd("rdr",   &console_cmd_renderer, "Renderer (0=sw,1=hw)");
+    console_add_cmd("fscale", &console_cmd_frame_scaling, "Scale whole frames instead of sprites (0=off,1=on)");
     console_add_cmd("god",   &console_cmd_god,  "Enable god mode");
     console_add_cmd("kreissack",   &console_kreissack,  "Fight Kreissack");
     console_add_cmd("ez-destruct",  &console_cmd_ez_destruct,  "Punch = destruction, kick = scrap");
+    console_add_cmd("prof",  &console_cmd_prof,  "Frame profiler. usage: prof (overlay), prof stats, prof csv [file], prof csv (stop)");
+    console_add_cmd("pacer", &console_cmd_pacer, "Frame pacer. usage: pacer (stats), pacer reset, pacer [fps] (0 = tick rate)");
+    console_add_cmd("tcache", &console_cmd_tcache, "Texture cache. usage: tcache (stats), tcache budget [MB], tcache upload [kB] (0 = no limit)");
+    console_add_cmd("bench", &console_cmd_bench, "Microbenchmarks. usage: bench pal, bench scale, bench collide, bench particles");
+    console_add_cmd("trace", &console_cmd_trace, "Timeline tracer. usage: trace start [events], trace stop, trace dump [file]");
 }
@@ -1,7 +1,6 @@
 #include <math.h>
 #include "controller/ai_controller.h"
 #include "game/objects/har.h"
-#include "game/objects/scrap.h"
 #include "game/objects/projectile.h"
 #include "game/protos/intersect.h"
 #include "game/protos/object_specializer.h"
@@ -209,9 +208,9 @@ int is_valid_move(af_move *move, har *h) {
     return 0;
 }
 
-int maybe(int difficulty) {
+int maybe(struct random_t *r, int difficulty) {
     // make chance of blocking exponentially better as the difficulty inreases
-    int a = rand_int(49);
+    int a = random_int(r, 49);
     int b = difficulty*difficulty;
     /*DEBUG("maybe %d, %d < %d : %s", difficulty, a, b, a < b ? "true" : "false");*/
     if(a < b) {
@@ -230,7 +229,7 @@ int ai_block_har(controller *ctrl, ctrl_event **ev) {
 
     // XXX TODO get maximum move distance from the animation object
     if(fabsf(o_enemy->pos.x - o->pos.x) < 100) {
-        if(h_enemy->executing_move && maybe(a->difficulty)) {
+        if(h_enemy->executing_move && maybe(&o->gs->rand_state, a->difficulty)) {
             if(har_is_crouching(h_enemy)) {
                 a->cur_act = (o->direction == OBJECT_FACE_RIGHT ? ACT_DOWNLEFT : ACT_DOWNRIGHT);
                 controller_cmd(ctrl, a->cur_act, ev);
@@ -256,7 +255,7 @@ int ai_block_projectile(controller *ctrl, ctrl_event **ev) {
         if(projectile_get_owner(o_prj) == o)  {
             continue;
         }
-        if(o_prj->cur_sprite && maybe(a->difficulty)) {
+        if(o_prj->cur_sprite && maybe(&o->gs->rand_state, a->difficulty)) {
             vec2i pos_prj = vec2i_add(object_get_pos(o_prj), o_prj->cur_sprite->pos);
             vec2i size_prj = object_get_size(o_prj);
             if (object_get_direction(o_prj) == OBJECT_FACE_LEFT) {
@@ -322,7 +321,7 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
         int ch = str_at(&a->selected_move->move_string, a->move_str_pos);
         controller_cmd(ctrl, char_to_act(ch, o->direction), ev);
 
-    } else if(rand_int(100) < a->difficulty) {
+    } else if(random_int(&o->gs->rand_state, 100) < a->difficulty) {
         af_move *selected_move = NULL;
         int top_value = 0;
 
@@ -332,7 +331,7 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
             if((move = af_get_move(h->af_data, i))) {
                 move_stat *ms = &a->move_stats[i];
                 if(is_valid_move(move, h)) {
-                    int value = ms->value + rand_int(10);
+                    int value = ms->value + random_int(&o->gs->rand_state, 10);
                     if (ms->min_hit_dist != -1){
                         if (ms->last_dist < ms->max_hit_dist+5 && ms->last_dist > ms->min_hit_dist+5){
                             value += 2;
@@ -344,7 +343,7 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
                     value -= ms->attempts/2;
                     value -= ms->consecutive*2;
 
-                    if (is_special_move(move) && !maybe(a->difficulty)) {
+                    if (is_special_move(move) && !maybe(&o->gs->rand_state, a->difficulty)) {
                         DEBUG("skipping special move %s because of difficulty", str_c(&move->move_string));
                         continue;
                     }
@@ -375,8 +374,8 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
         }
     } else {
         // Change action after 30 ticks
-        if(a->act_timer <= 0 && rand_int(100) > 88){
-            int p = rand_int(100);
+        if(a->act_timer <= 0 && random_int(&o->gs->rand_state, 100) > 88){
+            int p = random_int(&o->gs->rand_state, 100);
             if(p > 40){
                 // walk forward
                 a->cur_act = (o->direction == OBJECT_FACE_RIGHT ? ACT_RIGHT : ACT_LEFT);
@@ -398,7 +397,7 @@ int ai_controller_poll(controller *ctrl, ctrl_event **ev) {
         }
 
         // Jump once in a while
-        if(rand_int(100) == 88){
+        if(random_int(&o->gs->rand_state, 100) == 88){
             if(o->vel.x < 0) {
                 controller_cmd(ctrl, ACT_UPLEFT, ev);
             } else if(o->vel.x > 0) {
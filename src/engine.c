@@ -2,8 +2,14 @@
 #include <signal.h> // signal()
 #include <SDL2/SDL.h>
 #include "engine.h"
+#include "profiler.h"
+#include "pacer.h"
+#include "video/tcache.h"
+#include "startup.h"
 #include "utils/log.h"
 #include "utils/config.h"
+#include "utils/random.h"
+#include "utils/tracer.h"
 #include "audio/audio.h"
 #include "audio/music.h"
 #include "resources/sounds_loader.h"
@@ -16,8 +22,21 @@
 #include "game/text/text.h"
 #include "console/console.h"
 
+// Static ticks are run at a fixed 10ms rate, dynamic ticks depend on game speed
+#define STATIC_TICK_MS 10
+
+// At most this many ticks of each kind are run per frame to catch up after a stall.
+// Anything beyond that is dropped, so that the game slows down instead of skipping ahead.
+#define MAX_CATCHUP_TICKS 5
+
 static int run = 0;
 static int start_timeout = 30;
+
+// Resource loaders running in the background during startup
+static int sounds_task = -1;
+static int lang_task = -1;
+static int fonts_task = -1;
+static int altpals_task = -1;
 #ifndef STANDALONE_SERVER
 static int take_screenshot = 0;
 static int enable_screen_updates = 1;
@@ -28,7 +47,33 @@ void exit_handler(int s) {
     run = 0;
 }
 
+// Waits for the background loaders, and frees the ones that succeeded
+static void engine_close_loaders() {
+    if(!startup_wait(altpals_task)) {
+        altpals_close();
+    }
+    if(!startup_wait(fonts_task)) {
+        font_cache_clear();
+        fonts_close();
+    }
+    if(!startup_wait(lang_task)) {
+        lang_close();
+    }
+    if(!startup_wait(sounds_task)) {
+        sounds_loader_close();
+    }
+}
+
 int engine_init() {
+    // These only read their own resource files, so they can be loaded
+    // in the background while the window and audio are being set up.
+    sounds_task = startup_spawn("sounds", sounds_loader_init);
+    lang_task = startup_spawn("language", lang_init);
+    fonts_task = startup_spawn("fonts", fonts_init);
+
+    // Alternate palettes are not needed by the first scene. They are waited for after the first frame.
+    altpals_task = startup_spawn("altpals", altpals_init);
+
 #ifndef STANDALONE_SERVER
     settings *setting = settings_get();
 
@@ -43,29 +88,40 @@ int engine_init() {
     int sink_id = 0;
 
     // Initialize everything.
-    if(video_init(w, h, fs, vsync, scaler, scale_factor)) {
+    int stage = startup_begin("video");
+    video_set_frame_scaling(setting->video.frame_scaling);
+    int ret = video_init(w, h, fs, vsync, scaler, scale_factor);
+    startup_end(stage, ret);
+    if(ret) {
         goto exit_0;
     }
-    if(audio_init(sink_id)) {
+    tcache_set_budget((size_t)setting->video.texture_cache_mb * 1024 * 1024);
+    tcache_set_upload_budget((size_t)setting->video.texture_upload_kb * 1024);
+    stage = startup_begin("audio");
+    ret = audio_init(sink_id);
+    startup_end(stage, ret);
+    if(ret) {
         goto exit_1;
     }
 #endif
 
-    if(sounds_loader_init()) {
+    if(startup_wait(sounds_task) || startup_wait(lang_task) || startup_wait(fonts_task)) {
         goto exit_2;
     }
-    if(lang_init()) {
-        goto exit_3;
-    }
-    if(fonts_init()) {
-        goto exit_4;
-    }
-    if(altpals_init()) {
-        goto exit_5;
-    }
     if(console_init()) {
-        goto exit_6;
+        goto exit_2;
+    }
+#ifdef STANDALONE_SERVER
+    // No frames to hide the rest of the loading behind
+    if(startup_wait(altpals_task)) {
+        console_close();
+        goto exit_2;
     }
+    startup_report();
+#endif
+
+    profiler_init();
+    pacer_init(settings_get()->video.target_fps);
 
     // Return successfully
     run = 1;
@@ -73,34 +129,26 @@ int engine_init() {
     return 0;
 
     // If something failed, close in correct order
-exit_6:
-    altpals_close();
-exit_5:
-    fonts_close();
-exit_4:
-    lang_close();
-exit_3:
-    sounds_loader_close();
-
 exit_2:
 #ifndef STANDALONE_SERVER
     audio_close();
-#endif
 
 exit_1:
-#ifndef STANDALONE_SERVER
     video_close();
-#endif
 
 exit_0:
+#endif
+    engine_close_loaders();
     return 1;
 }
 
 void engine_run(int net_mode) {
+#ifndef STANDALONE_SERVER
     SDL_Event e;
 
     //if mouse_visible_ticks <= 0, hide mouse
     int mouse_visible_ticks = 1000;
+#endif
 
     INFO(" --- BEGIN GAME LOG ---");
 
@@ -125,8 +173,11 @@ void engine_run(int net_mode) {
         }
         video_render_prepare();
         video_render_finish();
+        pacer_frame_rendered(SDL_GetPerformanceCounter());
+        pacer_sleep_until(pacer_render_deadline());
         continue;
     }
+    pacer_reset_stats();
 
     // apply volume settings
     sound_set_volume(settings_get()->sound.sound_vol/10.0f);
@@ -134,15 +185,27 @@ void engine_run(int net_mode) {
 
     // Set up game
     game_state *gs = malloc(sizeof(game_state));
-    if(game_state_create(gs, net_mode)) {
+    if(game_state_create(gs, settings_get(), net_mode, rand_intmax())) {
         return;
     }
 
     // Game loop
-    int frame_start = SDL_GetTicks();
-    int dynamic_wait = 0;
-    int static_wait = 0;
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t static_step = freq * STATIC_TICK_MS / 1000;
+    uint64_t frame_start = SDL_GetPerformanceCounter();
+    uint64_t dynamic_wait = 0;
+    uint64_t static_wait = 0;
+    unsigned int frames = 0;
+    unsigned int catchup_frames = 0;
+    unsigned int dropped_ticks = 0;
+    int first_frame = startup_begin("first_frame");
     while(run && game_state_is_running(gs)) {
+        profiler_frame_begin();
+
+        // Time since last frame
+        uint64_t now = SDL_GetPerformanceCounter();
+        uint64_t dt = now - frame_start;
+        frame_start = now;
 
 #ifndef STANDALONE_SERVER
         // Handle events
@@ -162,6 +225,10 @@ void engine_run(int net_mode) {
                     mouse_visible_ticks = 1000;
                     SDL_ShowCursor(1);
                     break;
+                case SDL_RENDER_TARGETS_RESET:
+                case SDL_RENDER_DEVICE_RESET:
+                    video_render_reset();
+                    break;
                 case SDL_WINDOWEVENT:
                     switch(e.window.event) {
                         case SDL_WINDOWEVENT_MINIMIZED:
@@ -219,51 +286,96 @@ void engine_run(int net_mode) {
 
         // hide mouse after n ticks
         if(mouse_visible_ticks > 0) {
-            mouse_visible_ticks -= SDL_GetTicks() - frame_start;
+            mouse_visible_ticks -= dt * 1000 / freq;
             if(mouse_visible_ticks <= 0) {
                 SDL_ShowCursor(0);
             }
         }
 #endif
         // Tick controllers
+        profiler_begin(PROF_CONTROLLERS);
         game_state_tick_controllers(gs);
+        profiler_end(PROF_CONTROLLERS);
 
-        // Render scene
-        int dt = (SDL_GetTicks() - frame_start);
+        // Run fixed rate ticks for the time that has passed
         dynamic_wait += dt;
         static_wait += dt;
-        while(static_wait > 10) {
+        int steps = 0;
+        while(static_wait >= static_step && steps < MAX_CATCHUP_TICKS) {
             // Static tick for gamestate
+            profiler_begin(PROF_STATIC_TICK);
             game_state_static_tick(gs);
 
             // Tick console
             console_tick();
+            profiler_end(PROF_STATIC_TICK);
 
-            // Tick video (tcache)
-            video_tick();
-
-            static_wait -= 10;
+            static_wait -= static_step;
+            steps++;
+        }
+        if(static_wait >= static_step) {
+            static_wait %= static_step;
         }
-        while(dynamic_wait > game_state_ms_per_dyntick(gs)) {
+
+        // Game speed may change during a tick, so the step is looked up every time
+        steps = 0;
+        uint64_t dynamic_step = freq * game_state_ms_per_dyntick(gs) / 1000;
+        while(dynamic_wait >= dynamic_step && steps < MAX_CATCHUP_TICKS) {
             // Tick scene
+            profiler_begin(PROF_DYNAMIC_TICK);
             game_state_dynamic_tick(gs);
+            profiler_end(PROF_DYNAMIC_TICK);
 
             // Handle waiting period leftover time
-            dynamic_wait -= game_state_ms_per_dyntick(gs);
+            dynamic_wait -= dynamic_step;
+            dynamic_step = freq * game_state_ms_per_dyntick(gs) / 1000;
+            steps++;
+        }
+        if(steps > 1) {
+            catchup_frames++;
+        }
+        if(dynamic_wait >= dynamic_step) {
+            dropped_ticks += dynamic_wait / dynamic_step;
+            DEBUG("Dropped %u dynamic ticks after a stall.", (unsigned int)(dynamic_wait / dynamic_step));
+            dynamic_wait %= dynamic_step;
+        }
+        frames++;
+
+        // Objects are drawn between their last two positions by the leftover time
+        gs->interp = (float)dynamic_wait / (float)dynamic_step;
+
+        // Earliest time the next static or dynamic tick is due
+        uint64_t deadline = now + dynamic_step - dynamic_wait;
+        if(now + static_step - static_wait < deadline) {
+            deadline = now + static_step - static_wait;
         }
-        frame_start = SDL_GetTicks();
 
 #ifndef STANDALONE_SERVER
         // Handle audio
+        profiler_begin(PROF_AUDIO);
         audio_render();
+        profiler_end(PROF_AUDIO);
+
+        // With vsync, presenting the frame does the waiting. Otherwise the pacer decides.
+        int vsync;
+        video_get_state(NULL, NULL, NULL, &vsync);
+        int render = enable_screen_updates && (vsync || pacer_render_due(now));
 
         // Do the actual video rendering jobs
-        if(enable_screen_updates) {
+        if(render) {
 
+            profiler_begin(PROF_RENDER);
             video_render_prepare();
             game_state_render(gs);
+            profiler_render();
             console_render();
+            profiler_end(PROF_RENDER);
+
+            profiler_begin(PROF_RENDER_FINISH);
             video_render_finish();
+            font_cache_frame_end();
+            profiler_end(PROF_RENDER_FINISH);
+            pacer_frame_rendered(SDL_GetPerformanceCounter());
     
             // If screenshot requested, do it here.
             if(take_screenshot) {
@@ -284,16 +396,44 @@ void engine_run(int net_mode) {
                 image_free(&img);
                 take_screenshot = 0;
             }
-        } else {
-            // If screen updates are disabled, then wait
-            SDL_Delay(1);
+        }
+
+        // Sleep until the next tick or frame is due
+        if(!(render && vsync)) {
+            if(enable_screen_updates && !vsync && pacer_get_target_fps() > 0 && pacer_render_deadline() < deadline) {
+                deadline = pacer_render_deadline();
+            }
+            profiler_begin(PROF_SLEEP);
+            pacer_sleep_until(deadline);
+            profiler_end(PROF_SLEEP);
         }
 #else
-        // In standalone, just wait.
-        SDL_Delay(1);
+        // In standalone, just wait for the next tick.
+        profiler_begin(PROF_SLEEP);
+        pacer_sleep_until(deadline);
+        profiler_end(PROF_SLEEP);
 #endif // STANDALONE_SERVER
+        profiler_frame_end();
+
+        // First frame is out, finish up the deferred startup work
+        if(first_frame >= 0) {
+            startup_end(first_frame, 0);
+            if(startup_wait(altpals_task)) {
+                PERROR("Could not load alternate palettes, bailing.");
+                run = 0;
+            }
+            startup_report();
+            first_frame = -1;
+        }
     }
 
+    DEBUG("Ran %u frames; %u needed catch-up ticks, %u dynamic ticks were dropped.",
+          frames, catchup_frames, dropped_ticks);
+    pacer_stats ps;
+    pacer_get_stats(&ps);
+    DEBUG("Rendered %u frames at %.2f +- %.2f ms; %u missed deadlines.",
+          ps.frames, ps.avg, ps.stddev, ps.missed);
+
     // Free scene object
     game_state_free(gs);
     free(gs);
@@ -302,8 +442,12 @@ void engine_run(int net_mode) {
 }
 
 void engine_close() {
+    profiler_close();
     console_close();
-    altpals_close();
+    if(!startup_wait(altpals_task)) {
+        altpals_close();
+    }
+    font_cache_clear();
     fonts_close();
     lang_close();
     sounds_loader_close();
@@ -311,5 +455,7 @@ void engine_close() {
     audio_close();
     video_close();
 #endif
+    // Background loaders may have been tracing until now
+    tracer_close();
     INFO("Engine deinit successful.");
 }
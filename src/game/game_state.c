@@ -5,6 +5,8 @@
 #include "controller/joystick.h"
 #include "utils/log.h"
 #include "utils/miscmath.h"
+#include "utils/tracer.h"
+#include "resources/preloader.h"
 #include "game/utils/serial.h"
 #include "resources/ids.h"
 #include "resources/pilots.h"
@@ -12,11 +14,14 @@
 #include "video/video.h"
 #include "video/tcache.h"
 #include "game/game_state.h"
+#include "game/particles.h"
 #include "game/utils/settings.h"
 #include "game/utils/ticktimer.h"
 #include "game/protos/scene.h"
 #include "game/protos/object.h"
 #include "game/protos/intersect.h"
+#include "game/objects/har.h"
+#include "game/objects/projectile.h"
 #include "game/scenes/intro.h"
 #include "game/scenes/mainmenu.h"
 #include "game/scenes/credits.h"
@@ -45,16 +50,46 @@ typedef struct {
     object *obj;
 } render_obj;
 
-int game_state_create(game_state *gs, int net_mode) {
+static void game_state_create_pools(game_state *gs) {
+    pool_create(&gs->object_pool, sizeof(object), 64);
+    pool_create(&gs->har_pool, sizeof(har), 2);
+    pool_create(&gs->projectile_pool, sizeof(projectile_local), 16);
+}
+
+static void game_state_free_pools(game_state *gs) {
+    pool_free(&gs->object_pool);
+    pool_free(&gs->har_pool);
+    pool_free(&gs->projectile_pool);
+}
+
+// Anything still allocated belonged to the old scene, and was not freed with it
+static void game_state_reset_pools(game_state *gs) {
+    if(pool_used(&gs->object_pool) > 0) {
+        DEBUG("Reclaiming %u objects left over from the old scene.", pool_used(&gs->object_pool));
+    }
+    pool_reset(&gs->object_pool);
+    pool_reset(&gs->har_pool);
+    pool_reset(&gs->projectile_pool);
+}
+
+int game_state_create(game_state *gs, settings *setting, int net_mode, uint32_t seed) {
     gs->run = 1;
     gs->paused = 0;
     gs->tick = 0;
+    gs->interp = 1.0f;
     gs->int_tick = 0;
     gs->role = ROLE_CLIENT;
-    gs->next_requires_refresh = 0;
     gs->net_mode = net_mode;
-    gs->speed = settings_get()->gameplay.speed;
+    gs->demo_fixed = 0;
+    gs->setting = setting;
+    gs->speed = setting->gameplay.speed;
+    random_seed(&gs->rand_state, seed);
     vector_create(&gs->objects, sizeof(render_obj));
+    game_state_create_pools(gs);
+    gs->particles = malloc(sizeof(particles));
+    particles_create(gs->particles, setting);
+    gs->preload = malloc(sizeof(preloader));
+    preloader_init(gs->preload);
 
     // For screen shake
     gs->screen_shake_horizontal = 0;
@@ -105,9 +140,20 @@ error_1:
 error_0:
     free(gs->sc);
     vector_free(&gs->objects);
+    game_state_free_pools(gs);
+    free(gs->particles);
+    free(gs->preload);
     return 1;
 }
 
+object* game_state_alloc_object(game_state *gs) {
+    return pool_alloc(&gs->object_pool);
+}
+
+void game_state_release_object(game_state *gs, object *obj) {
+    pool_release(&gs->object_pool, obj);
+}
+
 int game_state_add_object(game_state *gs, object *obj, int layer) {
     render_obj o;
     o.obj = obj;
@@ -146,7 +192,7 @@ void game_state_del_animation(game_state *gs, int anim_id) {
         animation *ani = object_get_animation(robj->obj);
         if(ani != NULL && ani->id == anim_id) {
             object_free(robj->obj);
-            free(robj->obj);
+            game_state_release_object(gs, robj->obj);
             vector_delete(&gs->objects, &it);
             DEBUG("Deleted animation %i from game_state.", anim_id);
             return;
@@ -162,7 +208,7 @@ void game_state_del_object(game_state *gs, object *target) {
     while((robj = iter_next(&it)) != NULL) {
         if(target == robj->obj) {
             object_free(robj->obj);
-            free(robj->obj);
+            game_state_release_object(gs, robj->obj);
             vector_delete(&gs->objects, &it);
             return;
         }
@@ -187,7 +233,7 @@ void game_state_clear_hazards_projectiles(game_state *gs) {
     while((robj = iter_next(&it)) != NULL) {
         if(object_get_group(robj->obj) == GROUP_PROJECTILE) {
             object_free(robj->obj);
-            free(robj->obj);
+            game_state_release_object(gs, robj->obj);
             vector_delete(&gs->objects, &it);
         }
     }
@@ -197,6 +243,17 @@ void game_state_set_next(game_state *gs, unsigned int next_scene_id) {
     if(gs->next_wait_ticks <= 0) {
         gs->next_wait_ticks = FRAME_WAIT_TICKS;
         gs->next_id = next_scene_id;
+
+        // Start loading the next scene while the old one fades out
+        if(gs->setting->video.crossfade_on && next_scene_id != SCENE_NONE) {
+            int har_a = -1;
+            int har_b = -1;
+            if(is_arena(next_scene_id)) {
+                har_a = game_state_get_player(gs, 0)->har_id;
+                har_b = game_state_get_player(gs, 1)->har_id;
+            }
+            preloader_start(gs->preload, next_scene_id, har_a, har_b);
+        }
     }
 }
 
@@ -204,6 +261,10 @@ scene* game_state_get_scene(game_state *gs) {
     return gs->sc;
 }
 
+settings* game_state_get_settings(game_state *gs) {
+    return gs->setting;
+}
+
 unsigned int game_state_is_running(game_state *gs) {
     return gs->run;
 }
@@ -228,32 +289,21 @@ void game_state_render(game_state *gs) {
     iterator it;
     render_obj *robj;
 
-    // Do palette transformations
+    // Do palette transformations. Only textures that use the
+    // entries that changed since the last frame get redrawn.
     screen_palette *scr_pal = video_get_pal_ref();
-    int pal_changed = 0;
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
-        if(object_palette_transform(robj->obj, scr_pal) == 1) {
-            pal_changed = 1;
-            gs->next_requires_refresh = 1;
-        }
-    }
-
-    // If changes were made to palette, then
-    // all resources that depend on it must be redrawn.
-    // This will take care of it.
-    if(pal_changed) {
-        scr_pal->version++;
-    } else if(gs->next_requires_refresh) {
-        // Because of caching, we might sometimes get stuck to
-        // a bad/old frame. This will fix it.
-        scr_pal->version++;
-        gs->next_requires_refresh = 0;
+        object_palette_transform(robj->obj, scr_pal);
     }
+    screen_palette_commit(scr_pal);
 
     // Render scene background
     scene_render(gs->sc);
 
+    // Particles move between ticks the same way objects do
+    float interp = gs->paused ? 1.0f : gs->interp;
+
     // Get har objects
     object *har[2];
     har[0] = game_state_get_player(gs, 0)->har;
@@ -267,19 +317,23 @@ void game_state_render(game_state *gs) {
             object_render(robj->obj);
         }
     }
+    particles_render(gs->particles, RENDER_LAYER_BOTTOM, interp);
 
     // cast object shadows (scrap, projectiles, etc)
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         object_render_shadow(robj->obj);
     }
+    particles_render_shadows(gs->particles, interp);
 
-    // Render passive HARs here
+    // Render passive HARs here. HAR textures are updated first when uploads are over budget.
+    video_set_render_priority(VIDEO_PRIORITY_HIGH);
     for(int i = 0; i < 2; i++) {
         if(har[i] != NULL && !har_is_active(har[i])) {
             object_render(har[i]);
         }
     }
+    video_set_render_priority(VIDEO_PRIORITY_NORMAL);
 
     // Render MIDDLE layer
     vector_iter_begin(&gs->objects, &it);
@@ -289,13 +343,16 @@ void game_state_render(game_state *gs) {
             object_render(robj->obj);
         }
     }
+    particles_render(gs->particles, RENDER_LAYER_MIDDLE, interp);
 
     // Render active HARs here
+    video_set_render_priority(VIDEO_PRIORITY_HIGH);
     for(int i = 0; i < 2; i++) {
         if(har[i] != NULL && har_is_active(har[i])) {
             object_render(har[i]);
         }
     }
+    video_set_render_priority(VIDEO_PRIORITY_NORMAL);
 
     // Render TOP layer
     vector_iter_begin(&gs->objects, &it);
@@ -305,6 +362,7 @@ void game_state_render(game_state *gs) {
             object_render(robj->obj);
         }
     }
+    particles_render(gs->particles, RENDER_LAYER_TOP, interp);
 
     // If we are in debug mode, handle HAR debug layers
 #ifdef DEBUGMODE
@@ -320,6 +378,8 @@ void game_state_render(game_state *gs) {
 }
 
 int game_load_new(game_state *gs, int scene_id) {
+    uint64_t trace_start = tracer_begin();
+
     // Free old scene
     scene_free(gs->sc);
     free(gs->sc);
@@ -333,9 +393,11 @@ int game_load_new(game_state *gs, int scene_id) {
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         object_free(robj->obj);
-        free(robj->obj);
+        game_state_release_object(gs, robj->obj);
         vector_delete(&gs->objects, &it);
     }
+    game_state_reset_pools(gs);
+    particles_clear(gs->particles);
 
     // Initialize new scene with BK data etc.
     gs->sc = malloc(sizeof(scene));
@@ -419,29 +481,191 @@ int game_load_new(game_state *gs, int scene_id) {
     gs->this_id = scene_id;
     gs->next_id = scene_id;
     gs->tick = 0;
+    preloader_clear(gs->preload);
+    tracer_end("game", "game_load_new", trace_start);
     return 0;
 
 error_1:
     scene_free(gs->sc);
 error_0:
     free(gs->sc);
+    preloader_clear(gs->preload);
+    tracer_end("game", "game_load_new", trace_start);
     return 1;
 }
 
-void game_state_call_collide(game_state *gs) {
+typedef void (*collide_pair_cb)(object *a, object *b);
+
+static int collide_groups_match(object *a, object *b) {
+    if(a->group != b->group || a->group == OBJECT_NO_GROUP || b->group == OBJECT_NO_GROUP) {
+        return (a->layers & b->layers) != 0;
+    }
+    return 0;
+}
+
+// Old loop; every pair of objects. Kept for the benchmark.
+static void collide_all_pairs(vector *objects, collide_pair_cb cb) {
     object *a, *b;
-    unsigned int size = vector_size(&gs->objects);
+    unsigned int size = vector_size(objects);
     for(int i = 0; i < size; i++) {
-        a = ((render_obj*)vector_get(&gs->objects, i))->obj;
+        a = ((render_obj*)vector_get(objects, i))->obj;
         for(int k = i+1; k < size; k++) {
-            b = ((render_obj*)vector_get(&gs->objects, k))->obj;
-            if(a->group != b->group || a->group == OBJECT_NO_GROUP || b->group == OBJECT_NO_GROUP) {
-                if(a->layers & b->layers) {
-                    object_collide(a, b);
+            b = ((render_obj*)vector_get(objects, k))->obj;
+            if(collide_groups_match(a, b)) {
+                cb(a, b);
+            }
+        }
+    }
+}
+
+// Finds the horizontal span covered by the current sprite of the object, and by the
+// hit points of its current frame; see intersect_sprite_hitpoint(). Returns 0 if the
+// object has no sprite, and so can not hit or be hit.
+static int collide_get_span(object *obj, int *x0, int *x1) {
+    if(obj->cur_sprite == NULL) {
+        return 0;
+    }
+    int x = object_get_pos(obj).x;
+    int w = object_get_size(obj).x;
+    int sx = obj->cur_sprite->pos.x;
+    int dir = (object_get_direction(obj) == OBJECT_FACE_LEFT) ? -1 : 1;
+    if(dir > 0) {
+        *x0 = x + sx;
+        *x1 = x + sx + w;
+    } else {
+        *x0 = x - sx - w;
+        *x1 = x - sx;
+    }
+    if(obj->cur_animation != NULL) {
+        iterator it;
+        collision_coord *cc;
+        vector_iter_begin(&obj->cur_animation->collision_coords, &it);
+        while((cc = iter_next(&it)) != NULL) {
+            if(cc->frame_index != obj->cur_sprite->id) continue;
+            int hx = x + dir * cc->pos.x;
+            if(hx < *x0) *x0 = hx;
+            if(hx > *x1) *x1 = hx;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Only the first object of a pair gets its collide callback called, so pairs are only
+ * looked for after objects that have one. Objects that both have a callback (HARs) are
+ * always paired, since they react to closeness and throws, not just to overlapping sprites.
+ * Other objects (projectiles, hazards) can only be hit through sprite hit points, so they
+ * are skipped if their spans don't overlap. Callbacks may move objects and change their
+ * animations, so spans are taken just before each pair is tested; the calls and their
+ * order stay the same as with the plain pair loop.
+ */
+static void collide_broadphase(vector *objects, collide_pair_cb cb) {
+    object *a, *b;
+    int a0, a1, b0, b1;
+    unsigned int size = vector_size(objects);
+    for(int i = 0; i < size; i++) {
+        a = ((render_obj*)vector_get(objects, i))->obj;
+        if(a->collide == NULL) {
+            continue;
+        }
+        int a_span = collide_get_span(a, &a0, &a1);
+        for(int k = i+1; k < size; k++) {
+            b = ((render_obj*)vector_get(objects, k))->obj;
+            if(!collide_groups_match(a, b)) {
+                continue;
+            }
+            if(b->collide == NULL) {
+                if(!a_span || !collide_get_span(b, &b0, &b1) || a1 < b0 || b1 < a0) {
+                    continue;
                 }
             }
+            cb(a, b);
+            a_span = collide_get_span(a, &a0, &a1);
+        }
+    }
+}
+
+void game_state_call_collide(game_state *gs) {
+    collide_broadphase(&gs->objects, object_collide);
+}
+
+#define COLLIDE_BENCH_TICKS 1000
+
+static unsigned int collide_bench_calls;
+
+static void collide_bench_count(object *a, object *b) {
+    collide_bench_calls++;
+}
+
+static void collide_bench_run(collide_bench_result *res,
+                              const char *name,
+                              vector *objects,
+                              void (*loop)(vector*, collide_pair_cb)) {
+    collide_bench_calls = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for(int t = 0; t < COLLIDE_BENCH_TICKS; t++) {
+        loop(objects, collide_bench_count);
+    }
+    uint64_t end = SDL_GetPerformanceCounter();
+    res->name = name;
+    res->objects = vector_size(objects);
+    res->us_per_tick = (double)(end - start) * 1000000.0 / SDL_GetPerformanceFrequency() / COLLIDE_BENCH_TICKS;
+    res->calls_per_tick = collide_bench_calls / COLLIDE_BENCH_TICKS;
+}
+
+int game_state_collide_bench(collide_bench_result *results, int max_results) {
+    static const int counts[] = {50, 200, 400};
+    int n = 0;
+
+    // A game state of its own, so that the random state of the real one is not touched
+    game_state *gs = malloc(sizeof(game_state));
+    memset(gs, 0, sizeof(game_state));
+    random_seed(&gs->rand_state, 0x1234567);
+
+    surface sur;
+    surface_create(&sur, SURFACE_TYPE_PALETTE, 24, 24);
+    sprite spr;
+    sprite_create_custom(&spr, vec2i_create(-12, -24), &sur);
+
+    for(int c = 0; c < 3 && n + 1 < max_results; c++) {
+        vector objects;
+        vector_create(&objects, sizeof(render_obj));
+
+        // Two HARs, then a fight's worth of projectiles, and lots of scrap
+        for(int i = 0; i < counts[c]; i++) {
+            render_obj robj;
+            robj.layer = RENDER_LAYER_MIDDLE;
+            robj.obj = malloc(sizeof(object));
+            object_create(robj.obj, gs, vec2i_create(random_int(&gs->rand_state, NATIVE_W), 190), vec2f_create(0, 0));
+            robj.obj->cur_sprite = &spr;
+            if(i < 2) {
+                object_set_layers(robj.obj, LAYER_HAR | (i == 0 ? LAYER_HAR1 : LAYER_HAR2));
+                object_set_collide_cb(robj.obj, collide_bench_count);
+            } else if(i % 10 == 0) {
+                object_set_layers(robj.obj, LAYER_PROJECTILE | LAYER_HAR2);
+                object_set_group(robj.obj, GROUP_PROJECTILE);
+            } else {
+                object_set_layers(robj.obj, LAYER_SCRAP);
+            }
+            vector_append(&objects, &robj);
         }
+
+        collide_bench_run(&results[n++], "pairs", &objects, collide_all_pairs);
+        collide_bench_run(&results[n++], "broadphase", &objects, collide_broadphase);
+
+        iterator it;
+        render_obj *robj;
+        vector_iter_begin(&objects, &it);
+        while((robj = iter_next(&it)) != NULL) {
+            object_free(robj->obj);
+            free(robj->obj);
+        }
+        vector_free(&objects);
     }
+
+    surface_free(&sur);
+    free(gs);
+    return n;
 }
 
 void game_state_cleanup(game_state *gs) {
@@ -452,7 +676,7 @@ void game_state_cleanup(game_state *gs) {
         if(object_finished(robj->obj)) {
             /*DEBUG("Animation object %d is finished, removing.", robj->obj->cur_animation->id);*/
             object_free(robj->obj);
-            free(robj->obj);
+            game_state_release_object(gs, robj->obj);
             vector_delete(&gs->objects, &it);
         }
     }
@@ -529,7 +753,7 @@ void game_state_static_tick(game_state *gs) {
 // This function is called when the game speed requires it
 void game_state_dynamic_tick(game_state *gs) {
     // We want to load another scene
-    if(gs->this_id != gs->next_id && (gs->next_wait_ticks <= 1 || !settings_get()->video.crossfade_on)) {
+    if(gs->this_id != gs->next_id && (gs->next_wait_ticks <= 1 || !gs->setting->video.crossfade_on)) {
         // If this is the end, set run to 0 so that engine knows to close here
         if(gs->next_id == SCENE_NONE) {
             DEBUG("Next ID is SCENE_NONE! bailing.");
@@ -543,7 +767,7 @@ void game_state_dynamic_tick(game_state *gs) {
             gs->run = 0;
             return;
         }
-        if(settings_get()->video.crossfade_on) {
+        if(gs->setting->video.crossfade_on) {
             gs->this_wait_ticks = FRAME_WAIT_TICKS;
         } else {
             gs->this_wait_ticks = 0;
@@ -591,6 +815,7 @@ void game_state_dynamic_tick(game_state *gs) {
 
         // Tick all objects
         game_state_call_tick(gs, TICK_DYNAMIC);
+        particles_tick(gs->particles);
 
         // Increment tick
         gs->tick++;
@@ -616,7 +841,7 @@ int game_state_num_players(game_state *gs) {
 }
 
 void _setup_keyboard(game_state *gs, int player_id) {
-    settings_keyboard *k = &settings_get()->keys;
+    settings_keyboard *k = &gs->setting->keys;
     // Set up controller
     controller *ctrl = malloc(sizeof(controller));
     game_player *player = game_state_get_player(gs, player_id);
@@ -654,7 +879,7 @@ void _setup_ai(game_state *gs, int player_id) {
     game_player *player = game_state_get_player(gs, player_id);
     controller_init(ctrl);
 
-    ai_controller_create(ctrl, settings_get()->gameplay.difficulty);
+    ai_controller_create(ctrl, gs->setting->gameplay.difficulty);
 
     game_player_set_ctrl(player, ctrl);
     game_player_set_selectable(player, 0);
@@ -672,7 +897,7 @@ int _setup_joystick(game_state *gs, int player_id, const char *joyname, int offs
 }
 
 void reconfigure_controller(game_state *gs) {
-    settings_keyboard *k = &settings_get()->keys;
+    settings_keyboard *k = &gs->setting->keys;
     if (k->ctrl_type1 == CTRL_TYPE_KEYBOARD) {
         _setup_keyboard(gs, 0);
     } else if (k->ctrl_type1 == CTRL_TYPE_GAMEPAD) {
@@ -695,8 +920,8 @@ void game_state_init_demo(game_state *gs) {
         game_player_set_selectable(player, 1);
 
         // select random pilot and har
-        player->pilot_id = rand_int(10);
-        player->har_id = HAR_JAGUAR + rand_int(11);
+        player->pilot_id = random_int(&gs->rand_state, 10);
+        player->har_id = HAR_JAGUAR + random_int(&gs->rand_state, 11);
         chr_score_reset(&player->score, 1);
 
         // set proper color
@@ -715,7 +940,7 @@ void game_state_free(game_state *gs) {
     vector_iter_begin(&gs->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         object_free(robj->obj);
-        free(robj->obj);
+        game_state_release_object(gs, robj->obj);
         vector_delete(&gs->objects, &it);
     }
     vector_free(&gs->objects);
@@ -724,12 +949,18 @@ void game_state_free(game_state *gs) {
     scene_free(gs->sc);
     free(gs->sc);
 
+    // Free anything that was loaded for a scene we never got to
+    preloader_clear(gs->preload);
+    free(gs->preload);
+
     // Free players
     for(int i = 0; i < 2; i++) {
         game_player_set_ctrl(gs->players[i], NULL);
         game_player_free(gs->players[i]);
         free(gs->players[i]);
     }
+    game_state_free_pools(gs);
+    free(gs->particles);
 }
 
 int game_state_ms_per_dyntick(game_state *gs) {
@@ -747,7 +978,7 @@ int game_state_ms_per_dyntick(game_state *gs) {
 int game_state_serialize(game_state *gs, serial *ser) {
     // serialize tick time and random seed, so client can reply state from this point
     serial_write_int32(ser, game_state_get_tick(gs));
-    serial_write_int32(ser, rand_get_seed());
+    serial_write_int32(ser, random_get_seed(&gs->rand_state));
     serial_write_int32(ser, game_state_is_paused(gs));
 
     object *har[2];
@@ -789,14 +1020,14 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
 #endif
     gs->tick = serial_read_int32(ser);
     int endtick = gs->tick + ceil(rtt / 2.0f);
-    rand_seed(serial_read_int32(ser));
+    random_seed(&gs->rand_state, serial_read_int32(ser));
     game_state_set_paused(gs, serial_read_int32(ser));
 
     for(int i = 0; i < 2; i++) {
         // Declare some vars
         game_player *player = game_state_get_player(gs, i);
         game_state_del_object(gs, player->har);
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(gs);
 
         // Create object and specialize it as HAR.
         // Errors are unlikely here, but check anyway.
@@ -827,7 +1058,7 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
     while((robj = iter_next(&it)) != NULL) {
         if (robj->obj->group == GROUP_PROJECTILE) {
             object_free(robj->obj);
-            free(robj->obj);
+            game_state_release_object(gs, robj->obj);
             vector_delete(&gs->objects, &it);
         }
     }
@@ -835,7 +1066,7 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
     uint8_t count = serial_read_int8(ser);
 
     for (int i = 0; i < count; i++) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(gs);
         int layer = serial_read_int8(ser);
         object_create(obj, gs, vec2i_create(0, 0), vec2f_create(0,0));
         object_unserialize(obj, ser, gs);
@@ -852,13 +1083,16 @@ int game_state_unserialize(game_state *gs, serial *ser, int rtt) {
     // tick things back to the current time
     DEBUG("replaying %d ticks", endtick - gs->tick);
     DEBUG("adjusting clock from %d to %d (%d)", oldtick, endtick, ceil(rtt / 2.0f));
+    uint64_t trace_start = tracer_begin();
     while (gs->tick <= endtick) {
         game_state_cleanup(gs);
         game_state_call_move(gs);
         game_state_call_collide(gs);
         game_state_call_tick(gs, TICK_DYNAMIC);
+        particles_tick(gs->particles);
         gs->tick++;
     }
+    tracer_end("net", "unserialize_replay", trace_start);
     DEBUG("replay done");
 
     return 0;
@@ -4,13 +4,13 @@
 #include <math.h>
 
 #include "game/objects/har.h"
-#include "game/objects/scrap.h"
 #include "game/objects/projectile.h"
 #include "game/objects/arena_constraints.h"
 #include "game/protos/intersect.h"
 #include "game/protos/object_specializer.h"
 #include "game/scenes/arena.h"
 #include "game/game_state.h"
+#include "game/particles.h"
 #include "game/utils/serial.h"
 #include "resources/af_loader.h"
 #include "resources/ids.h"
@@ -29,7 +29,7 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount);
 void har_free(object *obj) {
     har *h = object_get_userdata(obj);
     list_free(&h->har_hooks);
-    free(h);
+    pool_release(&obj->gs->har_pool, h);
 }
 
 /* hooks */
@@ -277,34 +277,34 @@ int har_is_blocking(har *h, af_move *move) {
 }
 
 int har_is_invincible(object *obj, af_move *move) {
-    if (player_frame_isset(obj, "zz")) {
+    if (player_frame_isset(obj, TAG_ZZ)) {
         // blocks everything
         return 1;
     }
     switch (move->category) {
         // XX 'zg' is not handled here, but the game doesn't use it...
         case CAT_LOW:
-            if (player_frame_isset(obj, "zl")) {
+            if (player_frame_isset(obj, TAG_ZL)) {
                 return 1;
             }
             break;
         case CAT_MEDIUM:
-            if (player_frame_isset(obj, "zm")) {
+            if (player_frame_isset(obj, TAG_ZM)) {
                 return 1;
             }
             break;
         case CAT_HIGH:
-            if (player_frame_isset(obj, "zh")) {
+            if (player_frame_isset(obj, TAG_ZH)) {
                 return 1;
             }
             break;
         case CAT_JUMPING:
-            if (player_frame_isset(obj, "zj")) {
+            if (player_frame_isset(obj, TAG_ZJ)) {
                 return 1;
             }
             break;
         case CAT_PROJECTILE:
-            if (player_frame_isset(obj, "zp")) {
+            if (player_frame_isset(obj, TAG_ZP)) {
                 return 1;
             }
             break;
@@ -335,7 +335,7 @@ void cb_har_spawn_object(object *parent, int id, vec2i pos, int g, void *userdat
     // ... otherwise expect it is a projectile
     af_move *move = af_get_move(h->af_data, id);
     if(move != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, pos, vec2f_create(0,0));
         object_set_userdata(obj, h);
         object_set_stl(obj, object_get_stl(parent));
@@ -403,13 +403,13 @@ void har_move(object *obj) {
             // prevent har from sliding after defeat
             if(h->state != STATE_DEFEAT &&
                h->health <= 0 && h->endurance <= 0 &&
-               obj->animation_state.parser->current_frame.is_final_frame) {
+               player_is_final_frame(obj)) {
                 h->state = STATE_DEFEAT;
                 har_set_ani(obj, ANIM_DEFEAT, 0);
                 har_event_defeat(h);
             } else if(pos.y >= (ARENA_FLOOR-5) &&
                       IS_ZERO(vel.x) &&
-                      obj->animation_state.parser->current_frame.is_final_frame) {
+                      player_is_final_frame(obj)) {
                 if (h->state == STATE_FALLEN) {
                     h->state = STATE_STANDING_UP;
                     har_set_ani(obj, ANIM_STANDUP, 0);
@@ -456,8 +456,6 @@ void har_take_damage(object *obj, str* string, float damage) {
 
     // chronos' stasis does not have a hit animation
     if (string->data) {
-        sd_stringparser_frame f;
-        const sd_stringparser_tag_value *v;
         h->state = STATE_RECOIL;
         // Set hit animation
         object_set_animation(obj, &af_get_move(h->af_data, ANIM_DAMAGE)->ani);
@@ -480,9 +478,8 @@ void har_take_damage(object *obj, str* string, float damage) {
         h->flinching = 1;
         // XXX hack - if the first frame has the 'k' tag, treat it as some vertical knockback
         // we can't do this in player.c because it breaks the jaguar leap, which also uses the 'k' tag.
-        sd_stringparser_peek(obj->animation_state.parser, 0, &f);
-        sd_stringparser_get_tag(f.parser, f.id, "k", &v);
-        if (v->is_set) {
+        const animation_frame *first = animation_frames_get(obj->animation_state.frames, 0);
+        if (first != NULL && animation_frame_isset(first, TAG_K)) {
                 obj->vel.y -= 7;
         }
     }
@@ -493,10 +490,19 @@ void har_spawn_oil(object *obj, vec2i pos, int amount, float gravity, int layer)
     float velx, vely;
     har *h = object_get_userdata(obj);
 
+    particle_def def;
+    def.ani = &af_get_move(h->af_data, ANIM_BURNING_OIL)->ani;
+    def.stl = object_get_stl(obj);
+    def.gravity = gravity;
+    def.layer = layer;
+    def.flags = 0;
+    def.pal_offset = 0;
+    def.warmup = 1;
+
     // burning oil
     for(int i = 0; i < amount; i++) {
         // Calculate velocity etc.
-        rv = rand_int(100) / 100.0f - 0.5;
+        rv = random_int(&obj->gs->rand_state, 100) / 100.0f - 0.5;
         velx = (5 * cos(90 + i-(amount) / 2 + rv)) * object_get_direction(obj);
         vely = -12 * sin(i / amount + rv);
 
@@ -504,17 +510,7 @@ void har_spawn_oil(object *obj, vec2i pos, int amount, float gravity, int layer)
         // (to prevent floating scrap objects)
         if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
-        // Create the object
-        object *scrap = malloc(sizeof(object));
-        int anim_no = ANIM_BURNING_OIL;
-        object_create(scrap, obj->gs, pos, vec2f_create(velx, vely));
-        object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
-        object_set_stl(scrap, object_get_stl(obj));
-        object_set_gravity(scrap, gravity);
-        object_set_layers(scrap, LAYER_SCRAP);
-        object_dynamic_tick(scrap);
-        scrap_create(scrap);
-        game_state_add_object(obj->gs, scrap, layer);
+        particles_emit(obj->gs->particles, &def, vec2i_to_f(pos), vec2f_create(velx, vely));
     }
 
 }
@@ -537,6 +533,14 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount) {
     har_spawn_oil(obj, pos, oil_amount, 1, RENDER_LAYER_TOP);
 
     // scrap metal
+    particle_def def;
+    def.stl = object_get_stl(obj);
+    def.gravity = 1;
+    def.layer = RENDER_LAYER_TOP;
+    def.flags = PARTICLE_SHADOW;
+    def.pal_offset = object_get_pal_offset(obj);
+    def.warmup = 1;
+
     // TODO this assumes the default scrap level and does not consider BIG[1-9]
     int scrap_amount = 0;
     int destr = is_destruction(obj->gs);
@@ -551,7 +555,7 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount) {
     }
     for(int i = 0; i < scrap_amount; i++) {
         // Calculate velocity etc.
-        rv = rand_int(100) / 100.0f - 0.5;
+        rv = random_int(&obj->gs->rand_state, 100) / 100.0f - 0.5;
         velx = (5 * cos(90 + i-(scrap_amount) / 2 + rv)) * object_get_direction(obj);
         vely = -12 * sin(i / scrap_amount + rv);
 
@@ -565,19 +569,9 @@ void har_spawn_scrap(object *obj, vec2i pos, int amount) {
         // (to prevent floating scrap objects)
         if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
-        // Create the object
-        object *scrap = malloc(sizeof(object));
-        int anim_no = rand_int(3) + ANIM_SCRAP_METAL;
-        object_create(scrap, obj->gs, pos, vec2f_create(velx, vely));
-        object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
-        object_set_stl(scrap, object_get_stl(obj));
-        object_set_gravity(scrap, 1);
-        object_set_pal_offset(scrap, object_get_pal_offset(obj));
-        object_set_layers(scrap, LAYER_SCRAP);
-        object_dynamic_tick(scrap);
-        object_set_shadow(scrap, 1);
-        scrap_create(scrap);
-        game_state_add_object(obj->gs, scrap, RENDER_LAYER_TOP);
+        int anim_no = random_int(&obj->gs->rand_state, 3) + ANIM_SCRAP_METAL;
+        def.ani = &af_get_move(h->af_data, anim_no)->ani;
+        particles_emit(obj->gs->particles, &def, vec2i_to_f(pos), vec2f_create(velx, vely));
     }
 }
 
@@ -597,17 +591,15 @@ void har_block(object *obj, vec2i hit_coord) {
         // don't make another scrape
         return;
     }
-    object *scrape = malloc(sizeof(object));
-    object_create(scrape, obj->gs, hit_coord, vec2f_create(0, 0));
-    object_set_animation(scrape, &af_get_move(h->af_data, ANIM_BLOCKING_SCRAPE)->ani);
-    object_set_stl(scrape, object_get_stl(obj));
-    object_set_direction(scrape, object_get_direction(obj));
-    object_set_repeat(scrape, 0);
-    object_set_gravity(scrape, 0);
-    object_set_layers(scrape, LAYER_SCRAP);
-    object_dynamic_tick(scrape);
-    object_dynamic_tick(scrape);
-    game_state_add_object(obj->gs, scrape, RENDER_LAYER_MIDDLE);
+    particle_def def;
+    def.ani = &af_get_move(h->af_data, ANIM_BLOCKING_SCRAPE)->ani;
+    def.stl = object_get_stl(obj);
+    def.gravity = 0;
+    def.layer = RENDER_LAYER_MIDDLE;
+    def.flags = (object_get_direction(obj) == OBJECT_FACE_LEFT) ? PARTICLE_FACE_LEFT : 0;
+    def.pal_offset = 0;
+    def.warmup = 2;
+    particles_emit(obj->gs->particles, &def, vec2i_to_f(hit_coord), vec2f_create(0, 0));
     h->damage_received = 1;
     h->flinching = 1;
 }
@@ -696,7 +688,7 @@ void har_collide_with_har(object *obj_a, object *obj_b, int loop) {
     if(a->damage_done == 0 &&
             (intersect_sprite_hitpoint(obj_a, obj_b, level, &hit_coord)
             || move->category == CAT_CLOSE ||
-            (player_frame_isset(obj_a, "ue") && b->state != STATE_JUMPING))) {
+            (player_frame_isset(obj_a, TAG_UE) && b->state != STATE_JUMPING))) {
 
         if (har_is_blocking(b, move)) {
             har_event_enemy_block(a, move);
@@ -917,7 +909,7 @@ void har_tick(object *obj) {
     // TODO: Roof!
     vec2i pos = object_get_pos(obj);
     if (h->state != STATE_DEFEAT) {
-        int wall_flag = player_frame_isset(obj, "aw");
+        int wall_flag = player_frame_isset(obj, TAG_AW);
         int wall = 0;
         int hit = 0;
         if(pos.x <  ARENA_LEFT_WALL) {
@@ -945,7 +937,7 @@ void har_tick(object *obj) {
     }
 
     if ((h->state == STATE_DONE) &&
-               obj->animation_state.parser->current_frame.is_final_frame && obj->animation_state.entered_frame == 1) {
+               player_is_final_frame(obj) && obj->animation_state.entered_frame == 1) {
         // match is over
         har_event_done(h);
     }
@@ -996,21 +988,22 @@ void har_tick(object *obj) {
 
     // Note! If we ever add more effects, this will need to be changed!
     // XXX: Make this better.
-    if(player_frame_isset(obj, "bt")) {
+    if(player_frame_isset(obj, TAG_BT)) {
         object_set_effects(obj, EFFECT_DARK_TINT);
     } else {
         object_set_effects(obj, EFFECT_NONE);
     }
 
     // Leave shadow trail
-    // IF trail is on, copy current sprite to a new animation, and set animation string
+    // IF trail is on, make a new animation of the current sprite, and set animation string
     // to show the sprite with animation string that interpolates opacity down
+    // The sprite surface is shared, not copied, so the texture of it is shared too.
     // Mark new object as the owner of the animation, so that the animation gets
     // removed when the object is finished.
-    if(player_frame_isset(obj, "ub")) {
+    if(player_frame_isset(obj, TAG_UB) && obj->cur_sprite != NULL) {
         if(obj->age % 2 == 0) {
-            sprite *nsp = sprite_copy(obj->cur_sprite);
-            object *nobj = malloc(sizeof(object));
+            sprite *nsp = sprite_ref(obj->cur_sprite);
+            object *nobj = game_state_alloc_object(obj->gs);
             object_create(nobj, obj->gs, object_get_pos(obj), vec2f_create(0,0));
             object_set_stl(nobj, object_get_stl(obj));
             object_set_animation(nobj, create_animation_from_single(nsp, obj->cur_animation->start_pos));
@@ -1142,32 +1135,32 @@ af_move* match_move(object *obj, char *inputs) {
                 if (h->executing_move) {
                     // check if the current frame allows chaining
                    int allowed = 0;
-                   if (player_frame_isset(obj, "jn") && i == player_frame_get(obj, "jn")) {
+                   if (player_frame_isset(obj, TAG_JN) && i == player_frame_get(obj, TAG_JN)) {
                        allowed = 1;
                    } else {
                        switch (move->category) {
                            case CAT_LOW:
-                               if (player_frame_isset(obj, "jl")) {
+                               if (player_frame_isset(obj, TAG_JL)) {
                                    allowed = 1;
                                }
                                break;
                            case CAT_MEDIUM:
-                               if (player_frame_isset(obj, "jm")) {
+                               if (player_frame_isset(obj, TAG_JM)) {
                                    allowed = 1;
                                }
                                break;
                            case CAT_HIGH:
-                               if (player_frame_isset(obj, "jh")) {
+                               if (player_frame_isset(obj, TAG_JH)) {
                                    allowed = 1;
                                }
                                break;
                            case CAT_SCRAP:
-                               if (player_frame_isset(obj, "jf")) {
+                               if (player_frame_isset(obj, TAG_JF)) {
                                    allowed = 1;
                                }
                                break;
                            case CAT_DESTRUCTION:
-                               if (player_frame_isset(obj, "jf2")) {
+                               if (player_frame_isset(obj, TAG_JF2)) {
                                    allowed = 1;
                                }
                                break;
@@ -1654,7 +1647,7 @@ void har_copy_actions(object *new, object *old) {
 
 int har_create(object *obj, af *af_data, int dir, int har_id, int pilot_id, int player_id) {
     // Create local data
-    har *local = malloc(sizeof(har));
+    har *local = pool_alloc(&obj->gs->har_pool);
     object_set_userdata(obj, local);
     har_bootstrap(obj);
 
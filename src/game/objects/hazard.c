@@ -34,7 +34,7 @@ void hazard_tick(object *obj) {
             float mag;
             int limit = 10;
             do {
-                obj->orbit_dest = vec2f_create(rand_float()*320.0f, rand_float()*200.0f);
+                obj->orbit_dest = vec2f_create(random_float(&obj->gs->rand_state)*320.0f, random_float(&obj->gs->rand_state)*200.0f);
                 obj->orbit_dest_dir = vec2f_sub(obj->orbit_dest, obj->orbit_pos);
                 mag = sqrtf(obj->orbit_dest_dir.x*obj->orbit_dest_dir.x + obj->orbit_dest_dir.y*obj->orbit_dest_dir.y);
                 limit--;
@@ -52,7 +52,7 @@ void hazard_spawn_cb(object *parent, int id, vec2i pos, int g, void *userdata) {
     // Get next animation
     bk_info *info = bk_get_info(&s->bk_data, id);
     if(info != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, vec2i_add(pos, info->ani.start_pos), vec2f_create(0,0));
         object_set_stl(obj, object_get_stl(parent));
         object_set_animation(obj, &info->ani);
@@ -6,11 +6,6 @@
 #include "utils/log.h"
 #include "game/objects/arena_constraints.h"
 
-typedef struct projectile_local_t {
-    object *owner;
-    af *af_data;
-} projectile_local;
-
 void projectile_tick(object *obj) {
     projectile_local *local = object_get_userdata(obj);
 
@@ -26,7 +21,7 @@ void projectile_tick(object *obj) {
 
     // Note! If we ever add more effects, this will need to be changed!
     // XXX: Make this better.
-    if(player_frame_isset(obj, "bt")) {
+    if(player_frame_isset(obj, TAG_BT)) {
         object_set_effects(obj, EFFECT_DARK_TINT);
     } else {
         object_set_effects(obj, EFFECT_NONE);
@@ -34,7 +29,7 @@ void projectile_tick(object *obj) {
 }
 
 void projectile_free(object *obj) {
-    free(object_get_userdata(obj));
+    pool_release(&obj->gs->projectile_pool, object_get_userdata(obj));
 }
 
 void projectile_move(object *obj) {
@@ -97,7 +92,7 @@ void projectile_bootstrap(object *obj) {
 }
 
 int projectile_create(object *obj) {
-    projectile_local *local = malloc(sizeof(projectile_local));
+    projectile_local *local = pool_alloc(&obj->gs->projectile_pool);
     // strore the HAR in here instead
     local->owner = obj;
     local->af_data = ((har*)object_get_userdata(obj))->af_data;
@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#include "game/particles.h"
+#include "game/protos/player.h"
+#include "game/objects/arena_constraints.h"
+#include "game/utils/settings.h"
+#include "video/video.h"
+#include "utils/log.h"
+
+#define PARTICLE_DAMPEN 0.4f
+#define PARTICLE_INTERP_MAX_DIST 64.0f
+#define PARTICLE_BENCH_TICKS 200
+
+void particles_create(particles *p, const settings *setting) {
+    p->count = 0;
+    p->setting = setting;
+}
+
+void particles_clear(particles *p) {
+    p->count = 0;
+}
+
+int particles_count(particles *p) {
+    return p->count;
+}
+
+// Finds the frame playing at the given tick, or -1 if the animation has ended
+static int particle_frame_at_tick(const animation_frames *frames, uint32_t ticks) {
+    for(int i = 0; i < frames->count; i++) {
+        const animation_frame *f = &frames->frames[i];
+        if(ticks >= (uint32_t)f->start_tick && ticks < (uint32_t)(f->start_tick + f->duration)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Runs one tick of the animation, the same way player_run() would for a scrap object
+static void particle_animate(particles *p, int i) {
+    const animation_frames *frames = p->ani[i]->frames;
+    int id = (frames != NULL) ? particle_frame_at_tick(frames, p->ticks[i] - 1) : -1;
+    if(id < 0) {
+        p->spr[i] = NULL;
+        p->finished[i] = 1;
+        return;
+    }
+
+    if(id != p->frame[i]) {
+        const animation_frame *f = &frames->frames[id];
+        int real_frame = f->letter - 65;
+
+        // Loops are taken until the particle comes to rest
+        if(animation_frame_isset(f, TAG_D) && !p->resting[i]) {
+            p->ticks[i] = animation_frame_get(f, TAG_D) + 1;
+            int next = particle_frame_at_tick(frames, p->ticks[i]);
+            if(next >= 0) {
+                f = &frames->frames[next];
+            }
+        }
+
+        if(animation_frame_isset(f, TAG_S) && p->stl[i] != NULL && p->setting != NULL) {
+            player_play_frame_sound(f, p->stl[i], p->setting->sound.sound_vol);
+        }
+
+        p->spr[i] = (real_frame < 25) ? animation_get_sprite(p->ani[i], real_frame) : NULL;
+        p->blend[i] = animation_frame_isset(f, TAG_BR) ? BLEND_ADDITIVE : BLEND_ALPHA;
+        p->flip[i] = FLIP_NONE;
+        if(animation_frame_isset(f, TAG_R)) {
+            p->flip[i] ^= FLIP_HORIZONTAL;
+        }
+        if(animation_frame_isset(f, TAG_F)) {
+            p->flip[i] ^= FLIP_VERTICAL;
+        }
+        p->frame[i] = f->id;
+    }
+    p->ticks[i]++;
+}
+
+int particles_emit(particles *p, const particle_def *def, vec2f pos, vec2f vel) {
+    if(p->count >= PARTICLES_MAX) {
+        DEBUG("Particle limit reached, dropping particle.");
+        return -1;
+    }
+    int i = p->count++;
+
+    // Positions are kept in whole pixels, as object positions are
+    p->x[i] = (int)pos.x;
+    p->y[i] = (int)pos.y;
+    p->prev_x[i] = p->x[i];
+    p->prev_y[i] = p->y[i];
+    p->vel_x[i] = vel.x;
+    p->vel_y[i] = vel.y;
+    p->gravity[i] = def->gravity;
+    p->resting[i] = 0;
+
+    p->ani[i] = def->ani;
+    p->stl[i] = def->stl;
+    p->ticks[i] = 1;
+    p->frame[i] = -1;
+    p->finished[i] = 0;
+
+    p->spr[i] = NULL;
+    p->blend[i] = BLEND_ALPHA;
+    p->flip[i] = FLIP_NONE;
+    p->flags[i] = def->flags;
+    p->pal_offset[i] = def->pal_offset;
+    p->layer[i] = def->layer;
+
+    for(int k = 0; k < def->warmup && !p->finished[i]; k++) {
+        particle_animate(p, i);
+    }
+    return i;
+}
+
+// Same movement as scrap objects had; bounce off the walls and the floor
+// until at rest. No branches on the particle state, so this can be vectorized.
+static void particles_move(particles *p) {
+    int n = p->count;
+    for(int i = 0; i < n; i++) {
+        p->prev_x[i] = p->x[i];
+        p->prev_y[i] = p->y[i];
+    }
+    for(int i = 0; i < n; i++) {
+        float g = p->gravity[i];
+        float vx = p->vel_x[i];
+        float vy = p->vel_y[i] + g;
+        float x = (float)(int)(p->x[i] + vx);
+        float y = (float)(int)(p->y[i] + vy);
+
+        int left = x < ARENA_LEFT_WALL;
+        int right = x > ARENA_RIGHT_WALL;
+        int bottom = y > ARENA_FLOOR;
+        x = left ? ARENA_LEFT_WALL : x;
+        x = right ? ARENA_RIGHT_WALL : x;
+        vx = (left | right) ? -vx * PARTICLE_DAMPEN : vx;
+        y = bottom ? ARENA_FLOOR : y;
+        vy = bottom ? -vy * PARTICLE_DAMPEN : vy;
+        vx = bottom ? vx * PARTICLE_DAMPEN : vx;
+        vx = (vx < 0.1f && vx > -0.1f) ? 0.0f : vx;
+
+        int rest = y >= (ARENA_FLOOR - 5) && vx == 0.0f && vy < g * 1.1f && vy > g * -1.1f;
+
+        // Particles at rest are left where they are
+        int moving = !p->resting[i];
+        p->x[i] = moving ? x : p->x[i];
+        p->y[i] = moving ? y : p->y[i];
+        p->vel_x[i] = moving ? vx : p->vel_x[i];
+        p->vel_y[i] = moving ? vy : p->vel_y[i];
+        p->resting[i] = p->resting[i] | (moving & rest);
+    }
+}
+
+// Moves the last particle into the place of a removed one
+static void particles_remove(particles *p, int i) {
+    int last = --p->count;
+    if(i == last) {
+        return;
+    }
+    p->x[i] = p->x[last];
+    p->y[i] = p->y[last];
+    p->prev_x[i] = p->prev_x[last];
+    p->prev_y[i] = p->prev_y[last];
+    p->vel_x[i] = p->vel_x[last];
+    p->vel_y[i] = p->vel_y[last];
+    p->gravity[i] = p->gravity[last];
+    p->resting[i] = p->resting[last];
+    p->ani[i] = p->ani[last];
+    p->stl[i] = p->stl[last];
+    p->ticks[i] = p->ticks[last];
+    p->frame[i] = p->frame[last];
+    p->finished[i] = p->finished[last];
+    p->spr[i] = p->spr[last];
+    p->blend[i] = p->blend[last];
+    p->flip[i] = p->flip[last];
+    p->flags[i] = p->flags[last];
+    p->pal_offset[i] = p->pal_offset[last];
+    p->layer[i] = p->layer[last];
+}
+
+void particles_tick(particles *p) {
+    particles_move(p);
+    for(int i = 0; i < p->count; i++) {
+        particle_animate(p, i);
+    }
+
+    // Backwards, so that the particles moved into place are already handled
+    for(int i = p->count - 1; i >= 0; i--) {
+        if(p->finished[i]) {
+            particles_remove(p, i);
+        }
+    }
+}
+
+static void particle_render_pos(particles *p, int i, float interp, float *x, float *y) {
+    float dx = p->x[i] - p->prev_x[i];
+    float dy = p->y[i] - p->prev_y[i];
+    if(fabsf(dx) > PARTICLE_INTERP_MAX_DIST || fabsf(dy) > PARTICLE_INTERP_MAX_DIST) {
+        *x = p->x[i];
+        *y = p->y[i];
+        return;
+    }
+    *x = p->prev_x[i] + dx * interp;
+    *y = p->prev_y[i] + dy * interp;
+}
+
+// Particles of a layer are drawn one after another, so that the renderer can batch them
+void particles_render(particles *p, int layer, float interp) {
+    color tint = color_create(0xFF, 0xFF, 0xFF, 0xFF);
+    for(int i = 0; i < p->count; i++) {
+        sprite *spr = p->spr[i];
+        if(p->layer[i] != layer || spr == NULL) {
+            continue;
+        }
+        float px, py;
+        particle_render_pos(p, i, interp, &px, &py);
+        int x = px + spr->pos.x;
+        int y = py + spr->pos.y;
+        int flipmode = p->flip[i];
+        if(p->flags[i] & PARTICLE_FACE_LEFT) {
+            x = px - spr->pos.x - spr->data->w;
+            flipmode ^= FLIP_HORIZONTAL;
+        }
+        video_render_sprite_flip_scale_opacity_tint(
+            spr->data,
+            x, y,
+            p->blend[i],
+            p->pal_offset[i],
+            flipmode,
+            1.0f,
+            0xFF,
+            tint);
+    }
+}
+
+void particles_render_shadows(particles *p, float interp) {
+    // See object_render_shadow()
+    float scale_y = 0.25f;
+    for(int i = 0; i < p->count; i++) {
+        sprite *spr = p->spr[i];
+        if(!(p->flags[i] & PARTICLE_SHADOW) || spr == NULL) {
+            continue;
+        }
+        float px, py;
+        particle_render_pos(p, i, interp, &px, &py);
+        int flipmode = p->flip[i];
+        int x = px + spr->pos.x;
+        if(p->flags[i] & PARTICLE_FACE_LEFT) {
+            x = px - spr->pos.x - spr->data->w;
+            flipmode ^= FLIP_HORIZONTAL;
+        }
+        float temp = spr->data->h * scale_y;
+        int y = 190 - temp - (spr->data->h - temp) / 2;
+        for(int k = 0; k < 2; k++) {
+            video_render_sprite_flip_scale_opacity_tint(
+                spr->data,
+                x+k, y+k,
+                BLEND_ALPHA,
+                p->pal_offset[i],
+                flipmode,
+                scale_y,
+                50,
+                color_create(0,0,0,255));
+        }
+    }
+}
+
+int particles_bench(particle_bench_result *results, int max_results) {
+    static const int counts[] = {100, 400, 1000};
+    int n = 0;
+
+    // Long-lived particles with a single frame, so that none die during the run
+    particles *p = malloc(sizeof(particles));
+    particles_create(p, NULL);
+    sprite *sp = malloc(sizeof(sprite));
+    surface *sur = malloc(sizeof(surface));
+    surface_create(sur, SURFACE_TYPE_PALETTE, 8, 8);
+    sprite_create_custom(sp, vec2i_create(-4, -8), sur);
+    animation *ani = create_animation_from_single(sp, vec2i_create(0, 0));
+
+    particle_def def;
+    def.ani = ani;
+    def.stl = NULL;
+    def.gravity = 1.0f;
+    def.layer = 0;
+    def.flags = 0;
+    def.pal_offset = 0;
+    def.warmup = 1;
+
+    for(int c = 0; c < 3 && n < max_results; c++) {
+        particles_clear(p);
+        for(int i = 0; i < counts[c]; i++) {
+            // Spread out like a destruction, with some bouncing off the walls
+            float a = i * 0.37f;
+            particles_emit(p, &def, vec2f_create(160, 150), vec2f_create(cosf(a) * 25.0f, -fabsf(sinf(a)) * 30.0f));
+        }
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int t = 0; t < PARTICLE_BENCH_TICKS; t++) {
+            particles_tick(p);
+        }
+        uint64_t end = SDL_GetPerformanceCounter();
+
+        results[n].particles = counts[c];
+        results[n].us_per_tick = (double)(end - start) * 1000000.0 / SDL_GetPerformanceFrequency() / PARTICLE_BENCH_TICKS;
+        n++;
+    }
+
+    animation_free(ani);
+    free(ani);
+    free(p);
+    return n;
+}
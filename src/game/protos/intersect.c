@@ -84,7 +84,7 @@ int intersect_sprite_hitpoint(object *obj, object *target, int level, vec2i *poi
         if (object_get_direction(target) == OBJECT_FACE_LEFT) {
             hitpoint = (ycoord * sfc->w) + (sfc->w - xcoord);
         }
-        if(sfc->stencil[hitpoint] > 0) {
+        if(surface_get_stencil(sfc, hitpoint % sfc->w, hitpoint / sfc->w) > 0) {
             hcoords[found++] = vec2i_create(xcoord, ycoord);
             if(found >= level) {
                 vec2f sum = vec2f_create(0,0);
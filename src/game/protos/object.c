@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <shadowdive/sprite.h>
 #include "game/protos/object.h"
 #include "game/protos/object_specializer.h"
@@ -26,6 +27,8 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
     // remember the place we were spawned, the x= and y= tags are relative to that
     obj->start = vec2i_to_f(pos);
     obj->vel = vel;
+    obj->prev_pos = obj->pos;
+    obj->has_prev_pos = 0;
     obj->direction = OBJECT_FACE_RIGHT;
     obj->y_percent = 1.0;
 
@@ -62,7 +65,7 @@ void object_create(object *obj, game_state *gs, vec2i pos, vec2f vel) {
 
     obj->custom_str = NULL;
 
-    random_seed(&obj->rand_state, rand_intmax());
+    random_seed(&obj->rand_state, random_intmax(&gs->rand_state));
 
     // For enabling hit on the current and the next n-1 frames
     obj->hit_frames = 0;
@@ -304,6 +307,22 @@ int object_get_effects(object *obj) {
     return obj->video_effects;
 }
 
+// Anything moving further than this in one tick is considered a teleport, and is not interpolated
+#define OBJECT_INTERP_MAX_DIST 64.0f
+
+// Position to render at; blends from the previous dynamic tick towards the current one
+static vec2f object_render_pos(object *obj) {
+    if(!obj->has_prev_pos || obj->gs == NULL || obj->gs->paused) {
+        return obj->pos;
+    }
+    vec2f d = vec2f_sub(obj->pos, obj->prev_pos);
+    if(fabsf(d.x) > OBJECT_INTERP_MAX_DIST || fabsf(d.y) > OBJECT_INTERP_MAX_DIST) {
+        return obj->pos;
+    }
+    float a = obj->gs->interp;
+    return vec2f_create(obj->prev_pos.x + d.x * a, obj->prev_pos.y + d.y * a);
+}
+
 void object_render(object *obj) {
     // Stop here if cur_sprite is NULL
     if(obj->cur_sprite == NULL) return;
@@ -315,10 +334,11 @@ void object_render(object *obj) {
     player_sprite_state *rstate = &obj->sprite_state;
 
     // Position
-    int y = obj->pos.y + obj->cur_sprite->pos.y;
-    int x = obj->pos.x + obj->cur_sprite->pos.x;
+    vec2f pos = object_render_pos(obj);
+    int y = pos.y + obj->cur_sprite->pos.y;
+    int x = pos.x + obj->cur_sprite->pos.x;
     if(object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        x = obj->pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
+        x = pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
     }
 
     // Flip to face the right direction
@@ -367,9 +387,10 @@ void object_render_shadow(object *obj) {
 
     // Determine X
     int flipmode = obj->sprite_state.flipmode;
-    int x = obj->pos.x + obj->cur_sprite->pos.x;
+    vec2f pos = object_render_pos(obj);
+    int x = pos.x + obj->cur_sprite->pos.x;
     if(object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        x = obj->pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
+        x = pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
         flipmode ^= FLIP_HORIZONTAL;
     }
 
@@ -401,6 +422,8 @@ int object_act(object *obj, int action) {
 }
 
 void object_move(object *obj) {
+    obj->prev_pos = obj->pos;
+    obj->has_prev_pos = 1;
     if(obj->sprite_state.disable_gravity) {
         object_set_vel(obj, vec2f_create(0,0));
     }
@@ -1,6 +1,6 @@
 #include <inttypes.h>
 #include <stdlib.h>
-#include <shadowdive/stringparser.h>
+#include <string.h>
 
 #include "game/game_state.h"
 #include "game/game_player.h"
@@ -19,18 +19,6 @@
 
 // ---------------- Private functions ----------------
 
-int isset(sd_stringparser_frame *frame, const char *tag) {
-    const sd_stringparser_tag_value *v;
-    sd_stringparser_get_tag(frame->parser, frame->id, tag, &v);
-    return v->is_set;
-}
-
-int get(sd_stringparser_frame *frame, const char *tag) {
-    const sd_stringparser_tag_value *v;
-    sd_stringparser_get_tag(frame->parser, frame->id, tag, &v);
-    return v->value;
-}
-
 void player_clear_frame(object *obj) {
     player_sprite_state *s = &obj->sprite_state;
     s->blendmode = BLEND_ALPHA;
@@ -55,32 +43,89 @@ void player_clear_frame(object *obj) {
     s->pal_tint = 0;
 }
 
-int next_frame_with_tag(sd_stringparser *parser, int current_frame, const char *tag, sd_stringparser_frame *f) {
-    int frames = sd_stringparser_num_frames(parser);
-    int res = 0;
-    for(int i = current_frame + 1; i < frames; i++) {
-        sd_stringparser_peek(parser, i, f);
-        if(isset(f, tag)) {
-            return res;
+// Frame durations and start ticks, with the extra ticks from player_set_delay() added in
+static int frame_duration(const player_animation_state *state, int frame_id) {
+    return animation_frames_duration(state->frames, &state->delay, frame_id);
+}
+
+static int frame_start(const player_animation_state *state, int frame_id) {
+    return animation_frames_start(state->frames, &state->delay, frame_id);
+}
+
+static int frame_at_tick(const player_animation_state *state, uint32_t ticks) {
+    // Usually the frame is the same as last time, or the one after it
+    int first = (state->frame_id >= 0 && ticks >= (uint32_t)frame_start(state, state->frame_id)) ? state->frame_id : 0;
+    for(int i = first; i < state->frames->count; i++) {
+        uint32_t start = frame_start(state, i);
+        if(ticks >= start && ticks < start + frame_duration(state, i)) {
+            return i;
         }
-        res += f->duration;
     }
     return -1;
 }
 
-int next_frame_with_sprite(sd_stringparser *parser, int current_frame, int sprite, sd_stringparser_frame *f) {
-    int frames = sd_stringparser_num_frames(parser);
+// Moves to the frame that is playing at the given tick. If the tick is past the
+// end (or end_frame), the current frame is kept and the animation is marked as ended.
+// Returns 1 if there is nothing to play.
+static int player_seek(player_animation_state *state, uint32_t ticks, uint32_t end_frame) {
+    if(state->frames == NULL || state->frames->count == 0) {
+        return 1;
+    }
+    int id = frame_at_tick(state, ticks);
+    if(id < 0 || (uint32_t)id >= end_frame) {
+        state->animation_end = 1;
+        return 0;
+    }
+    state->frame_id = id;
+    state->animation_end = 0;
+    return 0;
+}
+
+// Ticks between the end of frame_id and the start of the next frame with the tag
+static int ticks_to_next_with_tag(const player_animation_state *state, int frame_id, int tag, int *next_id) {
     int res = 0;
-    for(int i = current_frame + 1; i < frames; i++) {
-        sd_stringparser_peek(parser, i, f);
-        if (f->letter == sprite + 'A') {
+    for(int i = frame_id + 1; i < state->frames->count; i++) {
+        if(animation_frame_isset(&state->frames->frames[i], tag)) {
+            *next_id = i;
             return res;
         }
-        res += f->duration;
+        res += frame_duration(state, i);
+    }
+    return -1;
+}
+
+static int first_frame_with_sprite(const player_animation_state *state, int sprite) {
+    for(int i = 1; i < state->frames->count; i++) {
+        if(state->frames->frames[i].letter == sprite + 'A') {
+            return i;
+        }
     }
     return -1;
 }
 
+static void player_load(object *obj, const animation_frames *frames) {
+    obj->animation_state.frames = frames;
+    obj->animation_state.ticks_len = (frames != NULL) ? frames->ticks_len : 0;
+    obj->animation_state.frame_id = -1;
+    obj->animation_state.animation_end = 0;
+    memset(&obj->animation_state.delay, 0, sizeof(animation_delay));
+
+    // Set player state
+    obj->animation_state.ticks = 1;
+    obj->animation_state.finished = 0;
+    obj->animation_state.previous = -1;
+    obj->animation_state.reverse = 0;
+
+    obj->slide_state.timer = 0;
+    obj->slide_state.vel = vec2f_create(0,0);
+
+    obj->enemy_slide_state.timer = 0;
+    obj->enemy_slide_state.dest = vec2i_create(0,0);
+    obj->enemy_slide_state.duration = 0;
+
+    obj->hit_frames = 0;
+    obj->can_hit = 0;
+}
 
 // ---------------- Public functions ----------------
 
@@ -95,10 +140,12 @@ void player_create(object *obj) {
     obj->animation_state.spawn_userdata = NULL;
     obj->animation_state.destroy = NULL;
     obj->animation_state.destroy_userdata = NULL;
-    obj->animation_state.parser = NULL;
     obj->animation_state.previous = -1;
     obj->animation_state.ticks_len = 0;
-    obj->animation_state.parser = sd_stringparser_create();
+    obj->animation_state.frames = NULL;
+    obj->animation_state.frame_id = -1;
+    obj->animation_state.animation_end = 0;
+    memset(&obj->animation_state.delay, 0, sizeof(animation_delay));
     obj->animation_state.disable_d = 0;
     obj->animation_state.enemy = NULL;
     obj->slide_state.timer = 0;
@@ -107,76 +154,52 @@ void player_create(object *obj) {
 }
 
 void player_free(object *obj) {
-    if(obj->animation_state.parser != NULL) {
-        sd_stringparser_delete(obj->animation_state.parser);
-    }
+    // Frame tables belong to the animations, or to the custom string cache
+    obj->animation_state.frames = NULL;
 }
 
 void player_reload_with_str(object *obj, const char* custom_str) {
-    // Load new animation string
-    sd_stringparser_set_string(
-        obj->animation_state.parser,
-        custom_str);
-
-    // Find string length
-    sd_stringparser_frame tmp;
-    obj->animation_state.ticks_len = 0;
-    int frames = sd_stringparser_num_frames(obj->animation_state.parser);
-    for(int i = 0; i < frames; i++) {
-        sd_stringparser_peek(obj->animation_state.parser, i, &tmp);
-        obj->animation_state.ticks_len += tmp.duration;
-    }
-
-    // Peek parameters
-    sd_stringparser_frame param;
-    sd_stringparser_peek(obj->animation_state.parser, 0, &param);
-
-    // Set player state
-    obj->animation_state.ticks = 1;
-    obj->animation_state.finished = 0;
-    obj->animation_state.previous = -1;
-    obj->animation_state.reverse = 0;
-
-    obj->slide_state.timer = 0;
-    obj->slide_state.vel = vec2f_create(0,0);
-
-    obj->enemy_slide_state.timer = 0;
-    obj->enemy_slide_state.dest = vec2i_create(0,0);
-    obj->enemy_slide_state.duration = 0;
-
-    obj->hit_frames = 0;
-    obj->can_hit = 0;
+    player_load(obj, animation_frames_get_custom(custom_str));
 }
 
 void player_reload(object *obj) {
-    player_reload_with_str(obj, str_c(&obj->cur_animation->animation_string));
+    player_load(obj, obj->cur_animation->frames);
 }
 
 void player_reset(object *obj) {
     obj->animation_state.ticks = 1;
     obj->animation_state.finished = 0;
     obj->animation_state.previous = -1;
-    sd_stringparser_reset(obj->animation_state.parser);
+    obj->animation_state.frame_id = -1;
+    obj->animation_state.animation_end = 0;
 }
 
-int player_frame_isset(object *obj, const char *tag) {
-    sd_stringparser_frame f = obj->animation_state.parser->current_frame;
-    return isset(&f, tag);
+int player_frame_isset(object *obj, int tag) {
+    const animation_frame *f = animation_frames_get(obj->animation_state.frames, obj->animation_state.frame_id);
+    return f != NULL && animation_frame_isset(f, tag);
 }
 
-int player_frame_get(object *obj, const char *tag) {
-    sd_stringparser_frame f = obj->animation_state.parser->current_frame;
-    return get(&f, tag);
+int player_frame_get(object *obj, int tag) {
+    const animation_frame *f = animation_frames_get(obj->animation_state.frames, obj->animation_state.frame_id);
+    return (f != NULL) ? animation_frame_get(f, tag) : 0;
+}
+
+int player_is_final_frame(object *obj) {
+    const player_animation_state *state = &obj->animation_state;
+    return state->frames != NULL && state->frame_id == state->frames->count - 1;
 }
 
 void player_set_delay(object *obj, int delay) {
     //try to spread <delay> ticks over the 'startup' frames; those that don't spawn projectiles or have hit coordinates
+    player_animation_state *state = &obj->animation_state;
+    if(state->frames == NULL) {
+        return;
+    }
     int r;
-    sd_stringparser_frame n;
     int frames = 99;
     // find the first frame that spawns a projectile, if any
-    if((r =next_frame_with_tag(obj->animation_state.parser, 0, "m", &n)) >= 0) {
-        frames = n.id;
+    if((r = animation_frames_next_with_tag(state->frames, 0, TAG_M)) >= 0) {
+        frames = r;
     }
 
     // find the first frame with hit coordinates
@@ -184,9 +207,9 @@ void player_set_delay(object *obj, int delay) {
     collision_coord *cc;
     vector_iter_begin(&obj->cur_animation->collision_coords, &it);
     while((cc = iter_next(&it)) != NULL) {
-        if((r = next_frame_with_sprite(obj->animation_state.parser, 0, cc->frame_index, &n)) >= 0) {
-            if (n.id < frames) {
-                frames = n.id;
+        if((r = first_frame_with_sprite(state, cc->frame_index)) >= 0) {
+            if (r < frames) {
+                frames = r;
             }
         }
     }
@@ -197,22 +220,27 @@ void player_set_delay(object *obj, int delay) {
 
     DEBUG("animation has %d initializer frames", frames);
 
-    int delay_per_frame = delay/frames;
-    int rem = delay % frames;
-    for(int i = 0; i < frames; i++) {
-        int olddur;
-        sd_stringparser_peek(obj->animation_state.parser, i, &n);
-        olddur = n.duration;
-        int newduration = n.duration + delay_per_frame;
-        if (rem) {
-            newduration++;
-            rem--;
-        }
+    // The shared frame table is left alone; the extra ticks are added when durations are looked up
+    animation_delay_spread(&state->delay, state->frames, frames, delay);
+}
 
-        sd_stringparser_set_frame_duration(obj->animation_state.parser, i, newduration);
-        sd_stringparser_peek(obj->animation_state.parser, i, &n);
-        DEBUG("changed duration of frame %d from %d to %d", i, olddur, n.duration);
+void player_play_frame_sound(const animation_frame *f, const char *stl, int sound_vol) {
+    float pitch = PITCH_DEFAULT;
+    float volume = VOLUME_DEFAULT * (sound_vol/10.0f);
+    float panning = PANNING_DEFAULT;
+    if(animation_frame_isset(f, TAG_SF)) {
+        int p = clamp(animation_frame_get(f, TAG_SF), -16, 239);
+        pitch = clampf((p/239.0f)*3.0f + 1.0f, PITCH_MIN, PITCH_MAX);
+    }
+    if(animation_frame_isset(f, TAG_L)) {
+        int v = clamp(animation_frame_get(f, TAG_L), 0, 100);
+        volume = (v / 100.0f) * (sound_vol/10.0f);
     }
+    if(animation_frame_isset(f, TAG_SB)) {
+        panning = clamp(animation_frame_get(f, TAG_SB), -100, 100) / 100.0f;
+    }
+    int sound_id = stl[animation_frame_get(f, TAG_S)] - 1;
+    sound_play(sound_id, volume, panning, pitch);
 }
 
 void player_run(object *obj) {
@@ -235,32 +263,13 @@ void player_run(object *obj) {
         obj->enemy_slide_state.timer--;
     }
 
-    // Not sure what this does
-    int run_ret;
-    if(state->end_frame == UINT32_MAX) {
-        run_ret = sd_stringparser_run(
-            state->parser,
-            state->ticks - 1);
-    } else {
-        run_ret = sd_stringparser_run_frames(
-            state->parser,
-            state->ticks - 1,
-            state->end_frame);
-    }
-
-    // Handle frame
-    if(run_ret == 0) {
-        // Handle frame switch
-        sd_stringparser_frame *param = &state->parser->current_frame;
-        sd_stringparser_frame *f = param;
-        int real_frame = param->letter - 65;
-
+    // Find the frame for the current tick
+    if(player_seek(state, state->ticks - 1, state->end_frame) == 0) {
         // Do something if animation is finished!
-        if(param->is_animation_end) {
+        if(state->animation_end) {
             if(state->repeat) {
                 player_reset(obj);
-                sd_stringparser_run(state->parser, state->ticks - 1);
-                real_frame = param->letter - 65;
+                player_seek(state, state->ticks - 1, UINT32_MAX);
             } else if(obj->finish != NULL) {
                 obj->cur_sprite = NULL;
                 obj->finish(obj);
@@ -271,76 +280,86 @@ void player_run(object *obj) {
                 return;
             }
         }
+        if(state->frame_id < 0) {
+            return;
+        }
+
+        // Handle frame switch
+        const animation_frame *f = &state->frames->frames[state->frame_id];
+        int duration = frame_duration(state, f->id);
+        int real_frame = f->letter - 65;
 
         state->entered_frame = 0;
         // If frame changed, do something
-        if(param->id != state->previous) {
+        if(f->id != state->previous) {
             player_clear_frame(obj);
             state->entered_frame = 1;
 
             // Tick management
-            if(isset(f, "d")) {
+            if(animation_frame_isset(f, TAG_D)) {
                 if(!obj->animation_state.disable_d) {
-                    state->ticks = get(f, "d") + 1;
-                    sd_stringparser_goto_tick(state->parser, state->ticks);
+                    state->ticks = animation_frame_get(f, TAG_D) + 1;
+                    player_seek(state, state->ticks, UINT32_MAX);
+                    f = &state->frames->frames[state->frame_id];
+                    duration = frame_duration(state, f->id);
                 }
             }
 
             // Hover flag
-            if(isset(f, "h")) {
+            if(animation_frame_isset(f, TAG_H)) {
                 rstate->disable_gravity = 1;
             } else {
                 rstate->disable_gravity = 0;
             }
 
-            if(isset(f, "ua")) {
+            if(animation_frame_isset(f, TAG_UA)) {
                 obj->animation_state.enemy->sprite_state.disable_gravity = 1;
             }
 
             // Animation management
-            if(isset(f, "m") && state->spawn != NULL) {
+            if(animation_frame_isset(f, TAG_M) && state->spawn != NULL) {
                 int mx = 0;
-                if (isset(f, "mrx")) {
-                    int mrx = get(f, "mrx");
-                    int mm = isset(f, "mm") ? get(f, "mm") : mrx;
+                if (animation_frame_isset(f, TAG_MRX)) {
+                    int mrx = animation_frame_get(f, TAG_MRX);
+                    int mm = animation_frame_isset(f, TAG_MM) ? animation_frame_get(f, TAG_MM) : mrx;
                     mx = random_int(&obj->rand_state, 320 - 2*mm) + mrx;
                     DEBUG("randomized mx as %d", mx);
-                } else if(isset(f, "mx")) {
-                    mx = obj->start.x + (get(f, "mx") * object_get_direction(obj));
+                } else if(animation_frame_isset(f, TAG_MX)) {
+                    mx = obj->start.x + (animation_frame_get(f, TAG_MX) * object_get_direction(obj));
                 }
 
                 int my = 0;
-                if (isset(f, "mry")) {
-                    int mry = get(f, "mry");
-                    int mm = isset(f, "mm") ? get(f, "mm") : mry;
+                if (animation_frame_isset(f, TAG_MRY)) {
+                    int mry = animation_frame_get(f, TAG_MRY);
+                    int mm = animation_frame_isset(f, TAG_MM) ? animation_frame_get(f, TAG_MM) : mry;
                     my = random_int(&obj->rand_state, 320 - 2*mm) + mry;
                     DEBUG("randomized my as %d", my);
-                } else if(isset(f, "my")) {
-                    my = obj->start.y + get(f, "my");
+                } else if(animation_frame_isset(f, TAG_MY)) {
+                    my = obj->start.y + animation_frame_get(f, TAG_MY);
                 }
 
-                int mg = isset(f, "mg") ? get(f, "mg") : 0;
+                int mg = animation_frame_isset(f, TAG_MG) ? animation_frame_get(f, TAG_MG) : 0;
                 /*DEBUG("Spawning %d, with g = %d, pos = (%d,%d)", */
-                    /*get(f, "m"), mg, mx, my);*/
+                    /*animation_frame_get(f, TAG_M), mg, mx, my);*/
                 state->spawn(
-                    obj, get(f, "m"),
+                    obj, animation_frame_get(f, TAG_M),
                     vec2i_create(mx, my), mg,
                     state->spawn_userdata);
             }
-            if(isset(f, "md") && state->destroy != NULL) {
-                state->destroy(obj, get(f, "md"), state->destroy_userdata);
+            if(animation_frame_isset(f, TAG_MD) && state->destroy != NULL) {
+                state->destroy(obj, animation_frame_get(f, TAG_MD), state->destroy_userdata);
             }
 
             // Music playback
-            if(isset(f, "smo")) {
-                if(get(f, "smo") == 0) {
+            if(animation_frame_isset(f, TAG_SMO)) {
+                if(animation_frame_get(f, TAG_SMO) == 0) {
                     music_stop();
                     return;
                 }
 
                 // Find file we want to play
                 char *filename = NULL;
-                switch(get(f, "smo")) {
+                switch(animation_frame_get(f, TAG_SMO)) {
                     case 1: filename = get_path_by_id(PSM_END); break;
                     case 2: filename = get_path_by_id(PSM_MENU); break;
                     case 3: filename = get_path_by_id(PSM_ARENA0); break;
@@ -352,72 +371,57 @@ void player_run(object *obj) {
                 if(filename != NULL) {
                     music_play(filename);
                     free(filename);
-                    music_set_volume(settings_get()->sound.music_vol/10.0f);
+                    music_set_volume(game_state_get_settings(obj->gs)->sound.music_vol/10.0f);
                 }
             }
-            if(isset(f, "smf")) {
+            if(animation_frame_isset(f, TAG_SMF)) {
                 music_stop();
             }
 
             // Sound playback
-            if(isset(f, "s")) {
-                float pitch = PITCH_DEFAULT;
-                float volume = VOLUME_DEFAULT * (settings_get()->sound.sound_vol/10.0f);
-                float panning = PANNING_DEFAULT;
-                if(isset(f, "sf")) {
-                    int p = clamp(get(f, "sf"), -16, 239);
-                    pitch = clampf((p/239.0f)*3.0f + 1.0f, PITCH_MIN, PITCH_MAX);
-                }
-                if(isset(f, "l")) {
-                    int v = clamp(get(f, "l"), 0, 100);
-                    volume = (v / 100.0f) * (settings_get()->sound.sound_vol/10.0f);
-                }
-                if(isset(f, "sb")) {
-                    panning = clamp(get(f, "sb"), -100, 100) / 100.0f;
-                }
-                int sound_id = obj->sound_translation_table[get(f, "s")] - 1;
-                sound_play(sound_id, volume, panning, pitch);
+            if(animation_frame_isset(f, TAG_S)) {
+                player_play_frame_sound(f, obj->sound_translation_table, game_state_get_settings(obj->gs)->sound.sound_vol);
             }
 
             // Blend mode stuff
-            if(isset(f, "b1")) { rstate->method_flags &= 0x2000; }
-            if(isset(f, "b2")) { rstate->method_flags &= 0x4000; }
-            if(isset(f, "bb")) {
+            if(animation_frame_isset(f, TAG_B1)) { rstate->method_flags &= 0x2000; }
+            if(animation_frame_isset(f, TAG_B2)) { rstate->method_flags &= 0x4000; }
+            if(animation_frame_isset(f, TAG_BB)) {
                 rstate->method_flags &= 0x0010;
-                rstate->blend_finish = get(f, "bb");
-                rstate->screen_shake_vertical = get(f, "bb");
+                rstate->blend_finish = animation_frame_get(f, TAG_BB);
+                rstate->screen_shake_vertical = animation_frame_get(f, TAG_BB);
             }
-            if(isset(f, "be")) { rstate->method_flags &= 0x0800; }
-            if(isset(f, "bf")) {
+            if(animation_frame_isset(f, TAG_BE)) { rstate->method_flags &= 0x0800; }
+            if(animation_frame_isset(f, TAG_BF)) {
                 rstate->method_flags &= 0x0001;
-                rstate->blend_finish = get(f, "bf");
+                rstate->blend_finish = animation_frame_get(f, TAG_BF);
             }
-            if(isset(f, "bh")) { rstate->method_flags &= 0x0040; }
-            if(isset(f, "bl")) {
+            if(animation_frame_isset(f, TAG_BH)) { rstate->method_flags &= 0x0040; }
+            if(animation_frame_isset(f, TAG_BL)) {
                 rstate->method_flags &= 0x0008;
-                rstate->blend_finish = get(f, "bl");
-                rstate->screen_shake_horizontal = get(f, "bl");
+                rstate->blend_finish = animation_frame_get(f, TAG_BL);
+                rstate->screen_shake_horizontal = animation_frame_get(f, TAG_BL);
             }
-            if(isset(f, "bm")) {
+            if(animation_frame_isset(f, TAG_BM)) {
                 rstate->method_flags &= 0x0100;
-                rstate->blend_finish = get(f, "bm");
+                rstate->blend_finish = animation_frame_get(f, TAG_BM);
             }
-            if(isset(f, "bj")) {
+            if(animation_frame_isset(f, TAG_BJ)) {
                 rstate->method_flags &= 0x0400;
-                rstate->blend_finish = get(f, "bj");
+                rstate->blend_finish = animation_frame_get(f, TAG_BJ);
             }
-            if(isset(f, "bs")) {
-                rstate->blend_start = get(f, "bs");
+            if(animation_frame_isset(f, TAG_BS)) {
+                rstate->blend_start = animation_frame_get(f, TAG_BS);
             }
-            if(isset(f, "bu")) { rstate->method_flags &= 0x8000; }
-            if(isset(f, "bw")) { rstate->method_flags &= 0x0080; }
-            if(isset(f, "bx")) { rstate->method_flags &= 0x0002; }
+            if(animation_frame_isset(f, TAG_BU)) { rstate->method_flags &= 0x8000; }
+            if(animation_frame_isset(f, TAG_BW)) { rstate->method_flags &= 0x0080; }
+            if(animation_frame_isset(f, TAG_BX)) { rstate->method_flags &= 0x0002; }
 
             // Palette tricks
-            if(isset(f, "bpd")) { rstate->pal_ref_index = get(f, "bpd"); }
-            if(isset(f, "bpn")) { rstate->pal_entry_count = get(f, "bpn"); }
-            if(isset(f, "bps")) { rstate->pal_start_index = get(f, "bps"); }
-            if(isset(f, "bpf")) {
+            if(animation_frame_isset(f, TAG_BPD)) { rstate->pal_ref_index = animation_frame_get(f, TAG_BPD); }
+            if(animation_frame_isset(f, TAG_BPN)) { rstate->pal_entry_count = animation_frame_get(f, TAG_BPN); }
+            if(animation_frame_isset(f, TAG_BPS)) { rstate->pal_start_index = animation_frame_get(f, TAG_BPS); }
+            if(animation_frame_isset(f, TAG_BPF)) {
                 // Exact values come from master.dat
                 if(game_state_get_player(obj->gs, 0)->har == obj) {
                     rstate->pal_start_index =  1;
@@ -427,51 +431,51 @@ void player_run(object *obj) {
                     rstate->pal_entry_count = 48;
                 }
             }
-            if(isset(f, "bpp")) {
-                rstate->pal_end = get(f, "bpp") * 4;
-                rstate->pal_begin = get(f, "bpp") * 4;
+            if(animation_frame_isset(f, TAG_BPP)) {
+                rstate->pal_end = animation_frame_get(f, TAG_BPP) * 4;
+                rstate->pal_begin = animation_frame_get(f, TAG_BPP) * 4;
             }
-            if(isset(f, "bpb")) { rstate->pal_begin = get(f, "bpb") * 4; }
-            if(isset(f, "bz"))  { rstate->pal_tint = 1; }
+            if(animation_frame_isset(f, TAG_BPB)) { rstate->pal_begin = animation_frame_get(f, TAG_BPB) * 4; }
+            if(animation_frame_isset(f, TAG_BZ))  { rstate->pal_tint = 1; }
 
             // The following is a hack. We don't REALLY know what these tags do.
             // However, they are only used in CREDITS.BK, so we can just interpret
             // then as we see fit, as long as stuff works.
-            if(isset(f, "bc") && f->duration >= 50) {
+            if(animation_frame_isset(f, TAG_BC) && f->duration >= 50) {
                 rstate->blend_start = 0;
-            } else if(isset(f, "bd") && f->duration >= 30) {
+            } else if(animation_frame_isset(f, TAG_BD) && f->duration >= 30) {
                 rstate->blend_finish = 0;
             }
 
             // Handle movement
-            if(isset(f, "ox")) {
-                DEBUG("changing X from %f to %f", obj->pos.x, obj->pos.x+get(f, "ox"));
-                /*obj->pos.x += get(f, "ox");*/
+            if(animation_frame_isset(f, TAG_OX)) {
+                DEBUG("changing X from %f to %f", obj->pos.x, obj->pos.x+animation_frame_get(f, TAG_OX));
+                /*obj->pos.x += animation_frame_get(f, TAG_OX);*/
             }
 
-            if(isset(f, "oy")) {
-                DEBUG("changing Y from %f to %f", obj->pos.y, obj->pos.y+get(f, "oy"));
-                /*obj->pos.y += get(f, "oy");*/
+            if(animation_frame_isset(f, TAG_OY)) {
+                DEBUG("changing Y from %f to %f", obj->pos.y, obj->pos.y+animation_frame_get(f, TAG_OY));
+                /*obj->pos.y += animation_frame_get(f, TAG_OY);*/
             }
 
-            if (isset(f, "bm")) {
+            if (animation_frame_isset(f, TAG_BM)) {
                 // hack because we don't have 'walk to other HAR' implemented
                 obj->pos.x = state->enemy->pos.x;
                 obj->pos.y = state->enemy->pos.y;
                 player_next_frame(state->enemy);
             }
 
-            if (isset(f, "v")) {
+            if (animation_frame_isset(f, TAG_V)) {
                 int x = 0, y = 0;
-                if(isset(f, "y-")) {
-                    y = get(f, "y-") * -1;
-                } else if(isset(f, "y+")) {
-                    y = get(f, "y+");
+                if(animation_frame_isset(f, TAG_Y_MINUS)) {
+                    y = animation_frame_get(f, TAG_Y_MINUS) * -1;
+                } else if(animation_frame_isset(f, TAG_Y_PLUS)) {
+                    y = animation_frame_get(f, TAG_Y_PLUS);
                 }
-                if(isset(f, "x-")) {
-                    x = get(f, "x-") * -1 * object_get_direction(obj);
-                } else if(isset(f, "x+")) {
-                    x = get(f, "x+") * object_get_direction(obj);
+                if(animation_frame_isset(f, TAG_X_MINUS)) {
+                    x = animation_frame_get(f, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(animation_frame_isset(f, TAG_X_PLUS)) {
+                    x = animation_frame_get(f, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
                 if (x || y) {
@@ -481,7 +485,7 @@ void player_run(object *obj) {
                 }
             }
 
-            if (isset(f, "bu") && obj->vel.y < 0.0f) {
+            if (animation_frame_isset(f, TAG_BU) && obj->vel.y < 0.0f) {
                 float x_dist = dist(obj->pos.x, 160);
                 // assume that bu is used in conjunction with 'vy-X' and that we want to land in the center of the arena
                 obj->slide_state.vel.x = x_dist / (obj->vel.y*-2);
@@ -490,25 +494,25 @@ void player_run(object *obj) {
 
 
             // handle scaling on the Y axis
-            if(isset(f, "y")) {
-                obj->y_percent = get(f, "y") / 100.0f;
+            if(animation_frame_isset(f, TAG_Y)) {
+                obj->y_percent = animation_frame_get(f, TAG_Y) / 100.0f;
             }
-            if (isset(f, "e")) {
+            if (animation_frame_isset(f, TAG_E)) {
                 // x,y relative to *enemy's* position
                 int x = 0, y = 0;
-                if(isset(f, "y-")) {
-                    y = get(f, "y-") * -1;
-                } else if(isset(f, "y+")) {
-                    y = get(f, "y+");
+                if(animation_frame_isset(f, TAG_Y_MINUS)) {
+                    y = animation_frame_get(f, TAG_Y_MINUS) * -1;
+                } else if(animation_frame_isset(f, TAG_Y_PLUS)) {
+                    y = animation_frame_get(f, TAG_Y_PLUS);
                 }
-                if(isset(f, "x-")) {
-                    x = get(f, "x-") * -1 * object_get_direction(obj);
-                } else if(isset(f, "x+")) {
-                    x = get(f, "x+") * object_get_direction(obj);
+                if(animation_frame_isset(f, TAG_X_MINUS)) {
+                    x = animation_frame_get(f, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(animation_frame_isset(f, TAG_X_PLUS)) {
+                    x = animation_frame_get(f, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
                 if (x || y) {
-                    obj->enemy_slide_state.timer = param->duration;
+                    obj->enemy_slide_state.timer = duration;
                     obj->enemy_slide_state.duration = 0;
                     obj->enemy_slide_state.dest.x = x;
                     obj->enemy_slide_state.dest.y = y;
@@ -516,95 +520,95 @@ void player_run(object *obj) {
                             obj->cur_animation->id,
                             obj->enemy_slide_state.vel.x,
                             obj->enemy_slide_state.vel.y,
-                            param->duration, x, y, x_dist, y_dist);*/
+                            duration, x, y, x_dist, y_dist);*/
                 }
             }
-            if (isset(f, "v") == 0 &&
-                isset(f, "e") == 0 &&
-                (isset(f, "x+") || isset(f, "y+") || isset(f, "x-") || isset(f, "y-"))) {
+            if (animation_frame_isset(f, TAG_V) == 0 &&
+                animation_frame_isset(f, TAG_E) == 0 &&
+                (animation_frame_isset(f, TAG_X_PLUS) || animation_frame_isset(f, TAG_Y_PLUS) || animation_frame_isset(f, TAG_X_MINUS) || animation_frame_isset(f, TAG_Y_MINUS))) {
                 // check for relative X interleaving
                 int x = 0, y = 0;
-                if(isset(f, "y-")) {
-                    y = get(f, "y-") * -1;
-                } else if(isset(f, "y+")) {
-                    y = get(f, "y+");
+                if(animation_frame_isset(f, TAG_Y_MINUS)) {
+                    y = animation_frame_get(f, TAG_Y_MINUS) * -1;
+                } else if(animation_frame_isset(f, TAG_Y_PLUS)) {
+                    y = animation_frame_get(f, TAG_Y_PLUS);
                 }
-                if(isset(f, "x-")) {
-                    x = get(f, "x-") * -1 * object_get_direction(obj);
-                } else if(isset(f, "x+")) {
-                    x = get(f, "x+") * object_get_direction(obj);
+                if(animation_frame_isset(f, TAG_X_MINUS)) {
+                    x = animation_frame_get(f, TAG_X_MINUS) * -1 * object_get_direction(obj);
+                } else if(animation_frame_isset(f, TAG_X_PLUS)) {
+                    x = animation_frame_get(f, TAG_X_PLUS) * object_get_direction(obj);
                 }
 
-                obj->slide_state.timer = param->duration;
+                obj->slide_state.timer = duration;
                 obj->slide_state.vel.x = (float)x;
                 obj->slide_state.vel.y = (float)y;
                 /*DEBUG("Slide object %d for (x,y) = (%f,%f) for %d ticks.",*/
                     /*obj->cur_animation->id,*/
                     /*obj->slide_state.vel.x, */
                     /*obj->slide_state.vel.y, */
-                    /*param->duration);*/
+                    /*duration);*/
             }
 
-            if(isset(f, "x=") || isset(f, "y=")) {
+            if(animation_frame_isset(f, TAG_X_SET) || animation_frame_isset(f, TAG_Y_SET)) {
                 obj->slide_state.vel = vec2f_create(0,0);
             }
-            if(isset(f, "x=")) {
-                obj->pos.x = obj->start.x + (get(f, "x=") * object_get_direction(obj));
-                sd_stringparser_frame n;
+            if(animation_frame_isset(f, TAG_X_SET)) {
+                obj->pos.x = obj->start.x + (animation_frame_get(f, TAG_X_SET) * object_get_direction(obj));
+                int n;
                 int r;
-                if((r =next_frame_with_tag(obj->animation_state.parser, f->id, "x=", &n)) >= 0) {
-                    int next_x = get(&n, "x=");
+                if((r = ticks_to_next_with_tag(state, f->id, TAG_X_SET, &n)) >= 0) {
+                    int next_x = animation_frame_get(&state->frames->frames[n], TAG_X_SET);
                     int slide = obj->start.x + (next_x * object_get_direction(obj));
                     if(slide != obj->pos.x) {
-                        obj->slide_state.vel.x = dist(obj->pos.x, slide) / (float)(param->duration + r);
-                        obj->slide_state.timer = param->duration + r;
+                        obj->slide_state.vel.x = dist(obj->pos.x, slide) / (float)(duration + r);
+                        obj->slide_state.timer = duration + r;
                         /*DEBUG("Slide object %d for X = %f for a total of %d ticks.",*/
                                 /*obj->cur_animation->id,*/
                                 /*obj->slide_state.vel.x,*/
-                                /*param->duration + r);*/
+                                /*duration + r);*/
                     }
 
                 }
             }
-            if(isset(f, "y=")) {
-                obj->pos.y = obj->start.y + get(f, "y=");
-                sd_stringparser_frame n;
+            if(animation_frame_isset(f, TAG_Y_SET)) {
+                obj->pos.y = obj->start.y + animation_frame_get(f, TAG_Y_SET);
+                int n;
                 int r;
-                if((r =next_frame_with_tag(obj->animation_state.parser, f->id, "y=", &n)) >= 0) {
-                    int next_y = get(&n, "y=");
+                if((r = ticks_to_next_with_tag(state, f->id, TAG_Y_SET, &n)) >= 0) {
+                    int next_y = animation_frame_get(&state->frames->frames[n], TAG_Y_SET);
                     int slide = next_y + obj->start.y;
                     if(slide != obj->pos.y) {
-                        obj->slide_state.vel.y = dist(obj->pos.y, slide) / (float)(param->duration + r);
-                        obj->slide_state.timer = param->duration + r;
+                        obj->slide_state.vel.y = dist(obj->pos.y, slide) / (float)(duration + r);
+                        obj->slide_state.timer = duration + r;
                         /*DEBUG("Slide object %d for Y = %f for a total of %d ticks.",*/
                                 /*obj->cur_animation->id,*/
                                 /*obj->slide_state.vel.y,*/
-                                /*param->duration + r);*/
+                                /*duration + r);*/
                     }
 
                 }
             }
-            if(isset(f, "as")) {
+            if(animation_frame_isset(f, TAG_AS)) {
                 // make the object move around the screen in a circular motion until end of frame
                 obj->orbit = 1;
             } else {
                 obj->orbit = 0;
             }
-            if(isset(f, "q")) {
+            if(animation_frame_isset(f, TAG_Q)) {
                 // Enable hit on the current and the next n-1 frames.
-                obj->hit_frames = get(f, "q");
+                obj->hit_frames = animation_frame_get(f, TAG_Q);
             }
             if(obj->hit_frames > 0) {
                 obj->can_hit = 1;
                 obj->hit_frames--;
             }
 
-            if(isset(f, "at")) {
+            if(animation_frame_isset(f, TAG_AT)) {
                 // set the object's X position to be behind the opponent
                 obj->pos.x = obj->animation_state.enemy->pos.x + (15 * object_get_direction(obj));
             }
 
-            if(isset(f, "ar")) {
+            if(animation_frame_isset(f, TAG_AR)) {
                 // reverse direction
                 object_set_direction(obj, object_get_direction(obj) * -1);
             }
@@ -614,12 +618,12 @@ void player_run(object *obj) {
             if(real_frame < 25) {
                 object_select_sprite(obj, real_frame);
                 if(obj->cur_sprite != NULL) {
-                    rstate->duration = param->duration;
-                    rstate->blendmode = isset(f, "br") ? BLEND_ADDITIVE : BLEND_ALPHA;
-                    if(isset(f, "r")) {
+                    rstate->duration = duration;
+                    rstate->blendmode = animation_frame_isset(f, TAG_BR) ? BLEND_ADDITIVE : BLEND_ALPHA;
+                    if(animation_frame_isset(f, TAG_R)) {
                         rstate->flipmode ^= FLIP_HORIZONTAL;
                     }
-                    if(isset(f, "f")) {
+                    if(animation_frame_isset(f, TAG_F)) {
                         rstate->flipmode ^= FLIP_VERTICAL;
                     }
                 }
@@ -628,7 +632,7 @@ void player_run(object *obj) {
             }
 
         }
-        state->previous = param->id;
+        state->previous = f->id;
     }
 
     // Animation ticks
@@ -646,7 +650,7 @@ void player_run(object *obj) {
 }
 
 void player_jump_to_tick(object *obj, int tick) {
-    sd_stringparser_goto_tick(obj->animation_state.parser, tick);
+    player_seek(&obj->animation_state, tick, UINT32_MAX);
     obj->animation_state.ticks = tick;
 }
 
@@ -668,24 +672,31 @@ void player_set_end_frame(object *obj, int end_frame) {
 
 void player_next_frame(object *obj) {
     // right now, this can only skip the first frame...
-    if(sd_stringparser_run(obj->animation_state.parser, 0) == 0) {
-        obj->animation_state.ticks = obj->animation_state.parser->current_frame.duration + 1;
+    player_animation_state *state = &obj->animation_state;
+    if(player_seek(state, 0, UINT32_MAX) == 0 && state->frame_id >= 0) {
+        state->ticks = frame_duration(state, state->frame_id) + 1;
     }
 }
 
 void player_goto_frame(object *obj, int frame_id) {
-    sd_stringparser_goto_frame(obj->animation_state.parser, frame_id, &obj->animation_state.ticks);
-    obj->animation_state.ticks++;
+    player_animation_state *state = &obj->animation_state;
+    if(animation_frames_get(state->frames, frame_id) != NULL) {
+        state->frame_id = frame_id;
+        state->animation_end = 0;
+        state->ticks = frame_start(state, frame_id);
+    }
+    state->ticks++;
 }
 
 int player_get_frame(object *obj) {
-    return sd_stringparser_get_current_frame_id(obj->animation_state.parser);
+    return obj->animation_state.frame_id;
 }
 
 char player_get_frame_letter(object *obj) {
-    return sd_stringparser_get_current_frame_letter(obj->animation_state.parser);
+    const animation_frame *f = animation_frames_get(obj->animation_state.frames, obj->animation_state.frame_id);
+    return (f != NULL) ? f->letter : 0;
 }
 
 const char* player_get_str(object *obj) {
-    return obj->animation_state.parser->string;
+    return (obj->animation_state.frames != NULL) ? obj->animation_state.frames->string : "";
 }
@@ -4,10 +4,12 @@
 #include "resources/ids.h"
 #include "resources/bk_loader.h"
 #include "utils/log.h"
+#include "utils/tracer.h"
 #include "utils/vec.h"
 #include "game/game_player.h"
 #include "game/game_state_type.h"
 #include "resources/af_loader.h"
+#include "resources/preloader.h"
 
 // Some internal functions
 void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata);
@@ -15,11 +17,16 @@ void cb_scene_destroy_object(object *parent, int id, void *userdata);
 
 // Loads BK file etc.
 int scene_create(scene *scene, game_state *gs, int scene_id) {
-    // Load BK
-    if(scene_id == SCENE_NONE || load_bk_file(&scene->bk_data, scene_id)) {
+    // Load BK. It may have already been loaded in the background during the crossfade.
+    uint64_t trace_start = tracer_begin();
+    if(scene_id == SCENE_NONE ||
+       (preloader_take_bk(gs->preload, scene_id, &scene->bk_data) &&
+        load_bk_file(&scene->bk_data, scene_id))) {
+        tracer_end("resources", "load_bk", trace_start);
         PERROR("Unable to load BK file %s (%d)!", get_id_name(scene_id), scene_id);
         return 1;
     }
+    tracer_end("resources", "load_bk", trace_start);
     scene->id = scene_id;
     scene->gs = gs;
     scene->af_data[0] = NULL;
@@ -69,9 +76,15 @@ int scene_load_har(scene *scene, int player_id, int har_id) {
         free(scene->af_data[player_id]);
     }
 
-    scene->af_data[player_id] = malloc(sizeof(af));
-
-    if(load_af_file(scene->af_data[player_id], har_id)) {
+    uint64_t trace_start = tracer_begin();
+    int ret = 0;
+    scene->af_data[player_id] = preloader_take_af(scene->gs->preload, har_id);
+    if(scene->af_data[player_id] == NULL) {
+        scene->af_data[player_id] = malloc(sizeof(af));
+        ret = load_af_file(scene->af_data[player_id], har_id);
+    }
+    tracer_end("resources", "load_af", trace_start);
+    if(ret) {
         PERROR("Unable to load HAR %s (%d)!", get_id_name(har_id), har_id);
         return 1;
     }
@@ -98,7 +111,7 @@ void scene_init(scene *scene) {
 
         // Start up animations
         if(info->load_on_start == 255 || m_load) {
-            object *obj = malloc(sizeof(object));
+            object *obj = game_state_alloc_object(scene->gs);
             object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
             object_set_stl(obj, scene->bk_data.sound_translation_table);
             object_set_animation(obj, &info->ani);
@@ -267,7 +280,7 @@ void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userd
     // Get next animation
     bk_info *info = bk_get_info(&s->bk_data, id);
     if(info != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, vec2i_add(pos, info->ani.start_pos), vec2f_create(0,0));
         object_set_stl(obj, object_get_stl(parent));
         object_set_animation(obj, &info->ani);
@@ -8,13 +8,13 @@
 #include "video/surface.h"
 #include "video/video.h"
 #include "game/scenes/arena.h"
+#include "game/particles.h"
 #include "game/utils/progressbar.h"
 #include "audio/stream.h"
 #include "audio/audio.h"
 #include "audio/music.h"
 #include "game/utils/settings.h"
 #include "game/objects/har.h"
-#include "game/objects/scrap.h"
 #include "game/objects/hazard.h"
 #include "game/protos/object.h"
 #include "game/utils/score.h"
@@ -130,7 +130,7 @@ void scene_fight_anim_start(void *userdata) {
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
     animation *fight_ani = &bk_get_info(&scene->bk_data, 10)->ani;
-    object *fight = malloc(sizeof(object));
+    object *fight = game_state_alloc_object(gs);
     object_create(fight, gs, fight_ani->start_pos, vec2f_create(0,0));
     object_set_stl(fight, bk_get_stl(&scene->bk_data));
     object_set_animation(fight, fight_ani);
@@ -158,7 +158,7 @@ void scene_youwin_anim_start(void *userdata) {
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
     animation *youwin_ani = &bk_get_info(&scene->bk_data, 9)->ani;
-    object *youwin = malloc(sizeof(object));
+    object *youwin = game_state_alloc_object(gs);
     object_create(youwin, gs, youwin_ani->start_pos, vec2f_create(0,0));
     object_set_stl(youwin, bk_get_stl(&scene->bk_data));
     object_set_animation(youwin, youwin_ani);
@@ -180,7 +180,7 @@ void scene_youlose_anim_start(void *userdata) {
     game_state *gs = userdata;
     scene *scene = game_state_get_scene(gs);
     animation *youlose_ani = &bk_get_info(&scene->bk_data, 8)->ani;
-    object *youlose = malloc(sizeof(object));
+    object *youlose = game_state_alloc_object(gs);
     object_create(youlose, gs, youlose_ani->start_pos, vec2f_create(0,0));
     object_set_stl(youlose, bk_get_stl(&scene->bk_data));
     object_set_animation(youlose, youlose_ani);
@@ -250,7 +250,7 @@ void arena_end(scene *sc) {
 
     // Switch scene
     if (is_demoplay(sc)) {
-        game_state_set_next(gs, rand_arena());
+        game_state_set_next(gs, rand_arena(&gs->rand_state));
     }
     else if (is_singleplayer(sc)) {
         game_state_set_next(gs, SCENE_NEWSROOM);
@@ -296,7 +296,7 @@ void arena_reset(scene *sc) {
     sc->bk_data.sound_translation_table[3] = 23 + local->round; // NUMBER
     // ROUND animation
     animation *round_ani = &bk_get_info(&sc->bk_data, 6)->ani;
-    object *round = malloc(sizeof(object));
+    object *round = game_state_alloc_object(sc->gs);
     object_create(round, sc->gs, round_ani->start_pos, vec2f_create(0,0));
     object_set_stl(round, sc->bk_data.sound_translation_table);
     object_set_animation(round, round_ani);
@@ -305,7 +305,7 @@ void arena_reset(scene *sc) {
 
     // Round number
     animation *number_ani = &bk_get_info(&sc->bk_data, 7)->ani;
-    object *number = malloc(sizeof(object));
+    object *number = game_state_alloc_object(sc->gs);
     object_create(number, sc->gs, number_ani->start_pos, vec2f_create(0,0));
     object_set_stl(number, sc->bk_data.sound_translation_table);
     object_set_animation(number, number_ani);
@@ -390,7 +390,7 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
     har *h = object_get_userdata(o_har);
     if (scene->id == SCENE_ARENA2 && o_har->pos.y < 190 && (h->state == STATE_FALLEN || h->state == STATE_RECOIL) && abs(o_har->vel.x) >= 1) {
         bk_info *info = bk_get_info(&scene->bk_data, 20+wall);
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(scene->gs);
         object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
         object_set_stl(obj, scene->bk_data.sound_translation_table);
         object_set_animation(obj, &info->ani);
@@ -411,7 +411,7 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
             // spawn the electricity on top of the HAR
             // TODO this doesn't track the har's position well...
             info = bk_get_info(&scene->bk_data, 22);
-            object *obj2 = malloc(sizeof(object));
+            object *obj2 = game_state_alloc_object(scene->gs);
             object_create(obj2, scene->gs, vec2i_create(o_har->pos.x, o_har->pos.y), vec2f_create(0, 0));
             object_set_stl(obj2, scene->bk_data.sound_translation_table);
             object_set_animation(obj2, &info->ani);
@@ -419,7 +419,7 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
             game_state_add_object(scene->gs, obj2, RENDER_LAYER_TOP);
         } else {
             object_free(obj);
-            free(obj);
+            game_state_release_object(scene->gs, obj);
         }
         return;
     }
@@ -428,7 +428,7 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
         DEBUG("hit desert wall %d", wall);
         // desert always shows the 'hit' animation when you touch the wall
         bk_info *info = bk_get_info(&scene->bk_data, 20+wall);
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(scene->gs);
         object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
         object_set_stl(obj, scene->bk_data.sound_translation_table);
         object_set_animation(obj, &info->ani);
@@ -436,7 +436,7 @@ void arena_har_hit_wall_hook(int player_id, int wall, scene *scene) {
         obj->singleton = 1;
         if(game_state_add_object(scene->gs, obj, RENDER_LAYER_BOTTOM) != 0) {
             object_free(obj);
-            free(obj);
+            game_state_release_object(scene->gs, obj);
         }
     }
 #ifdef DEBUGMODE_STFU
@@ -717,9 +717,9 @@ void arena_spawn_hazard(scene *scene) {
     while((pair = iter_next(&it)) != NULL) {
         bk_info *info = (bk_info*)pair->val;
         if(info->probability > 1) {
-            if (rand_int(info->probability) == 1) {
+            if (random_int(&scene->gs->rand_state, info->probability) == 1) {
                 // TODO don't spawn it if we already have this animation running
-                object *obj = malloc(sizeof(object));
+                object *obj = game_state_alloc_object(scene->gs);
                 object_create(obj, scene->gs, info->ani.start_pos, vec2f_create(0,0));
                 object_set_stl(obj, scene->bk_data.sound_translation_table);
                 object_set_animation(obj, &info->ani);
@@ -741,7 +741,7 @@ void arena_spawn_hazard(scene *scene) {
                         // the different plane formations.
                         // Pick one, rather than always use the first
 
-                        int r = rand_int(info->ani.extra_string_count);
+                        int r = random_int(&scene->gs->rand_state, info->ani.extra_string_count);
                         if (r > 0) {
                             str *s = vector_get(&info->ani.extra_strings, r);
                             object_set_custom_string(obj, str_c(s));
@@ -755,7 +755,7 @@ void arena_spawn_hazard(scene *scene) {
                     changed++;
                 } else {
                     object_free(obj);
-                    free(obj);
+                    game_state_release_object(scene->gs, obj);
                 }
             }
         }
@@ -787,7 +787,7 @@ void arena_dynamic_tick(scene *scene, int paused) {
         har2->delay = ceil(player1->ctrl->rtt / 2.0f);
 
         if(local->state != ARENA_STATE_ENDING && local->state != ARENA_STATE_STARTING) {
-            settings *setting = settings_get();
+            settings *setting = game_state_get_settings(gs);
             if (setting->gameplay.hazards_on) {
                 arena_spawn_hazard(scene);
             }
@@ -795,8 +795,8 @@ void arena_dynamic_tick(scene *scene, int paused) {
         if(local->state == ARENA_STATE_ENDING) {
             chr_score *s1 = game_player_get_score(game_state_get_player(scene->gs, 0));
             chr_score *s2 = game_player_get_score(game_state_get_player(scene->gs, 1));
-            if (player_frame_isset(obj_har1, "be")
-                || player_frame_isset(obj_har2, "be")
+            if (player_frame_isset(obj_har1, TAG_BE)
+                || player_frame_isset(obj_har2, TAG_BE)
                 || chr_score_onscreen(s1)
                 || chr_score_onscreen(s2)) {
                 /*DEBUG("blocking ending");*/
@@ -817,13 +817,13 @@ void arena_dynamic_tick(scene *scene, int paused) {
 
         // Pour some rein!
         if(local->rein_enabled) {
-            if(rand_float() > 0.65f) {
-                vec2i pos = vec2i_create(rand_int(NATIVE_W), -10);
+            if(random_float(&gs->rand_state) > 0.65f) {
+                vec2i pos = vec2i_create(random_int(&gs->rand_state, NATIVE_W), -10);
                 for(int harnum = 0;harnum < game_state_num_players(gs);harnum++) {
                     object *h_obj = game_state_get_player(gs, harnum)->har;
                     har *h = object_get_userdata(h_obj);
                     // Calculate velocity etc.
-                    float rv = rand_float() - 0.5f;
+                    float rv = random_float(&gs->rand_state) - 0.5f;
                     float velx = rv;
                     float vely = -12 * sin(0 / 2 + rv);
 
@@ -831,18 +831,16 @@ void arena_dynamic_tick(scene *scene, int paused) {
                     // (to prevent floating scrap objects)
                     if(vely < 0.1 && vely > -0.1) vely += 0.21;
 
-                    // Create the object
-                    object *scrap = malloc(sizeof(object));
-                    int anim_no = rand_int(3) + ANIM_SCRAP_METAL;
-                    object_create(scrap, gs, pos, vec2f_create(velx, vely));
-                    object_set_animation(scrap, &af_get_move(h->af_data, anim_no)->ani);
-                    object_set_gravity(scrap, 0.4f);
-                    object_set_pal_offset(scrap, object_get_pal_offset(h_obj));
-                    object_set_layers(scrap, LAYER_SCRAP);
-                    object_dynamic_tick(scrap);
-                    scrap->cast_shadow = 1;
-                    scrap_create(scrap);
-                    game_state_add_object(gs, scrap, RENDER_LAYER_TOP);
+                    int anim_no = random_int(&gs->rand_state, 3) + ANIM_SCRAP_METAL;
+                    particle_def def;
+                    def.ani = &af_get_move(h->af_data, anim_no)->ani;
+                    def.stl = NULL;
+                    def.gravity = 0.4f;
+                    def.layer = RENDER_LAYER_TOP;
+                    def.flags = PARTICLE_SHADOW;
+                    def.pal_offset = object_get_pal_offset(h_obj);
+                    def.warmup = 1;
+                    particles_emit(gs->particles, &def, vec2i_to_f(pos), vec2f_create(velx, vely));
                 }
             }
         }
@@ -895,7 +893,7 @@ void arena_render_overlay(scene *scene) {
 #ifdef DEBUGMODE
     sprintf(buf, "%u", game_state_get_tick(scene->gs));
     font_render(&font_small, buf, 160, 0, TEXT_COLOR);
-    sprintf(buf, "%u", rand_get_seed());
+    sprintf(buf, "%u", random_get_seed(&scene->gs->rand_state));
     font_render(&font_small, buf, 130, 8, TEXT_COLOR);
 #endif
     har *har[2];
@@ -1024,10 +1022,10 @@ int arena_create(scene *scene) {
     arena_local *local;
 
     // Load up settings
-    setting = settings_get();
+    setting = game_state_get_settings(scene->gs);
 
     // Initialize Demo
-    if(is_demoplay(scene)) {
+    if(is_demoplay(scene) && !scene->gs->demo_fixed) {
         game_state_init_demo(scene->gs);
     }
 
@@ -1086,7 +1084,7 @@ int arena_create(scene *scene) {
     for(int i = 0; i < 2; i++) {
         // Declare some vars
         game_player *player = game_state_get_player(scene->gs, i);
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(scene->gs);
 
         // load the player's colors into the palette
         palette *base_pal = video_get_base_palette();
@@ -1099,7 +1097,7 @@ int arena_create(scene *scene) {
         // Errors are unlikely here, but check anyway.
 
         if (scene_load_har(scene, i, player->har_id)) {
-            free(obj);
+            game_state_release_object(scene->gs, obj);
             return 1;
         }
 
@@ -1118,7 +1116,7 @@ int arena_create(scene *scene) {
         // Create round tokens
         for (int j = 0; j < 4; j++) {
             if (j < ceil(local->rounds / 2.0f)) {
-                local->player_rounds[i][j] = malloc(sizeof(object));
+                local->player_rounds[i][j] = game_state_alloc_object(scene->gs);
                 int xoff = 110 + 9 * j + 3 + j;
                 if (i == 1) {
                     xoff = 210 - 9 * j - 3 - j;
@@ -1268,7 +1266,7 @@ int arena_create(scene *scene) {
     if (local->rounds == 1) {
         // Start READY animation
         animation *ready_ani = &bk_get_info(&scene->bk_data, 11)->ani;
-        object *ready = malloc(sizeof(object));
+        object *ready = game_state_alloc_object(scene->gs);
         object_create(ready, scene->gs, ready_ani->start_pos, vec2f_create(0,0));
         object_set_stl(ready, scene->bk_data.sound_translation_table);
         object_set_animation(ready, ready_ani);
@@ -1277,7 +1275,7 @@ int arena_create(scene *scene) {
     } else {
         // ROUND
         animation *round_ani = &bk_get_info(&scene->bk_data, 6)->ani;
-        object *round = malloc(sizeof(object));
+        object *round = game_state_alloc_object(scene->gs);
         object_create(round, scene->gs, round_ani->start_pos, vec2f_create(0,0));
         object_set_stl(round, scene->bk_data.sound_translation_table);
         object_set_animation(round, round_ani);
@@ -1286,7 +1284,7 @@ int arena_create(scene *scene) {
 
         // Number
         animation *number_ani = &bk_get_info(&scene->bk_data, 7)->ani;
-        object *number = malloc(sizeof(object));
+        object *number = game_state_alloc_object(scene->gs);
         object_create(number, scene->gs, number_ani->start_pos, vec2f_create(0,0));
         object_set_stl(number, scene->bk_data.sound_translation_table);
         object_set_animation(number, number_ani);
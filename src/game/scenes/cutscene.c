@@ -124,7 +124,7 @@ int cutscene_create(scene *scene) {
 
         // Pilot face
         animation *ani = &bk_get_info(&scene->bk_data, 3)->ani;
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(scene->gs);
         object_create(obj, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
         object_set_animation(obj, ani);
         object_select_sprite(obj, p1->pilot_id);
@@ -133,7 +133,7 @@ int cutscene_create(scene *scene) {
 
         // Face effects
         ani = &bk_get_info(&scene->bk_data, 10+p1->pilot_id)->ani;
-        obj = malloc(sizeof(object));
+        obj = game_state_alloc_object(scene->gs);
         object_create(obj, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
         object_set_animation(obj, ani);
         game_state_add_object(scene->gs, obj, RENDER_LAYER_TOP);
@@ -245,7 +245,7 @@ void mainmenu_demo(component *c, void *userdata) {
     // Set up controllers
     game_state_init_demo(s->gs);
 
-    game_state_set_next(s->gs, rand_arena());
+    game_state_set_next(s->gs, rand_arena(&s->gs->rand_state));
 }
 
 void mainmenu_soreboard(component *c, void *userdata) {
@@ -908,7 +908,7 @@ void scaler_toggled(component *c, void *userdata, int pos) {
     v->scaler = realloc(v->scaler, strlen(textselector_get_current_text(c))+1);
     strcpy(v->scaler, textselector_get_current_text(c));
 
-    // If scaler is NEAREST, set factor to 1 and disable
+    // If scaler is NONE, set factor to 1 and disable
     if(textselector_get_pos(c) == 0) {
         textselector_clear_options(&local->scale_factor_toggle);
         textselector_add_option(&local->scale_factor_toggle, "1");
@@ -932,7 +932,7 @@ void scaler_toggled(component *c, void *userdata, int pos) {
         v->scale_factor = list[0];
     }
 
-    // If scaler is "Nearest", disable factor toggle
+    // If scaler is "None", disable factor toggle
     local->scale_factor_toggle.disabled = (textselector_get_pos(c) == 0);
 
     // Reinig after algorithm change
@@ -1161,7 +1161,7 @@ int mainmenu_create(scene *scene) {
     textselector_add_option(&local->vsync_toggle, "ON");
     textselector_create(&local->fullscreen_toggle, &font_large, "FULLSCREEN:", "OFF");
     textselector_add_option(&local->fullscreen_toggle, "ON");
-    textselector_create(&local->scaler_toggle, &font_large, "SCALER:", "NEAREST");
+    textselector_create(&local->scaler_toggle, &font_large, "SCALER:", "NONE");
     textselector_create(&local->scale_factor_toggle, &font_large, "SCALING FACTOR:", "1");
 
     // Get scalers
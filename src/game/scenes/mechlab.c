@@ -41,9 +41,9 @@ typedef struct mechlab_local_t {
 
 void panelbutton_create(object *pb, unsigned int npb, scene *scene, unsigned int anim) {
     for(int i = 0;i < npb; i++) {
-        sprite *button_spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, anim)->ani, i));
+        sprite *button_spr = sprite_ref(animation_get_sprite(&bk_get_info(&scene->bk_data, anim)->ani, i));
         animation *button_ani = create_animation_from_single(button_spr, vec2i_create(0,0));
-        object_create(&pb[i], pb->gs, button_spr->pos, vec2f_create(0,0));
+        object_create(&pb[i], scene->gs, button_spr->pos, vec2f_create(0,0));
         object_set_animation(&pb[i], button_ani);
         object_select_sprite(&pb[i], 0);
         object_set_repeat(&pb[i], 1);
@@ -195,7 +195,7 @@ int mechlab_create(scene *scene) {
 
     // Init the background
     for(int i = 0; i < sizeof(bg_ani)/sizeof(animation*); i++) {
-        sprite *spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 14)->ani, i));
+        sprite *spr = sprite_ref(animation_get_sprite(&bk_get_info(&scene->bk_data, 14)->ani, i));
         bg_ani[i] = create_animation_from_single(spr, spr->pos);
         object_create(&local->bg_obj[i], scene->gs, vec2i_create(0,0), vec2f_create(0,0));
         object_set_animation(&local->bg_obj[i], bg_ani[i]);
@@ -205,7 +205,7 @@ int mechlab_create(scene *scene) {
     }
 
     // Init the panel
-    sprite *panel_spr = sprite_copy(animation_get_sprite(&bk_get_info(&scene->bk_data, 1)->ani, 2));
+    sprite *panel_spr = sprite_ref(animation_get_sprite(&bk_get_info(&scene->bk_data, 1)->ani, 2));
     panel_ani = create_animation_from_single(panel_spr, panel_spr->pos);
     object_create(&local->panel_obj, scene->gs, vec2i_create(0,0), vec2f_create(0,0));
     object_set_animation(&local->panel_obj, panel_ani);
@@ -313,12 +313,12 @@ void handle_action(scene *scene, int player, int action) {
                         } else {
                             // pick an opponent we have not yet beaten
                             while(1) {
-                                int i = rand_int(10);
+                                int i = random_int(&scene->gs->rand_state, 10);
                                 if ((2 << i) & player1->sp_wins || i == player1->pilot_id) {
                                     continue;
                                 }
                                 player2->pilot_id = i;
-                                player2->har_id = HAR_JAGUAR + rand_int(10);
+                                player2->har_id = HAR_JAGUAR + random_int(&scene->gs->rand_state, 10);
                                 break;
                             }
                         }
@@ -565,7 +565,7 @@ int melee_create(scene *scene) {
         char *filename = get_path_by_id(PSM_MENU);
         music_play(filename);
         free(filename);
-        music_set_volume(settings_get()->sound.music_vol/10.0f);
+        music_set_volume(game_state_get_settings(scene->gs)->sound.music_vol/10.0f);
     }
 
     palette *mpal = video_get_base_palette();
@@ -250,12 +250,12 @@ int newsroom_event(scene *scene, SDL_Event *event) {
                                 } else {
                                     // pick an opponent we have not yet beaten
                                     while(1) {
-                                        int i = rand_int(10);
+                                        int i = random_int(&scene->gs->rand_state, 10);
                                         if ((2 << i) & p1->sp_wins || i == p1->pilot_id) {
                                             continue;
                                         }
                                         p2->pilot_id = i;
-                                        p2->har_id = HAR_JAGUAR + rand_int(10);
+                                        p2->har_id = HAR_JAGUAR + random_int(&scene->gs->rand_state, 10);
                                         break;
                                     }
                                 }
@@ -268,7 +268,7 @@ int newsroom_event(scene *scene, SDL_Event *event) {
                                 // make a new AI controller
                                 controller *ctrl = malloc(sizeof(controller));
                                 controller_init(ctrl);
-                                ai_controller_create(ctrl, settings_get()->gameplay.difficulty);
+                                ai_controller_create(ctrl, game_state_get_settings(scene->gs)->gameplay.difficulty);
                                 game_player_set_ctrl(p2, ctrl);
                                 game_state_set_next(scene->gs, SCENE_VS);
                             }
@@ -302,7 +302,7 @@ int pilot_sex(int pilot_id) {
 int newsroom_create(scene *scene) {
     newsroom_local *local = malloc(sizeof(newsroom_local));
 
-    local->news_id = rand_int(24)*2;
+    local->news_id = random_int(&scene->gs->rand_state, 24)*2;
     local->screen = 0;
     menu_background_create(&local->news_bg, 280, 50);
     str_create(&local->news_str);
@@ -333,13 +333,13 @@ int newsroom_create(scene *scene) {
     DEBUG("health is %d", health);
 
     if (health > 40 && local->won == 1) {
-        local->news_id = rand_int(6)*2;
+        local->news_id = random_int(&scene->gs->rand_state, 6)*2;
     } else if (local->won == 1) {
-        local->news_id = 12+rand_int(6)*2;
+        local->news_id = 12+random_int(&scene->gs->rand_state, 6)*2;
     } else if (health < 40 && local->won == 0) {
-        local->news_id = 38+rand_int(5)*2;
+        local->news_id = 38+random_int(&scene->gs->rand_state, 5)*2;
     } else {
-        local->news_id = 24+rand_int(7)*2;
+        local->news_id = 24+random_int(&scene->gs->rand_state, 7)*2;
     }
 
     // XXX TODO get the real sex of pilot
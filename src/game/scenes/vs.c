@@ -46,7 +46,7 @@ void cb_vs_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata
     // Get next animation
     bk_info *info = bk_get_info(&s->bk_data, id);
     if(info != NULL) {
-        object *obj = malloc(sizeof(object));
+        object *obj = game_state_alloc_object(parent->gs);
         object_create(obj, parent->gs, vec2i_add(pos, vec2f_to_i(parent->pos)), vec2f_create(0,0));
         object_set_stl(obj, object_get_stl(parent));
         object_set_animation(obj, &info->ani);
@@ -202,7 +202,7 @@ void vs_render(scene *scene) {
 
         // arena description
         font_render_wrapped(&font_small, lang_get(66+local->arena), 56+72, 160, (211-72)-4, COLOR_GREEN);
-    } else if (player2->pilot_id == 10 && settings_get()->gameplay.difficulty < 2) {
+    } else if (player2->pilot_id == 10 && game_state_get_settings(scene->gs)->gameplay.difficulty < 2) {
         // kriessack, but not on Veteran or higher
         font_render_wrapped(&font_small, lang_get(747), 59, 160, 200, COLOR_YELLOW);
     } else {
@@ -291,7 +291,7 @@ int vs_create(scene *scene) {
         local->arena = 0;
     } else {
         // pick a random arena for 1 player mode
-        local->arena = rand_int(5); // srand was done in melee
+        local->arena = random_int(&scene->gs->rand_state, 5);
     }
 
     // Arena
@@ -304,7 +304,7 @@ int vs_create(scene *scene) {
 
 
     // SCIENTIST
-    object *o_scientist = malloc(sizeof(object));
+    object *o_scientist = game_state_alloc_object(scene->gs);
     ani = &bk_get_info(&scene->bk_data, 8)->ani;
     object_create(o_scientist, scene->gs, vec2i_create(280,118), vec2f_create(0, 0));
     object_set_animation(o_scientist, ani);
@@ -313,7 +313,7 @@ int vs_create(scene *scene) {
     game_state_add_object(scene->gs, o_scientist, RENDER_LAYER_MIDDLE);
 
     // WELDER
-    object *o_welder = malloc(sizeof(object));
+    object *o_welder = game_state_alloc_object(scene->gs);
     ani = &bk_get_info(&scene->bk_data, 7)->ani;
     object_create(o_welder, scene->gs, vec2i_create(90,80), vec2f_create(0, 0));
     object_set_animation(o_welder, ani);
@@ -323,14 +323,14 @@ int vs_create(scene *scene) {
     game_state_add_object(scene->gs, o_welder, RENDER_LAYER_MIDDLE);
 
     // GANTRIES
-    object *o_gantry_a = malloc(sizeof(object));
+    object *o_gantry_a = game_state_alloc_object(scene->gs);
     ani = &bk_get_info(&scene->bk_data, 11)->ani;
     object_create(o_gantry_a, scene->gs, vec2i_create(0,0), vec2f_create(0, 0));
     object_set_animation(o_gantry_a, ani);
     object_select_sprite(o_gantry_a, 0);
     game_state_add_object(scene->gs, o_gantry_a, RENDER_LAYER_TOP);
 
-    object *o_gantry_b = malloc(sizeof(object));
+    object *o_gantry_b = game_state_alloc_object(scene->gs);
     object_create(o_gantry_b, scene->gs, vec2i_create(320,0), vec2f_create(0, 0));
     object_set_animation(o_gantry_b, ani);
     object_select_sprite(o_gantry_b, 0);
@@ -352,7 +352,7 @@ int vs_create(scene *scene) {
     local->too_pathetic_dialog.userdata = scene;
     local->too_pathetic_dialog.clicked = vs_too_pathetic_dialog_clicked;
 
-    if (player2->pilot_id == 10 && settings_get()->gameplay.difficulty < 2) {
+    if (player2->pilot_id == 10 && game_state_get_settings(scene->gs)->gameplay.difficulty < 2) {
         // kriessack, but not on Veteran or higher
         dialog_show(&local->too_pathetic_dialog, 1);
     }
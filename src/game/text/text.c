@@ -1,12 +1,214 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <assert.h>
 #include "game/text/text.h"
 #include "video/video.h"
+#include "utils/hashmap.h"
 #include "utils/log.h"
 
-void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w, int *out_h) {
-    int len = strlen(text);
+// Most text runs that are kept drawn at a time, and most remembered wrapped sizes
+#define TEXT_CACHE_MAX 256
+#define TEXT_SIZE_CACHE_MAX 256
+
+// Shadows are drawn under the text with this opacity
+#define TEXT_SHADOW_OPACITY 80
+
+enum {
+    TEXT_RUN_LINE,
+    TEXT_RUN_WRAPPED
+};
+
+// Start of a cache key. The text itself follows it.
+typedef struct text_key_t {
+    font *font;
+    color c;
+    int shadow_flags;
+    int mode;
+    int wrap_w;
+} text_key;
+
+// Values in both caches start with an entry. Entries are kept in a list, most recently
+// used first, so that the one to evict is always the last one. The key is stored
+// right after the value, so that an evicted entry can be found in the hashmap.
+typedef struct text_entry_t text_entry;
+struct text_entry_t {
+    text_entry *prev;
+    text_entry *next;
+    unsigned int key_len;
+    unsigned int last_frame;
+};
+
+typedef struct text_cache_t {
+    hashmap map;
+    text_entry *head;
+    text_entry *tail;
+    unsigned int val_size; // Size of the value before the key
+} text_cache;
+
+// Text drawn into a surface along with its shadows. The surface goes to (x + off_x, y + off_y).
+typedef struct text_run_t {
+    text_entry entry;
+    surface *sur;
+    int off_x;
+    int off_y;
+} text_run;
+
+typedef struct text_size_t {
+    text_entry entry;
+    int w;
+    int h;
+} text_size;
+
+// Glyph at a position relative to where the text is drawn
+typedef struct glyph_pos_t {
+    surface *sur;
+    int x;
+    int y;
+} glyph_pos;
+
+// The caches are not locked, so they may only be used from the rendering thread.
+// Debug builds check that they are only ever used from the thread that created them.
+static text_cache run_cache;
+static text_cache size_cache;
+static int cache_created = 0;
+static SDL_threadID cache_thread;
+static unsigned int frame = 0;
+
+static void text_cache_create(text_cache *c, unsigned int val_size) {
+    hashmap_create(&c->map, 8);
+    c->head = NULL;
+    c->tail = NULL;
+    c->val_size = val_size;
+}
+
+static void text_cache_unlink(text_cache *c, text_entry *e) {
+    if(e->prev != NULL) {
+        e->prev->next = e->next;
+    } else {
+        c->head = e->next;
+    }
+    if(e->next != NULL) {
+        e->next->prev = e->prev;
+    } else {
+        c->tail = e->prev;
+    }
+}
+
+static void text_cache_push(text_cache *c, text_entry *e) {
+    e->prev = NULL;
+    e->next = c->head;
+    if(c->head != NULL) {
+        c->head->prev = e;
+    } else {
+        c->tail = e;
+    }
+    c->head = e;
+    e->last_frame = frame;
+}
+
+// Finds an entry, and marks it as the most recently used one
+static text_entry* text_cache_get(text_cache *c, const char *key, int key_len) {
+    text_entry *e;
+    unsigned int val_len;
+    if(hashmap_get(&c->map, key, key_len, (void**)&e, &val_len) != 0) {
+        return NULL;
+    }
+    text_cache_unlink(c, e);
+    text_cache_push(c, e);
+    return e;
+}
+
+// Copies the value and the key into a new entry. The value starts with a text_entry.
+static text_entry* text_cache_put(text_cache *c, const char *key, int key_len, const void *val) {
+    char *tmp = malloc(c->val_size + key_len);
+    memcpy(tmp, val, c->val_size);
+    memcpy(tmp + c->val_size, key, key_len);
+    text_entry *e = hashmap_put(&c->map, key, key_len, tmp, c->val_size + key_len);
+    free(tmp);
+    e->key_len = key_len;
+    text_cache_push(c, e);
+    return e;
+}
+
+static void text_cache_drop(text_cache *c, text_entry *e) {
+    text_cache_unlink(c, e);
+    // The key is only read before the entry is freed
+    hashmap_del(&c->map, (char*)e + c->val_size, e->key_len);
+}
+
+static void font_cache_create() {
+    if(!cache_created) {
+        text_cache_create(&run_cache, sizeof(text_run));
+        text_cache_create(&size_cache, sizeof(text_size));
+        cache_thread = SDL_ThreadID();
+        cache_created = 1;
+    }
+    assert(SDL_ThreadID() == cache_thread);
+}
+
+static void font_run_free(text_run *run) {
+    if(run->sur != NULL) {
+        surface_free(run->sur);
+        free(run->sur);
+        run->sur = NULL;
+    }
+}
+
+void font_cache_clear() {
+    if(!cache_created) {
+        return;
+    }
+    assert(SDL_ThreadID() == cache_thread);
+    for(text_entry *e = run_cache.head; e != NULL; e = e->next) {
+        font_run_free((text_run*)e);
+    }
+    hashmap_free(&run_cache.map);
+    hashmap_free(&size_cache.map);
+    cache_created = 0;
+}
+
+void font_cache_frame_end() {
+    frame++;
+}
+
+// Builds a cache key into buf if it fits, otherwise into a new allocation
+static char* font_make_key(char *buf, int buf_size, const text_key *k, const char *text, int len, int *key_len) {
+    *key_len = sizeof(text_key) + len;
+    char *key = (*key_len <= buf_size) ? buf : malloc(*key_len);
+    memcpy(key, k, sizeof(text_key));
+    memcpy(key + sizeof(text_key), text, len);
+    return key;
+}
+
+// Drops the run that was used longest ago, unless it was used this frame. The surfaces
+// of runs drawn this frame are still needed until the frame is finished.
+static int font_cache_evict() {
+    text_run *oldest = (text_run*)run_cache.tail;
+    if(oldest == NULL || oldest->entry.last_frame == frame) {
+        return 1;
+    }
+    font_run_free(oldest);
+    text_cache_drop(&run_cache, &oldest->entry);
+    return 0;
+}
+
+static void font_layout_len(vector *glyphs, font *font, const char *text, int len, int x, int y) {
+    for(int i = 0; i < len; i++) {
+        // Make sure code is valid
+        int code = text[i] - 32;
+        if(code >= 0 && code < (int)vector_size(&font->surfaces)) {
+            glyph_pos g;
+            g.sur = *(surface**)vector_get(&font->surfaces, code);
+            g.x = x + i * font->w;
+            g.y = y;
+            vector_append(glyphs, &g);
+        }
+    }
+}
+
+// XXX If you modify this function please also reflect the changes onto font_get_wrapped_size().
+static void font_layout_wrapped(vector *glyphs, font *font, const char *text, int len, int w, int shadow_flags) {
     int has_newline = 0;
     for(int i = 0;i < len;i++) {
         if(text[i] == '\n' || text[i] == '\r') {
@@ -14,10 +216,12 @@ void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w,
             break;
         }
     }
-    if (!has_newline && font->w*len < max_w) {
+    if(!has_newline && font->w*len < w) {
         // short enough text that we don't need to wrap
-        *out_w = font->w*len;
-        *out_h = font->h;
+
+        // render it centered, at least for now
+        int xoff = (w - font->w*len)/2;
+        font_layout_len(glyphs, font, text, len, xoff, 0);
     } else {
         // ok, we actually have to do some real work
         // look ma, no mallocs!
@@ -25,13 +229,11 @@ void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w,
         const char *stop = start;
         const char *end = &start[len];
         const char *tmpstop;
-        int maxlen = max_w/font->w;
+        int maxlen = w/font->w;
         int yoff = 0;
         int is_last_line = 0;
 
-        *out_w = 0;
-        *out_h = 0;
-        while (start != end) {
+        while(start != end) {
             stop = tmpstop = start;
             while(1) {
                 // rules:
@@ -72,83 +274,142 @@ void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w,
                 }
                 stop++;
             }
-            int linelen = (stop - start) + (is_last_line?1:0);
-            if(*out_w < linelen*font->w) {
-                *out_w = linelen*font->w;
+            int linelen = stop - start;
+            int xoff = (w - font->w*linelen)/2;
+            if(shadow_flags & TEXT_SHADOW_TOP) {
+                yoff++;
             }
+            font_layout_len(glyphs, font, start, linelen + (is_last_line?1:0), xoff, yoff);
             yoff += font->h;
+            if(shadow_flags & TEXT_SHADOW_BOTTOM) {
+                yoff++;
+            }
             start = stop+1;
             stop = start;
         }
-        *out_h = yoff;
     }
 }
 
-void font_render_char(font *font, char ch, int x, int y, color c) {
-    font_render_char_shadowed(font, ch, x, y, c, 0);
-}
-
-void font_render_char_shadowed(font *font, char ch, int x, int y, color c, int shadow_flags) {
-    // Make sure code is valid
-    int code = ch - 32;
-    surface **sur = NULL;
-    if (code < 0) {
-        return;
-    }
-
-    // Get font face
-    sur = vector_get(&font->surfaces, code);
-
+// Draws one glyph straight to the screen. Glyphs are drawn from the font sheet.
+static void font_render_glyph(surface *sur, int x, int y, color c, int shadow_flags) {
     // Handle shadows if necessary
     if(shadow_flags & TEXT_SHADOW_RIGHT)
         video_render_sprite_flip_scale_opacity_tint(
-            *sur, x+1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
+            sur, x+1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, TEXT_SHADOW_OPACITY, c
         );
     if(shadow_flags & TEXT_SHADOW_LEFT)
         video_render_sprite_flip_scale_opacity_tint(
-            *sur, x-1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
+            sur, x-1, y, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, TEXT_SHADOW_OPACITY, c
         );
     if(shadow_flags & TEXT_SHADOW_BOTTOM)
         video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y+1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
+            sur, x, y+1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, TEXT_SHADOW_OPACITY, c
         );
     if(shadow_flags & TEXT_SHADOW_TOP)
         video_render_sprite_flip_scale_opacity_tint(
-            *sur, x, y-1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, 80, c
+            sur, x, y-1, BLEND_ALPHA, 0, FLIP_NONE, 1.0f, TEXT_SHADOW_OPACITY, c
         );
 
     // Handle the font face itself
-    video_render_sprite_tint(*sur, x, y, c, 0);
+    video_render_sprite_tint(sur, x, y, c, 0);
 }
 
-void font_render_len(font *font, const char *text, int len, int x, int y, color c) {
-    font_render_len_shadowed(font, text, len, x, y, c, 0);
-}
+// Draws the glyphs and their shadows into a new surface, in the same order as they would be drawn on screen
+static void font_run_create(text_run *run, font *font, vector *glyphs, color c, int shadow_flags) {
+    run->sur = NULL;
+    run->off_x = 0;
+    run->off_y = 0;
+    if(vector_size(glyphs) == 0) {
+        return;
+    }
 
-void font_render_len_shadowed(font *font, const char *text, int len, int x, int y, color c, int shadow_flags) {
-    int pos_x = x;
-    for(int i = 0; i < len; i++) {
-        font_render_char_shadowed(font, text[i], pos_x, y, c, shadow_flags);
-        pos_x += font->w;
+    // Find the area covered by glyphs and shadows
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for(unsigned int i = 0; i < vector_size(glyphs); i++) {
+        glyph_pos *g = vector_get(glyphs, i);
+        if(i == 0 || g->x < x0) x0 = g->x;
+        if(i == 0 || g->y < y0) y0 = g->y;
+        if(i == 0 || g->x + font->w > x1) x1 = g->x + font->w;
+        if(i == 0 || g->y + font->h > y1) y1 = g->y + font->h;
     }
-}
+    if(shadow_flags & TEXT_SHADOW_LEFT) x0--;
+    if(shadow_flags & TEXT_SHADOW_RIGHT) x1++;
+    if(shadow_flags & TEXT_SHADOW_TOP) y0--;
+    if(shadow_flags & TEXT_SHADOW_BOTTOM) y1++;
 
-void font_render(font *font, const char *text, int x, int y, color c) {
-    int len = strlen(text);
-    font_render_len(font, text, len, x, y, c);
-}
+    run->sur = malloc(sizeof(surface));
+    surface_create(run->sur, SURFACE_TYPE_RGBA, x1 - x0, y1 - y0);
+    memset(run->sur->data, 0, run->sur->w * run->sur->h * 4);
+    run->off_x = x0;
+    run->off_y = y0;
 
-void font_render_shadowed(font *font, const char *text, int x, int y, color c, int shadow_flags) {
-    int len = strlen(text);
-    font_render_len_shadowed(font, text, len, x, y, c, shadow_flags);
+    for(unsigned int i = 0; i < vector_size(glyphs); i++) {
+        glyph_pos *g = vector_get(glyphs, i);
+        int x = g->x - x0;
+        int y = g->y - y0;
+        if(shadow_flags & TEXT_SHADOW_RIGHT)
+            surface_blend_blit(run->sur, g->sur, x+1, y, 0, TEXT_SHADOW_OPACITY, c);
+        if(shadow_flags & TEXT_SHADOW_LEFT)
+            surface_blend_blit(run->sur, g->sur, x-1, y, 0, TEXT_SHADOW_OPACITY, c);
+        if(shadow_flags & TEXT_SHADOW_BOTTOM)
+            surface_blend_blit(run->sur, g->sur, x, y+1, 0, TEXT_SHADOW_OPACITY, c);
+        if(shadow_flags & TEXT_SHADOW_TOP)
+            surface_blend_blit(run->sur, g->sur, x, y-1, 0, TEXT_SHADOW_OPACITY, c);
+        surface_blend_blit(run->sur, g->sur, x, y, 0, 0xFF, c);
+    }
 }
 
-void font_render_wrapped(font *font, const char *text, int x, int y, int w, color c) {
-    font_render_wrapped_shadowed(font, text, x, y, w, c, 0);
+// Draws text from the run cache. The text is only laid out and drawn into a surface when
+// it is not found there. If the cache is full of text drawn this frame, glyphs are drawn one by one.
+static void font_render_run(font *font, const char *text, int len, int x, int y, int wrap_w,
+                            color c, int shadow_flags, int mode) {
+    font_cache_create();
+
+    text_key k;
+    memset(&k, 0, sizeof(text_key));
+    k.font = font;
+    k.c = c;
+    k.shadow_flags = shadow_flags;
+    k.mode = mode;
+    k.wrap_w = wrap_w;
+    char buf[256];
+    int key_len;
+    char *key = font_make_key(buf, sizeof(buf), &k, text, len, &key_len);
+
+    text_run *run = (text_run*)text_cache_get(&run_cache, key, key_len);
+    if(run == NULL) {
+        vector glyphs;
+        vector_create(&glyphs, sizeof(glyph_pos));
+        if(mode == TEXT_RUN_WRAPPED) {
+            font_layout_wrapped(&glyphs, font, text, len, wrap_w, shadow_flags);
+        } else {
+            font_layout_len(&glyphs, font, text, len, 0, 0);
+        }
+
+        if(hashmap_reserved(&run_cache.map) < TEXT_CACHE_MAX || font_cache_evict() == 0) {
+            text_run tmp;
+            font_run_create(&tmp, font, &glyphs, c, shadow_flags);
+            run = (text_run*)text_cache_put(&run_cache, key, key_len, &tmp);
+        } else {
+            iterator it;
+            glyph_pos *g;
+            vector_iter_begin(&glyphs, &it);
+            while((g = iter_next(&it)) != NULL) {
+                font_render_glyph(g->sur, x + g->x, y + g->y, c, shadow_flags);
+            }
+        }
+        vector_free(&glyphs);
+    }
+    if(key != buf) {
+        free(key);
+    }
+
+    if(run != NULL && run->sur != NULL) {
+        video_render_sprite(run->sur, x + run->off_x, y + run->off_y, BLEND_ALPHA, 0);
+    }
 }
 
-// XXX If you modify this function please also reflect the changes onto font_get_wrapped_size().
-void font_render_wrapped_shadowed(font *font, const char *text, int x, int y, int w, color c, int shadow_flags) {
+static void font_calc_wrapped_size(font *font, const char *text, int max_w, int *out_w, int *out_h) {
     int len = strlen(text);
     int has_newline = 0;
     for(int i = 0;i < len;i++) {
@@ -157,12 +418,10 @@ void font_render_wrapped_shadowed(font *font, const char *text, int x, int y, in
             break;
         }
     }
-    if(!has_newline && font->w*len < w) {
+    if (!has_newline && font->w*len < max_w) {
         // short enough text that we don't need to wrap
-
-        // render it centered, at least for now
-        int xoff = (w - font->w*len)/2;
-        font_render_len_shadowed(font, text, len, x + xoff, y, c, shadow_flags);
+        *out_w = font->w*len;
+        *out_h = font->h;
     } else {
         // ok, we actually have to do some real work
         // look ma, no mallocs!
@@ -170,11 +429,13 @@ void font_render_wrapped_shadowed(font *font, const char *text, int x, int y, in
         const char *stop = start;
         const char *end = &start[len];
         const char *tmpstop;
-        int maxlen = w/font->w;
+        int maxlen = max_w/font->w;
         int yoff = 0;
         int is_last_line = 0;
 
-        while(start != end) {
+        *out_w = 0;
+        *out_h = 0;
+        while (start != end) {
             stop = tmpstop = start;
             while(1) {
                 // rules:
@@ -215,18 +476,88 @@ void font_render_wrapped_shadowed(font *font, const char *text, int x, int y, in
                 }
                 stop++;
             }
-            int linelen = stop - start;
-            int xoff = (w - font->w*linelen)/2;
-            if(shadow_flags & TEXT_SHADOW_TOP) {
-                yoff++;
+            int linelen = (stop - start) + (is_last_line?1:0);
+            if(*out_w < linelen*font->w) {
+                *out_w = linelen*font->w;
             }
-            font_render_len_shadowed(font, start, linelen + (is_last_line?1:0), x + xoff, y + yoff, c, shadow_flags);
             yoff += font->h;
-            if(shadow_flags & TEXT_SHADOW_BOTTOM) {
-                yoff++;
-            }
             start = stop+1;
             stop = start;
         }
+        *out_h = yoff;
+    }
+}
+
+void font_get_wrapped_size(font *font, const char *text, int max_w, int *out_w, int *out_h) {
+    font_cache_create();
+
+    text_key k;
+    memset(&k, 0, sizeof(text_key));
+    k.font = font;
+    k.mode = TEXT_RUN_WRAPPED;
+    k.wrap_w = max_w;
+    char buf[256];
+    int key_len;
+    char *key = font_make_key(buf, sizeof(buf), &k, text, strlen(text), &key_len);
+
+    text_size *size = (text_size*)text_cache_get(&size_cache, key, key_len);
+    if(size != NULL) {
+        *out_w = size->w;
+        *out_h = size->h;
+    } else {
+        text_size tmp;
+        font_calc_wrapped_size(font, text, max_w, &tmp.w, &tmp.h);
+        if(hashmap_reserved(&size_cache.map) >= TEXT_SIZE_CACHE_MAX) {
+            text_cache_drop(&size_cache, size_cache.tail);
+        }
+        text_cache_put(&size_cache, key, key_len, &tmp);
+        *out_w = tmp.w;
+        *out_h = tmp.h;
+    }
+    if(key != buf) {
+        free(key);
     }
 }
+
+void font_render_char(font *font, char ch, int x, int y, color c) {
+    font_render_char_shadowed(font, ch, x, y, c, 0);
+}
+
+void font_render_char_shadowed(font *font, char ch, int x, int y, color c, int shadow_flags) {
+    // Make sure code is valid
+    int code = ch - 32;
+    surface **sur = NULL;
+    if (code < 0) {
+        return;
+    }
+
+    // Get font face
+    sur = vector_get(&font->surfaces, code);
+    font_render_glyph(*sur, x, y, c, shadow_flags);
+}
+
+void font_render_len(font *font, const char *text, int len, int x, int y, color c) {
+    font_render_len_shadowed(font, text, len, x, y, c, 0);
+}
+
+void font_render_len_shadowed(font *font, const char *text, int len, int x, int y, color c, int shadow_flags) {
+    font_render_run(font, text, len, x, y, 0, c, shadow_flags, TEXT_RUN_LINE);
+}
+
+void font_render(font *font, const char *text, int x, int y, color c) {
+    int len = strlen(text);
+    font_render_len(font, text, len, x, y, c);
+}
+
+void font_render_shadowed(font *font, const char *text, int x, int y, color c, int shadow_flags) {
+    int len = strlen(text);
+    font_render_len_shadowed(font, text, len, x, y, c, shadow_flags);
+}
+
+void font_render_wrapped(font *font, const char *text, int x, int y, int w, color c) {
+    font_render_wrapped_shadowed(font, text, x, y, w, c, 0);
+}
+
+void font_render_wrapped_shadowed(font *font, const char *text, int x, int y, int w, color c, int shadow_flags) {
+    font_render_run(font, text, strlen(text), x, y, w, c, shadow_flags, TEXT_RUN_WRAPPED);
+}
@@ -49,12 +49,16 @@ const field f_video[] = {
     F_INT(settings_video,  screen_w,       640),
     F_INT(settings_video,  screen_h,       400),
     F_BOOL(settings_video, vsync,            0),
+    F_INT(settings_video,  target_fps,      60),
     F_BOOL(settings_video, fullscreen,       0),
     F_INT(settings_video,  scaling,          0),
     F_BOOL(settings_video, instant_console,  0),
     F_BOOL(settings_video, crossfade_on,     1),
     F_STRING(settings_video, scaler, "Nearest"),
     F_INT(settings_video,  scale_factor,     1),
+    F_BOOL(settings_video, frame_scaling,    0),
+    F_INT(settings_video,  texture_cache_mb, 64),
+    F_INT(settings_video,  texture_upload_kb, 0),
 };
 
 const field f_sound[] = {
@@ -11,11 +11,14 @@
 #endif
 
 #include "engine.h"
+#include "startup.h"
+#include "simulator.h"
 #include "shadowdive/stringparser.h"
 #include "utils/log.h"
 #include "utils/random.h"
 #include "game/game_state.h"
 #include "game/utils/settings.h"
+#include "resources/animation_frames.h"
 #include "resources/global_paths.h"
 #include "resources/ids.h"
 #include "plugins/plugins.h"
@@ -44,6 +47,13 @@ void err_msgbox(const char *fmt, ...) {
 }
 #endif
 
+// Set by validate_resources() if a resource file is missing
+static char *missing_resource = NULL;
+
+static int validate_resources() {
+    return validate_resource_path(&missing_resource);
+}
+
 int main(int argc, char *argv[]) {
     // Get path
     char *path = NULL;
@@ -53,6 +63,10 @@ int main(int argc, char *argv[]) {
     int net_mode = NET_MODE_NONE;
     int portable_mode = 0;
     int ret = 0;
+#ifdef STANDALONE_SERVER
+    sim_config sim_cfg;
+    sim_config_defaults(&sim_cfg);
+#endif
 
     // if openomf.conf exists in the current directory, switch to portable mode
     if(access("openomf.conf", F_OK) != -1) {
@@ -102,8 +116,12 @@ int main(int argc, char *argv[]) {
             printf("Arguments:\n");
             printf("-h              Prints this help\n");
             printf("-w              Writes a config file\n");
+#ifdef STANDALONE_SERVER
+            sim_print_help();
+#else
             printf("-c [ip] [port]  Connect to server\n");
             printf("-l [port]       Start server\n");
+#endif
             goto exit_0;
         } else if(strcmp(argv[1], "-w") == 0) {
             if(settings_write_defaults(global_path_get(CONFIG_PATH))) {
@@ -130,6 +148,14 @@ int main(int argc, char *argv[]) {
         }
     }
 
+#ifdef STANDALONE_SERVER
+    // Headless simulation options
+    if(sim_parse_args(&sim_cfg, argc, argv)) {
+        ret = 1;
+        goto exit_0;
+    }
+#endif
+
     // Init log
 #if defined(DEBUGMODE) || defined(STANDALONE_SERVER)
     if(log_init(0)) {
@@ -201,16 +227,27 @@ int main(int argc, char *argv[]) {
     // Print all paths if debug mode is on
     global_paths_print_debug();
 
-    // Make sure the required resource files exist
-    char *missingfile = NULL;
-    if(validate_resource_path(&missingfile)) {
-        err_msgbox("Resource file does not exist: %s", missingfile);
-        free(missingfile);
+    // SDL has to be initialized before other threads are started. The subsystems are
+    // brought up later; this only sets up what threads and timers need.
+    if(SDL_Init(0)) {
+        err_msgbox("SDL2 Initialization failed: %s", SDL_GetError());
         goto exit_1;
     }
 
+    // Make sure the required resource files exist. This is done in the background
+    // while plugins are being searched, since both mostly wait for the disk.
+    int validate_task = startup_spawn("validate", validate_resources);
+
     // Find plugins and make sure they are valid
+    int stage = startup_begin("plugins");
     plugins_init();
+    startup_end(stage, 0);
+
+    if(startup_wait(validate_task)) {
+        err_msgbox("Resource file does not exist: %s", missing_resource);
+        free(missing_resource);
+        goto exit_1;
+    }
 
     // Network game override stuff
     if(ip) {
@@ -231,7 +268,7 @@ int main(int argc, char *argv[]) {
 #ifndef STANDALONE_SERVER
     sdl_flags |= SDL_INIT_VIDEO;
 #endif
-    if(SDL_Init(sdl_flags)) {
+    if(SDL_InitSubSystem(sdl_flags)) {
         err_msgbox("SDL2 Initialization failed: %s", SDL_GetError());
         goto exit_2;
     }
@@ -290,7 +327,7 @@ int main(int argc, char *argv[]) {
     // Init enet
     if(enet_initialize() != 0) {
         err_msgbox("Failed to initialize enet");
-        goto exit_3;
+        goto exit_2;
     }
 
     // Initialize engine
@@ -300,19 +337,26 @@ int main(int argc, char *argv[]) {
     }
 
     // Run
+#ifdef STANDALONE_SERVER
+    ret = sim_run(&sim_cfg);
+    (void)(net_mode);
+#else
     engine_run(net_mode);
+#endif
 
     // Close everything
     engine_close();
 exit_4:
     enet_deinitialize();
-exit_3:
-    SDL_Quit();
 exit_2:
     dumb_exit();
     settings_save();
     settings_free();
 exit_1:
+    // Startup threads have all been waited for by now. This is safe to call
+    // even if SDL was never initialized.
+    SDL_Quit();
+    animation_frames_clear_custom();
     sd_stringparser_lib_deinit();
     INFO("Exit.");
     log_close();
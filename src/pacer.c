@@ -0,0 +1,98 @@
+#include <math.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "pacer.h"
+#include "utils/log.h"
+
+// SDL_Delay() may oversleep by about a millisecond, so wake up this early and spin the rest
+#define PACER_SPIN_US 1000
+
+typedef struct pacer_t {
+    uint64_t freq;
+    uint64_t period; // Frame period in counter ticks, 0 if not limited
+    uint64_t deadline; // Next render deadline
+    uint64_t last_frame;
+    int target_fps;
+
+    // Frame time statistics (Welford's running variance)
+    unsigned int frames;
+    unsigned int missed;
+    double mean;
+    double m2;
+} pacer;
+
+static pacer pace;
+
+void pacer_init(int target_fps) {
+    memset(&pace, 0, sizeof(pacer));
+    pace.freq = SDL_GetPerformanceFrequency();
+    pacer_set_target_fps(target_fps);
+}
+
+void pacer_set_target_fps(int target_fps) {
+    pace.target_fps = (target_fps > 0) ? target_fps : 0;
+    pace.period = (pace.target_fps > 0) ? pace.freq / pace.target_fps : 0;
+    pace.deadline = SDL_GetPerformanceCounter();
+    DEBUG("Frame pacer target set to %d FPS.", pace.target_fps);
+}
+
+int pacer_get_target_fps() {
+    return pace.target_fps;
+}
+
+int pacer_render_due(uint64_t now) {
+    return (pace.period == 0 || now >= pace.deadline);
+}
+
+uint64_t pacer_render_deadline() {
+    return pace.deadline;
+}
+
+void pacer_frame_rendered(uint64_t now) {
+    // Advance the deadline. If we are more than a whole frame late, don't try to catch up.
+    if(pace.period > 0) {
+        if(now > pace.deadline + pace.period) {
+            pace.missed++;
+            pace.deadline = now + pace.period;
+        } else {
+            pace.deadline += pace.period;
+        }
+    }
+
+    // Frame time statistics
+    if(pace.last_frame != 0) {
+        double ms = (now - pace.last_frame) * 1000.0 / pace.freq;
+        pace.frames++;
+        double delta = ms - pace.mean;
+        pace.mean += delta / pace.frames;
+        pace.m2 += delta * (ms - pace.mean);
+    }
+    pace.last_frame = now;
+}
+
+void pacer_sleep_until(uint64_t deadline) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    while(now < deadline) {
+        uint64_t left_us = (deadline - now) * 1000000 / pace.freq;
+        if(left_us > PACER_SPIN_US) {
+            uint32_t ms = (left_us - PACER_SPIN_US) / 1000;
+            SDL_Delay(ms > 0 ? ms : 1);
+        }
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
+void pacer_get_stats(pacer_stats *stats) {
+    stats->frames = pace.frames;
+    stats->missed = pace.missed;
+    stats->avg = pace.mean;
+    stats->stddev = (pace.frames > 1) ? sqrt(pace.m2 / (pace.frames - 1)) : 0.0f;
+}
+
+void pacer_reset_stats() {
+    pace.frames = 0;
+    pace.missed = 0;
+    pace.mean = 0.0;
+    pace.m2 = 0.0;
+    pace.last_frame = 0;
+}
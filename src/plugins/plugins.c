@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "plugins/plugins.h"
+#include "video/scalers.h"
 #include "resources/global_paths.h"
 #include "utils/scandir.h"
 #include "utils/list.h"
@@ -104,6 +105,11 @@ void plugins_init() {
 }
 
 int plugins_get_scaler(scaler_plugin *scaler, const char* name) {
+    // Built-in scalers take precedence over plugins with the same name
+    if(scalers_get(scaler, name) == 0) {
+        return 0;
+    }
+
     // Search for a scaler with given name
     for(int i = 0; i < PLUGIN_MAX_COUNT; i++) {
         if(_plugins[i].handle != NULL
@@ -124,9 +130,14 @@ int plugins_get_scaler(scaler_plugin *scaler, const char* name) {
 int plugins_get_list_by_type(list *tlist, const char* type) {
     // Search for a scaler with given type
     int count = 0;
+    scaler_plugin builtin;
+    if(strcmp(type, "scaler") == 0) {
+        count += scalers_get_list(tlist);
+    }
     for(int i = 0; i < PLUGIN_MAX_COUNT; i++) {
         if(_plugins[i].handle != NULL
-           && strcmp(_plugins[i].get_type(), type) == 0)
+           && strcmp(_plugins[i].get_type(), type) == 0
+           && (strcmp(type, "scaler") != 0 || scalers_get(&builtin, _plugins[i].get_name()) != 0))
         {
             void *ptr = &_plugins[i];
             list_append(tlist,&ptr,sizeof(base_plugin*));
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "profiler.h"
+#include "utils/log.h"
+#include "utils/tracer.h"
+#include "game/text/text.h"
+
+// Number of frames the rolling statistics are calculated over
+#define PROFILER_WINDOW 256
+
+// How often (in frames) the overlay statistics are recalculated
+#define PROFILER_OVERLAY_REFRESH 30
+
+typedef struct profiler_t {
+    int overlay;
+    FILE *csv;
+    uint64_t freq;
+    unsigned int frame;
+
+    // Start times of running phases, and time spent per phase this frame.
+    // Timing may be switched on mid-frame, so only phases (and frames) whose
+    // start was recorded are accounted for.
+    uint64_t start[PROF_PHASE_COUNT];
+    uint64_t spent[PROF_PHASE_COUNT];
+    uint8_t started[PROF_PHASE_COUNT];
+
+    // Counters for this frame, and the last finished one
+    unsigned int counts[PROF_COUNTER_COUNT];
+    unsigned int last_counts[PROF_COUNTER_COUNT];
+
+    // Rolling window of per-frame times, in milliseconds
+    float samples[PROF_PHASE_COUNT][PROFILER_WINDOW];
+    unsigned int count;
+    unsigned int pos;
+
+    profiler_stats overlay_stats[PROF_PHASE_COUNT];
+} profiler;
+
+static profiler prof;
+
+static const char *phase_names[] = {
+    "controllers",
+    "static_tick",
+    "dynamic_tick",
+    "audio",
+    "render",
+    "render_finish",
+    "sleep",
+    "frame",
+};
+
+static const char *counter_names[] = {
+    "draw_calls",
+    "sprites",
+    "redrawn_px",
+};
+
+void profiler_init() {
+    memset(&prof, 0, sizeof(profiler));
+    prof.freq = SDL_GetPerformanceFrequency();
+}
+
+void profiler_close() {
+    profiler_csv_close();
+    prof.overlay = 0;
+}
+
+int profiler_is_enabled() {
+    return (prof.overlay || prof.csv != NULL);
+}
+
+// Phases are also timed while the tracer is recording, so they show up on the timeline
+static int profiler_is_timing() {
+    return (profiler_is_enabled() || tracer_is_enabled());
+}
+
+void profiler_set_overlay(int enabled) {
+    prof.overlay = enabled;
+}
+
+int profiler_overlay_enabled() {
+    return prof.overlay;
+}
+
+int profiler_csv_open(const char *filename) {
+    profiler_csv_close();
+    prof.csv = fopen(filename, "w");
+    if(prof.csv == NULL) {
+        PERROR("Could not open profiler CSV file '%s' for writing.", filename);
+        return 1;
+    }
+    fprintf(prof.csv, "frame");
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        fprintf(prof.csv, ",%s", phase_names[i]);
+    }
+    for(int i = 0; i < PROF_COUNTER_COUNT; i++) {
+        fprintf(prof.csv, ",%s", counter_names[i]);
+    }
+    fprintf(prof.csv, "\n");
+    DEBUG("Profiler CSV dump started to '%s'.", filename);
+    return 0;
+}
+
+void profiler_csv_close() {
+    if(prof.csv != NULL) {
+        fclose(prof.csv);
+        prof.csv = NULL;
+        DEBUG("Profiler CSV dump closed.");
+    }
+}
+
+void profiler_frame_begin() {
+    memset(prof.started, 0, sizeof(prof.started));
+    if(!profiler_is_timing()) {
+        return;
+    }
+    memset(prof.spent, 0, sizeof(prof.spent));
+    prof.start[PROF_FRAME] = SDL_GetPerformanceCounter();
+    prof.started[PROF_FRAME] = 1;
+}
+
+void profiler_begin(int phase) {
+    if(!profiler_is_timing()) {
+        return;
+    }
+    prof.start[phase] = SDL_GetPerformanceCounter();
+    prof.started[phase] = 1;
+}
+
+void profiler_end(int phase) {
+    if(!profiler_is_timing() || !prof.started[phase]) {
+        return;
+    }
+    prof.started[phase] = 0;
+    uint64_t now = SDL_GetPerformanceCounter();
+    prof.spent[phase] += now - prof.start[phase];
+    tracer_span("engine", phase_names[phase], prof.start[phase], now);
+}
+
+void profiler_count(int counter, unsigned int n) {
+    prof.counts[counter] += n;
+}
+
+unsigned int profiler_get_count(int counter) {
+    return prof.last_counts[counter];
+}
+
+static int float_cmp(const void *a, const void *b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void profiler_get_stats(int phase, profiler_stats *stats) {
+    float sorted[PROFILER_WINDOW];
+    unsigned int n = prof.count;
+
+    memset(stats, 0, sizeof(profiler_stats));
+    if(n == 0) {
+        return;
+    }
+
+    float sum = 0.0f;
+    memcpy(sorted, prof.samples[phase], n * sizeof(float));
+    for(unsigned int i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    qsort(sorted, n, sizeof(float), float_cmp);
+    stats->min = sorted[0];
+    stats->avg = sum / n;
+    stats->p99 = sorted[(n * 99) / 100];
+    stats->last = prof.samples[phase][(prof.pos + PROFILER_WINDOW - 1) % PROFILER_WINDOW];
+}
+
+void profiler_frame_end() {
+    memcpy(prof.last_counts, prof.counts, sizeof(prof.counts));
+    memset(prof.counts, 0, sizeof(prof.counts));
+    if(!profiler_is_timing() || !prof.started[PROF_FRAME]) {
+        return;
+    }
+    prof.started[PROF_FRAME] = 0;
+    uint64_t now = SDL_GetPerformanceCounter();
+    prof.spent[PROF_FRAME] = now - prof.start[PROF_FRAME];
+    tracer_span("engine", phase_names[PROF_FRAME], prof.start[PROF_FRAME], now);
+    if(!profiler_is_enabled()) {
+        return;
+    }
+
+    // Push this frame to the rolling window
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        prof.samples[i][prof.pos] = (float)(prof.spent[i] * 1000.0 / prof.freq);
+    }
+    if(prof.csv != NULL) {
+        fprintf(prof.csv, "%u", prof.frame);
+        for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+            fprintf(prof.csv, ",%.3f", prof.samples[i][prof.pos]);
+        }
+        for(int i = 0; i < PROF_COUNTER_COUNT; i++) {
+            fprintf(prof.csv, ",%u", prof.last_counts[i]);
+        }
+        fprintf(prof.csv, "\n");
+    }
+    prof.pos = (prof.pos + 1) % PROFILER_WINDOW;
+    if(prof.count < PROFILER_WINDOW) {
+        prof.count++;
+    }
+
+    // Sorting for p99 is not free, so only do it every now and then
+    if(prof.overlay && prof.frame % PROFILER_OVERLAY_REFRESH == 0) {
+        for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+            profiler_get_stats(i, &prof.overlay_stats[i]);
+        }
+    }
+    prof.frame++;
+}
+
+const char* profiler_phase_name(int phase) {
+    return phase_names[phase];
+}
+
+void profiler_render() {
+    if(!prof.overlay) {
+        return;
+    }
+    char buf[64];
+    color c = color_create(255, 255, 0, 255);
+    font_render_shadowed(&font_small, "phase          min   avg   p99", 2, 2, c, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        profiler_stats *s = &prof.overlay_stats[i];
+        snprintf(buf, sizeof(buf), "%-13s%6.2f%6.2f%6.2f", phase_names[i], s->min, s->avg, s->p99);
+        font_render_shadowed(&font_small, buf, 2, 2 + (i+1) * font_small.h, c, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    }
+    for(int i = 0; i < PROF_COUNTER_COUNT; i++) {
+        snprintf(buf, sizeof(buf), "%-13s%6u", counter_names[i], prof.last_counts[i]);
+        font_render_shadowed(&font_small, buf, 2, 2 + (PROF_PHASE_COUNT+i+1) * font_small.h, c, TEXT_SHADOW_RIGHT|TEXT_SHADOW_BOTTOM);
+    }
+}
@@ -1,6 +1,7 @@
 #include <string.h>
 #include <shadowdive/shadowdive.h>
 #include "resources/af.h"
+#include "utils/log.h"
 
 void af_create(af *a, void *src) {
     sd_af_file *sdaf = (sd_af_file*)src;
@@ -28,6 +29,20 @@ void af_create(af *a, void *src) {
             a->moves[i].id = -1;
         }
     }
+
+    // Pack sprites into atlas pages
+    atlas_create(&a->sprites);
+    int bytes = 0;
+    int unpacked_bytes = 0;
+    for(int i = 0; i < 70; i++) {
+        if(a->moves[i].id != -1) {
+            animation_add_to_atlas(&a->moves[i].ani, &a->sprites);
+            animation_add_sprite_bytes(&a->moves[i].ani, &bytes, &unpacked_bytes);
+        }
+    }
+    atlas_pack(&a->sprites);
+    DEBUG("AF %d: sprites take %d kB, %d kB saved by run-length encoding.",
+          a->id, bytes / 1024, (unpacked_bytes - bytes) / 1024);
 }
 
 af_move* af_get_move(af *a, int id) {
@@ -43,4 +58,5 @@ void af_free(af *a) {
             af_move_free(&a->moves[i]);
         }
     }
+    atlas_free(&a->sprites);
 }
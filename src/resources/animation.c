@@ -9,6 +9,7 @@ void animation_create(animation *ani, void *src, int id) {
     ani->id = id;
     ani->start_pos = vec2i_create(sdani->start_x, sdani->start_y);
     str_create_from_cstr(&ani->animation_string, sdani->anim_string);
+    ani->frames = animation_frames_compile(sdani->anim_string);
 
     // Copy collision coordinates
     vector_create(&ani->collision_coords, sizeof(collision_coord));
@@ -39,11 +40,32 @@ void animation_create(animation *ani, void *src, int id) {
     }
 }
 
+void animation_add_to_atlas(animation *ani, atlas *a) {
+    iterator it;
+    sprite *sp;
+    vector_iter_begin(&ani->sprites, &it);
+    while((sp = iter_next(&it)) != NULL) {
+        atlas_add(a, sp->data);
+    }
+}
+
+// Adds up the memory taken by sprite pixels, and what it would be without run-length encoding
+void animation_add_sprite_bytes(animation *ani, int *bytes, int *unpacked_bytes) {
+    iterator it;
+    sprite *sp;
+    vector_iter_begin(&ani->sprites, &it);
+    while((sp = iter_next(&it)) != NULL) {
+        *bytes += surface_get_bytes(sp->data);
+        *unpacked_bytes += sp->data->w * sp->data->h * 2;
+    }
+}
+
 animation* create_animation_from_single(sprite *sp, vec2i pos) {
     animation *a = malloc(sizeof(animation));
     a->start_pos = pos;
     a->id = -1;
     str_create_from_cstr(&a->animation_string, "A9999999999");
+    a->frames = animation_frames_compile("A9999999999");
     vector_create(&a->collision_coords, sizeof(collision_coord));
     vector_create(&a->extra_strings, sizeof(str));
     vector_create(&a->sprites, sizeof(sprite));
@@ -61,6 +83,8 @@ void animation_free(animation *ani) {
 
     // Free animation string
     str_free(&ani->animation_string);
+    animation_frames_free(ani->frames);
+    ani->frames = NULL;
 
     // Free collision coordinates
     vector_free(&ani->collision_coords);
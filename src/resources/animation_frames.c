@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <shadowdive/stringparser.h>
+#include "resources/animation_frames.h"
+#include "utils/hashmap.h"
+#include "utils/log.h"
+
+// Names of the tags, as they appear in the animation strings
+static const char *tag_names[TAG_COUNT] = {
+    [TAG_D] = "d",
+    [TAG_H] = "h",
+    [TAG_UA] = "ua",
+    [TAG_M] = "m",
+    [TAG_MRX] = "mrx",
+    [TAG_MM] = "mm",
+    [TAG_MX] = "mx",
+    [TAG_MRY] = "mry",
+    [TAG_MY] = "my",
+    [TAG_MG] = "mg",
+    [TAG_MD] = "md",
+    [TAG_SMO] = "smo",
+    [TAG_SMF] = "smf",
+    [TAG_S] = "s",
+    [TAG_SF] = "sf",
+    [TAG_L] = "l",
+    [TAG_SB] = "sb",
+    [TAG_B1] = "b1",
+    [TAG_B2] = "b2",
+    [TAG_BB] = "bb",
+    [TAG_BE] = "be",
+    [TAG_BF] = "bf",
+    [TAG_BH] = "bh",
+    [TAG_BL] = "bl",
+    [TAG_BM] = "bm",
+    [TAG_BJ] = "bj",
+    [TAG_BS] = "bs",
+    [TAG_BU] = "bu",
+    [TAG_BW] = "bw",
+    [TAG_BX] = "bx",
+    [TAG_BPD] = "bpd",
+    [TAG_BPN] = "bpn",
+    [TAG_BPS] = "bps",
+    [TAG_BPF] = "bpf",
+    [TAG_BPP] = "bpp",
+    [TAG_BPB] = "bpb",
+    [TAG_BZ] = "bz",
+    [TAG_BC] = "bc",
+    [TAG_BD] = "bd",
+    [TAG_OX] = "ox",
+    [TAG_OY] = "oy",
+    [TAG_V] = "v",
+    [TAG_Y_MINUS] = "y-",
+    [TAG_Y_PLUS] = "y+",
+    [TAG_X_MINUS] = "x-",
+    [TAG_X_PLUS] = "x+",
+    [TAG_Y] = "y",
+    [TAG_E] = "e",
+    [TAG_X_SET] = "x=",
+    [TAG_Y_SET] = "y=",
+    [TAG_AS] = "as",
+    [TAG_Q] = "q",
+    [TAG_AT] = "at",
+    [TAG_AR] = "ar",
+    [TAG_BR] = "br",
+    [TAG_R] = "r",
+    [TAG_F] = "f",
+    [TAG_ZZ] = "zz",
+    [TAG_ZL] = "zl",
+    [TAG_ZM] = "zm",
+    [TAG_ZH] = "zh",
+    [TAG_ZJ] = "zj",
+    [TAG_ZP] = "zp",
+    [TAG_UE] = "ue",
+    [TAG_UB] = "ub",
+    [TAG_AW] = "aw",
+    [TAG_BT] = "bt",
+    [TAG_JN] = "jn",
+    [TAG_JL] = "jl",
+    [TAG_JM] = "jm",
+    [TAG_JH] = "jh",
+    [TAG_JF] = "jf",
+    [TAG_JF2] = "jf2",
+    [TAG_K] = "k",
+};
+
+// Shared by all game states, which may run on several threads (openomf_server -j),
+// so it is only touched while holding the lock.
+static hashmap custom_cache;
+static int custom_cache_ready = 0;
+static SDL_SpinLock custom_cache_lock = 0;
+
+// Must be called with the lock held
+static animation_frames* custom_cache_find(const char *str) {
+    if(!custom_cache_ready) {
+        hashmap_create(&custom_cache, 7);
+        custom_cache_ready = 1;
+    }
+    void *val;
+    unsigned int len;
+    if(!hashmap_sget(&custom_cache, str, &val, &len)) {
+        return *(animation_frames**)val;
+    }
+    return NULL;
+}
+
+animation_frames* animation_frames_compile(const char *str) {
+    if(TAG_COUNT > ANIMATION_TAG_WORDS * 64) {
+        PERROR("Too many animation tags for the tag mask!");
+        return NULL;
+    }
+
+    sd_stringparser *parser = sd_stringparser_create();
+    if(parser == NULL) {
+        PERROR("Could not create stringparser for animation string '%s'", str);
+        return NULL;
+    }
+    sd_stringparser_set_string(parser, str);
+
+    animation_frames *af = malloc(sizeof(animation_frames));
+    af->string = strcpy(malloc(strlen(str) + 1), str);
+    af->count = sd_stringparser_num_frames(parser);
+    af->ticks_len = 0;
+    af->frames = malloc(sizeof(animation_frame) * (af->count > 0 ? af->count : 1));
+
+    // Values are first collected into a table big enough for every tag of every frame,
+    // and shrunk down afterwards.
+    int *offsets = malloc(sizeof(int) * (af->count > 0 ? af->count : 1));
+    int used = 0;
+    af->values = malloc(sizeof(int) * TAG_COUNT * (af->count > 0 ? af->count : 1));
+
+    sd_stringparser_frame f;
+    const sd_stringparser_tag_value *v;
+    for(int i = 0; i < af->count; i++) {
+        animation_frame *frame = &af->frames[i];
+        sd_stringparser_peek(parser, i, &f);
+        frame->id = i;
+        frame->letter = f.letter;
+        frame->duration = f.duration;
+        frame->start_tick = af->ticks_len;
+        memset(frame->tags, 0, sizeof(frame->tags));
+        offsets[i] = used;
+        for(int t = 0; t < TAG_COUNT; t++) {
+            if(sd_stringparser_get_tag(parser, i, tag_names[t], &v) == 0 && v->is_set) {
+                frame->tags[t >> 6] |= UINT64_C(1) << (t & 63);
+                af->values[used++] = v->value;
+            }
+        }
+        af->ticks_len += f.duration;
+    }
+    sd_stringparser_delete(parser);
+
+    if(used > 0) {
+        af->values = realloc(af->values, sizeof(int) * used);
+    }
+    for(int i = 0; i < af->count; i++) {
+        af->frames[i].values = af->values + offsets[i];
+    }
+    free(offsets);
+    return af;
+}
+
+void animation_frames_free(animation_frames *af) {
+    if(af == NULL) {
+        return;
+    }
+    free(af->string);
+    free(af->frames);
+    free(af->values);
+    free(af);
+}
+
+animation_frames* animation_frames_get_custom(const char *str) {
+    SDL_AtomicLock(&custom_cache_lock);
+    animation_frames *af = custom_cache_find(str);
+    SDL_AtomicUnlock(&custom_cache_lock);
+    if(af != NULL) {
+        return af;
+    }
+
+    // Compiled outside the lock. If another thread got there first, its copy is used.
+    animation_frames *compiled = animation_frames_compile(str);
+    if(compiled == NULL) {
+        return NULL;
+    }
+    SDL_AtomicLock(&custom_cache_lock);
+    af = custom_cache_find(str);
+    if(af == NULL) {
+        hashmap_sput(&custom_cache, str, &compiled, sizeof(animation_frames*));
+        af = compiled;
+        compiled = NULL;
+    }
+    SDL_AtomicUnlock(&custom_cache_lock);
+    animation_frames_free(compiled);
+    return af;
+}
+
+// Only called at exit, once no game states are left
+void animation_frames_clear_custom() {
+    SDL_AtomicLock(&custom_cache_lock);
+    if(!custom_cache_ready) {
+        SDL_AtomicUnlock(&custom_cache_lock);
+        return;
+    }
+    iterator it;
+    hashmap_pair *pair;
+    hashmap_iter_begin(&custom_cache, &it);
+    while((pair = iter_next(&it)) != NULL) {
+        animation_frames_free(*(animation_frames**)pair->val);
+    }
+    hashmap_free(&custom_cache);
+    custom_cache_ready = 0;
+    SDL_AtomicUnlock(&custom_cache_lock);
+}
+
+const animation_frame* animation_frames_get(const animation_frames *af, int frame_id) {
+    if(af == NULL || frame_id < 0 || frame_id >= af->count) {
+        return NULL;
+    }
+    return &af->frames[frame_id];
+}
+
+const char* animation_frames_tag_name(int tag) {
+    if(tag < 0 || tag >= TAG_COUNT) {
+        return NULL;
+    }
+    return tag_names[tag];
+}
+
+// Spreads delay ticks over the first frames; the first (delay % frames) of them get one tick more
+void animation_delay_spread(animation_delay *d, const animation_frames *af, int frames, int delay) {
+    if(frames <= 0) {
+        d->frames = 0;
+        d->per_frame = 0;
+        d->rem = 0;
+        return;
+    }
+    d->frames = (frames < af->count) ? frames : af->count;
+    d->per_frame = delay / frames;
+    d->rem = delay % frames;
+}
+
+int animation_frames_duration(const animation_frames *af, const animation_delay *d, int frame_id) {
+    int duration = af->frames[frame_id].duration;
+    if(frame_id < d->frames) {
+        duration += d->per_frame + (frame_id < d->rem ? 1 : 0);
+    }
+    return duration;
+}
+
+int animation_frames_start(const animation_frames *af, const animation_delay *d, int frame_id) {
+    int k = (frame_id < d->frames) ? frame_id : d->frames;
+    return af->frames[frame_id].start_tick + k * d->per_frame + ((k < d->rem) ? k : d->rem);
+}
+
+// Returns the next frame after frame_id that has the tag set, or -1 if there is none
+int animation_frames_next_with_tag(const animation_frames *af, int frame_id, int tag) {
+    for(int i = frame_id + 1; i < af->count; i++) {
+        if(animation_frame_isset(&af->frames[i], tag)) {
+            return i;
+        }
+    }
+    return -1;
+}
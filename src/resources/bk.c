@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <shadowdive/shadowdive.h>
 #include "resources/bk.h"
+#include "utils/log.h"
 
 void bk_create(bk *b, void *src) {
     sd_bk_file *sdbk = (sd_bk_file*)src;
@@ -35,6 +36,21 @@ void bk_create(bk *b, void *src) {
             hashmap_iput(&b->infos, i, &tmp_bk_info, sizeof(bk_info));
         }
     }
+
+    // Pack sprites into atlas pages
+    atlas_create(&b->sprites);
+    int bytes = 0;
+    int unpacked_bytes = 0;
+    for(int i = 0; i < 50; i++) {
+        bk_info *info = bk_get_info(b, i);
+        if(info != NULL) {
+            animation_add_to_atlas(&info->ani, &b->sprites);
+            animation_add_sprite_bytes(&info->ani, &bytes, &unpacked_bytes);
+        }
+    }
+    atlas_pack(&b->sprites);
+    DEBUG("BK %d: sprites take %d kB, %d kB saved by run-length encoding.",
+          b->file_id, bytes / 1024, (unpacked_bytes - bytes) / 1024);
 }
 
 bk_info* bk_get_info(bk *b, int id) {
@@ -66,4 +82,5 @@ void bk_free(bk *b) {
         bk_info_free((bk_info*)pair->val);
     }
     hashmap_free(&b->infos);
+    atlas_free(&b->sprites);
 }
@@ -1,4 +1,6 @@
 #include <shadowdive/shadowdive.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "utils/log.h"
 #include "utils/vector.h"
@@ -6,6 +8,10 @@
 #include "resources/ids.h"
 #include "resources/fonts.h"
 
+// Glyphs on the sheet
+#define FONT_SHEET_COLS 16
+#define FONT_SHEET_PADDING 2
+
 font font_small;
 font font_large;
 static int fonts_loaded = 0;
@@ -13,6 +19,7 @@ static int fonts_loaded = 0;
 void font_create(font *font) {
     font->size = FONT_UNDEFINED;
     vector_create(&font->surfaces, sizeof(surface*));
+    surface_create(&font->sheet, SURFACE_TYPE_RGBA, 0, 0);
 }
 
 void font_free(font *font) {
@@ -25,6 +32,33 @@ void font_free(font *font) {
         free(*sur);
     }
     vector_free(&font->surfaces);
+    surface_free(&font->sheet);
+}
+
+// Copies the glyphs onto a sheet, in a grid with empty pixels between them
+static void font_build_sheet(font *font) {
+    int count = vector_size(&font->surfaces);
+    int cell_w = font->w + FONT_SHEET_PADDING;
+    int cell_h = font->h + FONT_SHEET_PADDING;
+    int rows = (count + FONT_SHEET_COLS - 1) / FONT_SHEET_COLS;
+    surface_free(&font->sheet);
+    surface_create(&font->sheet, SURFACE_TYPE_RGBA,
+                   FONT_SHEET_COLS * cell_w + FONT_SHEET_PADDING,
+                   rows * cell_h + FONT_SHEET_PADDING);
+    memset(font->sheet.data, 0, font->sheet.w * font->sheet.h * 4);
+    for(int i = 0; i < count; i++) {
+        surface *glyph = *(surface**)vector_get(&font->surfaces, i);
+        int x = (i % FONT_SHEET_COLS) * cell_w + FONT_SHEET_PADDING;
+        int y = (i / FONT_SHEET_COLS) * cell_h + FONT_SHEET_PADDING;
+        for(int row = 0; row < glyph->h; row++) {
+            memcpy(font->sheet.data + ((y + row) * font->sheet.w + x) * 4,
+                   glyph->data + row * glyph->w * 4,
+                   glyph->w * 4);
+        }
+        glyph->atlas_page = &font->sheet;
+        glyph->atlas_x = x;
+        glyph->atlas_y = y;
+    }
 }
 
 int font_load(font *font, const char* filename, unsigned int size) {
@@ -61,6 +95,7 @@ int font_load(font *font, const char* filename, unsigned int size) {
     font->w = pixsize;
     font->h = pixsize;
     font->size = size;
+    font_build_sheet(font);
 
     // Free resources
     sd_rgba_image_delete(img);
@@ -174,6 +174,6 @@ int is_music(int id) {
     return (id >= PSM_ARENA0 && id <= PSM_END);
 }
 
-int rand_arena() {
-   return SCENE_ARENA0 + rand_int(5);
+int rand_arena(struct random_t *r) {
+   return SCENE_ARENA0 + random_int(r, 5);
 }
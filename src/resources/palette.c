@@ -13,6 +13,7 @@ int altpals_init() {
     altpals = sd_altpal_create();
     if(sd_altpals_load(altpals, filename)) {
         sd_altpal_delete(altpals);
+        altpals = NULL;
         PERROR("Unable to load altpals file '%s'!", filename);
         free(filename);
         return 1;
@@ -25,6 +26,7 @@ int altpals_init() {
 void altpals_close() {
     if(altpals != NULL) {
         sd_altpal_delete(altpals);
+        altpals = NULL;
     }
 }
 
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include "resources/preloader.h"
+#include "resources/bk_loader.h"
+#include "resources/af_loader.h"
+#include "resources/ids.h"
+#include "utils/log.h"
+
+static int preloader_worker(void *userdata) {
+    preloader *p = userdata;
+
+    p->bk_ok = !load_bk_file(&p->bk_data, p->scene_id);
+    for(int i = 0; i < 2; i++) {
+        if(p->har_id[i] < 0) {
+            continue;
+        }
+        p->af_data[i] = malloc(sizeof(af));
+        if(load_af_file(p->af_data[i], p->har_id[i])) {
+            free(p->af_data[i]);
+            p->af_data[i] = NULL;
+        }
+    }
+
+    p->end = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&p->done, 1);
+    return 0;
+}
+
+static void preloader_wait(preloader *p) {
+    if(p->thread == NULL) {
+        return;
+    }
+
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t wait_start = SDL_GetPerformanceCounter();
+    int ready = SDL_AtomicGet(&p->done);
+    SDL_WaitThread(p->thread, NULL);
+    p->thread = NULL;
+
+    double load_ms = (p->end - p->start) * 1000.0 / freq;
+    if(ready) {
+        INFO("Preloaded scene %s in %.1fms.", get_id_name(p->scene_id), load_ms);
+    } else {
+        double wait_ms = (SDL_GetPerformanceCounter() - wait_start) * 1000.0 / freq;
+        INFO("Preloaded scene %s in %.1fms; had to wait %.1fms for it.",
+             get_id_name(p->scene_id), load_ms, wait_ms);
+    }
+}
+
+void preloader_init(preloader *p) {
+    p->thread = NULL;
+    SDL_AtomicSet(&p->done, 0);
+    p->scene_id = SCENE_NONE;
+    p->har_id[0] = -1;
+    p->har_id[1] = -1;
+    p->bk_ok = 0;
+    p->af_data[0] = NULL;
+    p->af_data[1] = NULL;
+}
+
+int preloader_start(preloader *p, int scene_id, int har_id_a, int har_id_b) {
+    preloader_clear(p);
+
+    p->scene_id = scene_id;
+    p->har_id[0] = har_id_a;
+    p->har_id[1] = har_id_b;
+    p->start = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&p->done, 0);
+    p->thread = SDL_CreateThread(preloader_worker, "preloader", p);
+    if(p->thread == NULL) {
+        PERROR("Could not create preloader thread: %s", SDL_GetError());
+        preloader_init(p);
+        return 1;
+    }
+    return 0;
+}
+
+int preloader_take_bk(preloader *p, int scene_id, bk *b) {
+    if(p->scene_id != scene_id) {
+        return 1;
+    }
+    preloader_wait(p);
+    if(!p->bk_ok) {
+        return 1;
+    }
+    *b = p->bk_data;
+    p->bk_ok = 0;
+    return 0;
+}
+
+af* preloader_take_af(preloader *p, int har_id) {
+    for(int i = 0; i < 2; i++) {
+        if(p->har_id[i] == har_id) {
+            preloader_wait(p);
+            if(p->af_data[i] != NULL) {
+                af *a = p->af_data[i];
+                p->af_data[i] = NULL;
+                return a;
+            }
+        }
+    }
+    return NULL;
+}
+
+void preloader_clear(preloader *p) {
+    preloader_wait(p);
+    if(p->bk_ok) {
+        bk_free(&p->bk_data);
+    }
+    for(int i = 0; i < 2; i++) {
+        if(p->af_data[i] != NULL) {
+            af_free(p->af_data[i]);
+            free(p->af_data[i]);
+        }
+    }
+    preloader_init(p);
+}
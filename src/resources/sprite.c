@@ -20,11 +20,13 @@ void sprite_create(sprite *sp, void *src, int id) {
     surface_create_from_data(sp->data, SURFACE_TYPE_PALETTE, raw->w, raw->h, raw->data);
     memcpy(sp->data->stencil, raw->stencil, raw->w * raw->h);
     sd_vga_image_delete(raw);
+
+    // Sprites are mostly transparent, so keep only the opaque runs
+    surface_rle_pack(sp->data);
 }
 
 void sprite_free(sprite *sp) {
-    surface_free(sp->data);
-    free(sp->data);
+    surface_release(sp->data);
     sp->data = NULL;
 }
 
@@ -47,3 +49,15 @@ sprite* sprite_copy(sprite *src) {
     surface_copy(new->data, src->data);
     return new;
 }
+
+// Like sprite_copy, but the new sprite shares the surface of the old one.
+// Cheaper, and any texture made of the surface is shared too; the surface must not be modified.
+sprite* sprite_ref(sprite *src) {
+    if(src == NULL) return NULL;
+
+    sprite *new = malloc(sizeof(sprite));
+    new->pos = src->pos;
+    new->id = src->id;
+    new->data = surface_ref(src->data);
+    return new;
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "simulator.h"
+#include "utils/log.h"
+#include "utils/random.h"
+#include "resources/ids.h"
+#include "resources/pilots.h"
+#include "game/game_state.h"
+#include "game/game_player.h"
+#include "game/objects/har.h"
+#include "game/utils/settings.h"
+
+// Static ticks are run at a fixed rate by the engine; dynamic ticks are
+// scheduled between them the same way engine_run does, but on virtual time.
+#define SIM_MS_PER_STATIC_TICK 10
+
+void sim_config_defaults(sim_config *cfg) {
+    cfg->seed = time(NULL);
+    cfg->har_id[0] = -1;
+    cfg->har_id[1] = -1;
+    cfg->pilot_id[0] = -1;
+    cfg->pilot_id[1] = -1;
+    cfg->arena_id = -1;
+    cfg->max_ticks = 0;
+    cfg->matches = 1;
+    cfg->threads = 1;
+}
+
+void sim_print_help() {
+    printf("Simulation arguments:\n");
+    printf("-s [seed]           Random seed for the first match\n");
+    printf("-a [arena]          Arena number 0-4 (default random)\n");
+    printf("-1 [har] [pilot]    HAR (name or 0-10) and pilot (0-9) for player 1\n");
+    printf("-2 [har] [pilot]    HAR (name or 0-10) and pilot (0-9) for player 2\n");
+    printf("-t [ticks]          Dynamic tick limit per match (default none)\n");
+    printf("-n [matches]        Number of matches to run (default 1)\n");
+    printf("-j [threads]        Matches to run in parallel, 0 for one per core (default 1)\n");
+}
+
+static int sim_parse_har(const char *str) {
+    for(int i = HAR_JAGUAR; i <= HAR_NOVA; i++) {
+        if(strcasecmp(str, get_id_name(i)) == 0) {
+            return i;
+        }
+    }
+    int num = atoi(str);
+    if(num < 0 || num > HAR_NOVA - HAR_JAGUAR || (num == 0 && str[0] != '0')) {
+        return -1;
+    }
+    return HAR_JAGUAR + num;
+}
+
+int sim_parse_args(sim_config *cfg, int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i+1 < argc) {
+            cfg->seed = strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-a") == 0 && i+1 < argc) {
+            int arena = atoi(argv[++i]);
+            if(arena < 0 || arena > 4) {
+                fprintf(stderr, "Invalid arena '%s'\n", argv[i]);
+                return 1;
+            }
+            cfg->arena_id = SCENE_ARENA0 + arena;
+        } else if((strcmp(argv[i], "-1") == 0 || strcmp(argv[i], "-2") == 0) && i+2 < argc) {
+            int player = argv[i][1] - '1';
+            int har_id = sim_parse_har(argv[i+1]);
+            int pilot_id = atoi(argv[i+2]);
+            if(har_id < 0) {
+                fprintf(stderr, "Invalid HAR '%s'\n", argv[i+1]);
+                return 1;
+            }
+            if(pilot_id < 0 || pilot_id > 9) {
+                fprintf(stderr, "Invalid pilot '%s'\n", argv[i+2]);
+                return 1;
+            }
+            cfg->har_id[player] = har_id;
+            cfg->pilot_id[player] = pilot_id;
+            i += 2;
+        } else if(strcmp(argv[i], "-t") == 0 && i+1 < argc) {
+            cfg->max_ticks = strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+            cfg->matches = strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            cfg->threads = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown or incomplete argument '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void sim_set_player(game_player *player, int har_id, int pilot_id) {
+    if(har_id >= 0) {
+        player->har_id = har_id;
+    }
+    if(pilot_id >= 0) {
+        player->pilot_id = pilot_id;
+
+        // set proper color
+        pilot pilot_info;
+        pilot_get_info(&pilot_info, player->pilot_id);
+        player->colors[0] = pilot_info.colors[0];
+        player->colors[1] = pilot_info.colors[1];
+        player->colors[2] = pilot_info.colors[2];
+    }
+}
+
+int sim_run_match(const sim_config *cfg, uint32_t seed, sim_result *res) {
+    // Every match gets its own copy of the settings, so that matches
+    // running in parallel never share mutable state.
+    settings setting = *settings_get();
+
+    // There is no screen to fade, so load scenes immediately
+    setting.video.crossfade_on = 0;
+
+    game_state *gs = malloc(sizeof(game_state));
+    if(game_state_create(gs, &setting, NET_MODE_NONE, seed)) {
+        free(gs);
+        return 1;
+    }
+
+    // AI on both sides, like the demo mode. Keep our own picks when arena starts.
+    game_state_init_demo(gs);
+    gs->demo_fixed = 1;
+    for(int i = 0; i < 2; i++) {
+        sim_set_player(game_state_get_player(gs, i), cfg->har_id[i], cfg->pilot_id[i]);
+    }
+    int arena_id = (cfg->arena_id >= 0) ? cfg->arena_id : rand_arena(&gs->rand_state);
+    game_state_set_next(gs, arena_id);
+
+    // Run ticks until the arena asks for the next scene
+    unsigned int ticks = 0;
+    int dynamic_wait = 0;
+    int done = 0;
+    while(!done && game_state_is_running(gs)) {
+        game_state_tick_controllers(gs);
+        game_state_static_tick(gs);
+        dynamic_wait += SIM_MS_PER_STATIC_TICK;
+        while(!done && dynamic_wait > game_state_ms_per_dyntick(gs)) {
+            game_state_dynamic_tick(gs);
+            dynamic_wait -= game_state_ms_per_dyntick(gs);
+            ticks++;
+            if(gs->this_id == arena_id && gs->next_id != gs->this_id) {
+                done = 1;
+            }
+            if(cfg->max_ticks > 0 && ticks >= cfg->max_ticks) {
+                done = 1;
+            }
+        }
+    }
+
+    // Collect results
+    res->seed = seed;
+    res->arena_id = arena_id;
+    res->ticks = ticks;
+    res->winner = -1;
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(gs, i);
+        res->har_id[i] = player->har_id;
+        res->pilot_id[i] = player->pilot_id;
+        res->rounds[i] = player->score.rounds;
+        res->score[i] = player->score.score;
+        res->health[i] = 0;
+        if(player->har != NULL && gs->this_id == arena_id) {
+            har *h = object_get_userdata(player->har);
+            res->health[i] = h->health;
+        }
+    }
+    if(gs->this_id == arena_id && gs->next_id != gs->this_id && res->rounds[0] != res->rounds[1]) {
+        res->winner = (res->rounds[0] > res->rounds[1]) ? 0 : 1;
+    }
+
+    game_state_free(gs);
+    free(gs);
+    return 0;
+}
+
+typedef struct sim_pool_t {
+    const sim_config *cfg;
+    sim_result *results;
+    SDL_atomic_t next_match;
+} sim_pool;
+
+// Worker thread; takes matches from the pool until all have been run
+static int sim_worker(void *userdata) {
+    sim_pool *pool = userdata;
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    unsigned int m;
+    while((m = SDL_AtomicAdd(&pool->next_match, 1)) < pool->cfg->matches) {
+        sim_result *res = &pool->results[m];
+        uint64_t start = SDL_GetPerformanceCounter();
+        res->failed = sim_run_match(pool->cfg, pool->cfg->seed + m, res);
+        res->secs = (double)(SDL_GetPerformanceCounter() - start) / freq;
+    }
+    return 0;
+}
+
+static void sim_print_result(unsigned int m, const sim_result *res) {
+    printf("match %u seed %u arena %s: %s (pilot %d) vs %s (pilot %d)",
+           m, res->seed, get_id_name(res->arena_id),
+           get_id_name(res->har_id[0]), res->pilot_id[0],
+           get_id_name(res->har_id[1]), res->pilot_id[1]);
+    if(res->winner >= 0) {
+        printf(" winner %d", res->winner + 1);
+    } else {
+        printf(" unfinished");
+    }
+    printf(" rounds %d-%d health %d-%d score %d-%d ticks %u (%.0f ticks/sec)\n",
+           res->rounds[0], res->rounds[1],
+           res->health[0], res->health[1],
+           res->score[0], res->score[1],
+           res->ticks, res->secs > 0 ? res->ticks / res->secs : 0.0);
+}
+
+int sim_run(const sim_config *cfg) {
+    unsigned int total_ticks = 0;
+    unsigned int wins[2] = {0, 0};
+    unsigned int unfinished = 0;
+    unsigned int failed = 0;
+    char name[16];
+
+    unsigned int threads = cfg->threads;
+    if(threads == 0) {
+        threads = SDL_GetCPUCount();
+    }
+    if(threads > cfg->matches) {
+        threads = cfg->matches;
+    }
+
+    sim_pool pool;
+    pool.cfg = cfg;
+    pool.results = calloc(cfg->matches, sizeof(sim_result));
+    SDL_AtomicSet(&pool.next_match, 0);
+
+    INFO("Running %u matches on %u threads.", cfg->matches, threads);
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+    if(threads <= 1) {
+        sim_worker(&pool);
+    } else {
+        SDL_Thread **workers = malloc(threads * sizeof(SDL_Thread*));
+        for(unsigned int i = 0; i < threads; i++) {
+            snprintf(name, sizeof(name), "sim%u", i);
+            workers[i] = SDL_CreateThread(sim_worker, name, &pool);
+            if(workers[i] == NULL) {
+                PERROR("Could not create simulation thread: %s", SDL_GetError());
+            }
+        }
+        for(unsigned int i = 0; i < threads; i++) {
+            if(workers[i] != NULL) {
+                SDL_WaitThread(workers[i], NULL);
+            }
+        }
+        free(workers);
+
+        // If no threads could be started, run everything here
+        sim_worker(&pool);
+    }
+    double secs = (double)(SDL_GetPerformanceCounter() - start) / freq;
+
+    for(unsigned int m = 0; m < cfg->matches; m++) {
+        sim_result *res = &pool.results[m];
+        if(res->failed) {
+            PERROR("Match %u failed to run.", m);
+            failed++;
+            continue;
+        }
+        sim_print_result(m, res);
+        if(res->winner >= 0) {
+            wins[res->winner]++;
+        } else {
+            unfinished++;
+        }
+        total_ticks += res->ticks;
+    }
+    free(pool.results);
+
+    printf("total: %u matches, player 1 wins %u, player 2 wins %u, unfinished %u, failed %u\n",
+           cfg->matches, wins[0], wins[1], unfinished, failed);
+    printf("total: %u ticks in %.3f sec on %u threads (%.0f ticks/sec)\n",
+           total_ticks, secs, threads, secs > 0 ? total_ticks / secs : 0.0);
+    return failed > 0;
+}
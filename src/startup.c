@@ -0,0 +1,101 @@
+#include <SDL2/SDL.h>
+#include "startup.h"
+#include "utils/log.h"
+
+typedef struct startup_stage_t {
+    const char *name;
+    startup_func func;
+    SDL_Thread *thread;
+    uint64_t start;
+    uint64_t end;
+    int ret;
+} startup_stage;
+
+static startup_stage stages[STARTUP_MAX_STAGES];
+static int stage_count = 0;
+static uint64_t first_start = 0;
+
+static int startup_add(const char *name) {
+    if(stage_count >= STARTUP_MAX_STAGES) {
+        PERROR("Too many startup stages; not timing '%s'.", name);
+        return -1;
+    }
+    startup_stage *s = &stages[stage_count];
+    s->name = name;
+    s->func = NULL;
+    s->thread = NULL;
+    s->start = SDL_GetPerformanceCounter();
+    s->end = s->start;
+    s->ret = 0;
+    if(stage_count == 0) {
+        first_start = s->start;
+    }
+    return stage_count++;
+}
+
+static int startup_worker(void *userdata) {
+    startup_stage *s = userdata;
+    s->ret = s->func();
+    s->end = SDL_GetPerformanceCounter();
+    return 0;
+}
+
+int startup_begin(const char *name) {
+    return startup_add(name);
+}
+
+void startup_end(int stage, int ret) {
+    if(stage < 0) {
+        return;
+    }
+    stages[stage].end = SDL_GetPerformanceCounter();
+    stages[stage].ret = ret;
+}
+
+int startup_spawn(const char *name, startup_func func) {
+    int stage = startup_add(name);
+    if(stage < 0) {
+        // Can't track it, so just run it here. The result is lost, so
+        // startup_wait(-1) reports failure.
+        func();
+        return -1;
+    }
+    startup_stage *s = &stages[stage];
+    s->func = func;
+    s->thread = SDL_CreateThread(startup_worker, name, s);
+    if(s->thread == NULL) {
+        DEBUG("Could not create thread for '%s', loading it directly: %s", name, SDL_GetError());
+        startup_worker(s);
+    }
+    return stage;
+}
+
+int startup_wait(int stage) {
+    if(stage < 0) {
+        return 1;
+    }
+    startup_stage *s = &stages[stage];
+    if(s->thread != NULL) {
+        SDL_WaitThread(s->thread, NULL);
+        s->thread = NULL;
+    }
+    return s->ret;
+}
+
+void startup_report() {
+    double freq = SDL_GetPerformanceFrequency() / 1000.0;
+    uint64_t last_end = first_start;
+    INFO("Startup timing (stage, started at, duration):");
+    for(int i = 0; i < stage_count; i++) {
+        startup_stage *s = &stages[i];
+        INFO(" * %-12s %8.1fms %8.1fms%s",
+             s->name,
+             (s->start - first_start) / freq,
+             (s->end - s->start) / freq,
+             (s->ret != 0) ? " (failed)" : "");
+        if(s->end > last_end) {
+            last_end = s->end;
+        }
+    }
+    INFO(" * %-12s %8.1fms", "total", (last_end - first_start) / freq);
+}
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <stdalign.h>
+#include "utils/pool.h"
+
+// Free blocks hold a pointer to the next free block
+typedef struct pool_free_block_t {
+    struct pool_free_block_t *next;
+} pool_free_block;
+
+// Pushes the blocks of a slab to the free list, so that they are handed out in address order
+static void pool_push_slab(pool *p, char *slab) {
+    for(int i = p->blocks_per_slab - 1; i >= 0; i--) {
+        pool_free_block *b = (pool_free_block*)(slab + i * p->block_size);
+        b->next = p->free_head;
+        p->free_head = b;
+    }
+}
+
+void pool_create(pool *p, size_t block_size, unsigned int blocks_per_slab) {
+    // Blocks must be able to hold the free list pointer, and anything else
+    size_t align = alignof(max_align_t);
+    if(block_size < sizeof(pool_free_block)) {
+        block_size = sizeof(pool_free_block);
+    }
+    p->block_size = (block_size + align - 1) / align * align;
+    p->blocks_per_slab = (blocks_per_slab > 0) ? blocks_per_slab : 1;
+    p->free_head = NULL;
+    p->used = 0;
+    vector_create(&p->slabs, sizeof(char*));
+}
+
+void pool_free(pool *p) {
+    iterator it;
+    char **slab;
+    vector_iter_begin(&p->slabs, &it);
+    while((slab = iter_next(&it)) != NULL) {
+        free(*slab);
+    }
+    vector_free(&p->slabs);
+    p->free_head = NULL;
+    p->used = 0;
+}
+
+void* pool_alloc(pool *p) {
+    if(p->free_head == NULL) {
+        char *slab = malloc(p->block_size * p->blocks_per_slab);
+        if(slab == NULL) {
+            return NULL;
+        }
+        vector_append(&p->slabs, &slab);
+        pool_push_slab(p, slab);
+    }
+    pool_free_block *b = p->free_head;
+    p->free_head = b->next;
+    p->used++;
+    return b;
+}
+
+void pool_release(pool *p, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    pool_free_block *b = ptr;
+    b->next = p->free_head;
+    p->free_head = b;
+    p->used--;
+}
+
+void pool_reset(pool *p) {
+    p->free_head = NULL;
+    p->used = 0;
+    for(int i = vector_size(&p->slabs) - 1; i >= 0; i--) {
+        pool_push_slab(p, *(char**)vector_get(&p->slabs, i));
+    }
+}
+
+unsigned int pool_used(pool *p) {
+    return p->used;
+}
+
+unsigned int pool_capacity(pool *p) {
+    return vector_size(&p->slabs) * p->blocks_per_slab;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "utils/tracer.h"
+#include "utils/log.h"
+
+typedef struct trace_event_t {
+    const char *cat;
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    unsigned long tid;
+} trace_event;
+
+typedef struct tracer_t {
+    trace_event *events;
+    unsigned int size; // Always a power of two
+    SDL_atomic_t pos; // Number of events recorded since start
+    SDL_atomic_t enabled;
+    SDL_atomic_t writers; // Spans being written right now
+    uint64_t freq;
+    uint64_t epoch;
+} tracer;
+
+static tracer trace;
+
+// Stops recording, and waits for the spans that were already being written.
+// Returns whether recording was enabled.
+static int tracer_pause() {
+    int was_enabled = SDL_AtomicSet(&trace.enabled, 0);
+    while(SDL_AtomicGet(&trace.writers) > 0) {
+        SDL_Delay(0);
+    }
+    return was_enabled;
+}
+
+int tracer_start(unsigned int max_events) {
+    unsigned int size = 1;
+    while(size < max_events) {
+        size <<= 1;
+    }
+
+    // The buffer is allocated once, and kept until tracer_close(). Other threads
+    // may still be writing into it right after a stop, so it is never reallocated.
+    if(trace.events == NULL) {
+        trace.events = malloc(size * sizeof(trace_event));
+        if(trace.events == NULL) {
+            PERROR("Could not allocate tracer buffer for %u events.", size);
+            return 1;
+        }
+        trace.size = size;
+    } else if(trace.size != size) {
+        DEBUG("Tracer buffer already allocated; keeping room for %u events.", trace.size);
+    }
+    tracer_pause();
+    trace.freq = SDL_GetPerformanceFrequency();
+    trace.epoch = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&trace.pos, 0);
+    SDL_AtomicSet(&trace.enabled, 1);
+    DEBUG("Tracer started with room for %u events.", trace.size);
+    return 0;
+}
+
+void tracer_stop() {
+    SDL_AtomicSet(&trace.enabled, 0);
+}
+
+int tracer_is_enabled() {
+    return SDL_AtomicGet(&trace.enabled);
+}
+
+unsigned int tracer_event_count() {
+    unsigned int pos = SDL_AtomicGet(&trace.pos);
+    return (pos < trace.size) ? pos : trace.size;
+}
+
+uint64_t tracer_begin() {
+    if(!SDL_AtomicGet(&trace.enabled)) {
+        return 0;
+    }
+    return SDL_GetPerformanceCounter();
+}
+
+void tracer_end(const char *cat, const char *name, uint64_t start) {
+    if(start == 0 || !SDL_AtomicGet(&trace.enabled)) {
+        return;
+    }
+    tracer_span(cat, name, start, SDL_GetPerformanceCounter());
+}
+
+void tracer_span(const char *cat, const char *name, uint64_t start, uint64_t end) {
+    // Writers are counted before the flag is checked, so that once tracer_pause()
+    // sees no writers, nobody can be past the check any more.
+    SDL_AtomicAdd(&trace.writers, 1);
+    if(!SDL_AtomicGet(&trace.enabled)) {
+        SDL_AtomicAdd(&trace.writers, -1);
+        return;
+    }
+    // Spans that began before the trace was started have no place on the timeline
+    if(start >= trace.epoch && end >= start) {
+        unsigned int idx = (unsigned int)SDL_AtomicAdd(&trace.pos, 1);
+        trace_event *ev = &trace.events[idx & (trace.size - 1)];
+        ev->cat = cat;
+        ev->name = name;
+        ev->start = start;
+        ev->end = end;
+        ev->tid = SDL_ThreadID();
+    }
+    SDL_AtomicAdd(&trace.writers, -1);
+}
+
+// Writes the buffer contents (oldest first) as trace-event JSON.
+// Recording is paused while writing, and spans still being recorded are waited for.
+int tracer_flush(const char *filename) {
+    if(trace.events == NULL) {
+        PERROR("Tracer has not been started.");
+        return 1;
+    }
+
+    FILE *f = fopen(filename, "w");
+    if(f == NULL) {
+        PERROR("Could not open trace file '%s' for writing.", filename);
+        return 1;
+    }
+
+    int was_enabled = tracer_pause();
+    unsigned int pos = SDL_AtomicGet(&trace.pos);
+    unsigned int count = tracer_event_count();
+    double us_per_tick = 1000000.0 / trace.freq;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(unsigned int i = 0; i < count; i++) {
+        trace_event *ev = &trace.events[(pos - count + i) & (trace.size - 1)];
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}\n",
+                (i > 0) ? "," : "",
+                ev->name,
+                ev->cat,
+                ev->tid,
+                (ev->start - trace.epoch) * us_per_tick,
+                (ev->end - ev->start) * us_per_tick);
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    SDL_AtomicSet(&trace.enabled, was_enabled);
+    INFO("Wrote %u trace events to '%s'.", count, filename);
+    return 0;
+}
+
+// Must only be called once no other threads are running
+void tracer_close() {
+    tracer_stop();
+    free(trace.events);
+    trace.events = NULL;
+    trace.size = 0;
+}
@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "utils/workers.h"
+#include "utils/log.h"
+
+#define WORKERS_MAX 16
+
+typedef struct workers_t {
+    SDL_Thread *threads[WORKERS_MAX];
+    int thread_count;
+    SDL_mutex *job_lock; // Held by the thread that owns the current job
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    SDL_cond *done;
+    unsigned int job_id;
+    int quit;
+
+    // Current job
+    workers_func func;
+    void *userdata;
+    int count;
+    int chunk;
+    SDL_atomic_t next;
+    int pending; // Chunks not finished yet; protected by lock
+    int active; // Workers inside workers_do_chunks(); protected by lock
+} workers;
+
+static workers *pool = NULL;
+
+// Runs chunks of the current job until there are none left
+static void workers_do_chunks() {
+    int start;
+    while((start = SDL_AtomicAdd(&pool->next, pool->chunk)) < pool->count) {
+        int end = start + pool->chunk;
+        if(end > pool->count) {
+            end = pool->count;
+        }
+        pool->func(pool->userdata, start, end);
+
+        SDL_LockMutex(pool->lock);
+        if(--pool->pending == 0) {
+            SDL_CondSignal(pool->done);
+        }
+        SDL_UnlockMutex(pool->lock);
+    }
+}
+
+static int workers_thread(void *userdata) {
+    unsigned int seen_job = 0;
+    SDL_LockMutex(pool->lock);
+    while(1) {
+        while(!pool->quit && pool->job_id == seen_job) {
+            SDL_CondWait(pool->wake, pool->lock);
+        }
+        if(pool->quit) {
+            break;
+        }
+        seen_job = pool->job_id;
+        pool->active++;
+        SDL_UnlockMutex(pool->lock);
+        workers_do_chunks();
+        SDL_LockMutex(pool->lock);
+        if(--pool->active == 0) {
+            SDL_CondSignal(pool->done);
+        }
+    }
+    SDL_UnlockMutex(pool->lock);
+    return 0;
+}
+
+int workers_init(int threads) {
+    if(threads <= 0) {
+        threads = SDL_GetCPUCount() - 1;
+    }
+    if(threads > WORKERS_MAX) {
+        threads = WORKERS_MAX;
+    }
+
+    pool = malloc(sizeof(workers));
+    pool->thread_count = 0;
+    pool->job_id = 0;
+    pool->quit = 0;
+    pool->pending = 0;
+    pool->active = 0;
+    pool->job_lock = SDL_CreateMutex();
+    pool->lock = SDL_CreateMutex();
+    pool->wake = SDL_CreateCond();
+    pool->done = SDL_CreateCond();
+    if(pool->job_lock == NULL || pool->lock == NULL || pool->wake == NULL || pool->done == NULL) {
+        PERROR("Could not create worker pool: %s", SDL_GetError());
+        workers_close();
+        return 1;
+    }
+
+    for(int i = 0; i < threads; i++) {
+        pool->threads[i] = SDL_CreateThread(workers_thread, "worker", NULL);
+        if(pool->threads[i] == NULL) {
+            PERROR("Could not create worker thread: %s", SDL_GetError());
+            break;
+        }
+        pool->thread_count++;
+    }
+    DEBUG("Worker pool started with %d threads.", pool->thread_count);
+    return 0;
+}
+
+void workers_run(workers_func func, void *userdata, int count, int min_chunk) {
+    if(count <= 0) {
+        return;
+    }
+    if(pool == NULL || pool->thread_count == 0 || count < min_chunk * 2) {
+        func(userdata, 0, count);
+        return;
+    }
+
+    // A few chunks per thread keeps them busy if some chunks are slower
+    int chunk = count / ((pool->thread_count + 1) * 4);
+    if(chunk < min_chunk) {
+        chunk = min_chunk;
+    }
+
+    // Workers that woke up late for the previous job must be out before it is replaced
+    SDL_LockMutex(pool->job_lock);
+    SDL_LockMutex(pool->lock);
+    while(pool->active > 0) {
+        SDL_CondWait(pool->done, pool->lock);
+    }
+    pool->func = func;
+    pool->userdata = userdata;
+    pool->count = count;
+    pool->chunk = chunk;
+    pool->pending = (count + chunk - 1) / chunk;
+    SDL_AtomicSet(&pool->next, 0);
+    pool->job_id++;
+    SDL_CondBroadcast(pool->wake);
+    SDL_UnlockMutex(pool->lock);
+
+    workers_do_chunks();
+
+    SDL_LockMutex(pool->lock);
+    while(pool->pending > 0 || pool->active > 0) {
+        SDL_CondWait(pool->done, pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+    SDL_UnlockMutex(pool->job_lock);
+}
+
+int workers_count() {
+    return (pool != NULL) ? pool->thread_count + 1 : 1;
+}
+
+void workers_close() {
+    if(pool == NULL) {
+        return;
+    }
+    if(pool->lock != NULL) {
+        SDL_LockMutex(pool->lock);
+        pool->quit = 1;
+        SDL_CondBroadcast(pool->wake);
+        SDL_UnlockMutex(pool->lock);
+    }
+    for(int i = 0; i < pool->thread_count; i++) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+    if(pool->done) SDL_DestroyCond(pool->done);
+    if(pool->wake) SDL_DestroyCond(pool->wake);
+    if(pool->lock) SDL_DestroyMutex(pool->lock);
+    if(pool->job_lock) SDL_DestroyMutex(pool->job_lock);
+    free(pool);
+    pool = NULL;
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include "video/atlas.h"
+#include "utils/log.h"
+
+// Empty pixels between packed surfaces, so that filtering and scalers don't bleed between them
+#define ATLAS_PADDING 2
+
+void atlas_create(atlas *a) {
+    vector_create(&a->pending, sizeof(surface*));
+    vector_create(&a->packed, sizeof(surface*));
+    vector_create(&a->pages, sizeof(surface*));
+}
+
+void atlas_add(atlas *a, surface *sur) {
+    // Only paletted surfaces that fit on a page are packed; others are drawn on their own
+    if(sur->type != SURFACE_TYPE_PALETTE ||
+       sur->w > ATLAS_PAGE_SIZE - ATLAS_PADDING * 2 ||
+       sur->h > ATLAS_PAGE_SIZE - ATLAS_PADDING * 2) {
+        return;
+    }
+    vector_append(&a->pending, &sur);
+}
+
+static int atlas_height_cmp(const void *a, const void *b) {
+    const surface *sa = *(surface* const*)a;
+    const surface *sb = *(surface* const*)b;
+    return sb->h - sa->h;
+}
+
+static surface* atlas_new_page(atlas *a) {
+    surface *page = malloc(sizeof(surface));
+    surface_create(page, SURFACE_TYPE_PALETTE, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    memset(page->data, 0, ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE);
+    memset(page->stencil, 0, ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE);
+    memset(page->pal_used, 0, sizeof(page->pal_used));
+    vector_append(&a->pages, &page);
+    return page;
+}
+
+static void atlas_blit(atlas *a, surface *page, surface *sur, int x, int y) {
+    int dst = y * page->w + x;
+    surface_rle_decode(sur, page->data + dst, page->stencil + dst, page->w);
+    for(int i = 0; i < PAL_SET_WORDS; i++) {
+        page->pal_used[i] |= sur->pal_used[i];
+    }
+    page->regions = realloc(page->regions, (page->region_count + 1) * sizeof(surface_region));
+    surface_region *r = &page->regions[page->region_count++];
+    r->x = x;
+    r->y = y;
+    r->w = sur->w;
+    r->h = sur->h;
+    memcpy(r->pal_used, sur->pal_used, sizeof(r->pal_used));
+    sur->atlas_page = page;
+    sur->atlas_x = x;
+    sur->atlas_y = y;
+    surface_ref(sur);
+    vector_append(&a->packed, &sur);
+}
+
+void atlas_pack(atlas *a) {
+    if(vector_size(&a->pending) == 0) {
+        return;
+    }
+
+    // Simple shelf packing. Tallest first keeps the shelves reasonably full.
+    vector_sort(&a->pending, atlas_height_cmp);
+
+    surface *page = NULL;
+    int x = 0;
+    int y = 0;
+    int shelf_h = 0;
+    iterator it;
+    surface **s;
+    vector_iter_begin(&a->pending, &it);
+    while((s = iter_next(&it)) != NULL) {
+        surface *sur = *s;
+        if(page != NULL && x + sur->w + ATLAS_PADDING > ATLAS_PAGE_SIZE) {
+            x = ATLAS_PADDING;
+            y += shelf_h + ATLAS_PADDING;
+            shelf_h = 0;
+        }
+        if(page == NULL || y + sur->h + ATLAS_PADDING > ATLAS_PAGE_SIZE) {
+            page = atlas_new_page(a);
+            x = ATLAS_PADDING;
+            y = ATLAS_PADDING;
+            shelf_h = 0;
+        }
+        atlas_blit(a, page, sur, x, y);
+        x += sur->w + ATLAS_PADDING;
+        if(sur->h > shelf_h) {
+            shelf_h = sur->h;
+        }
+    }
+
+    DEBUG("Packed %u surfaces into %u atlas pages.", vector_size(&a->pending), vector_size(&a->pages));
+    vector_clear(&a->pending);
+}
+
+unsigned int atlas_page_count(atlas *a) {
+    return vector_size(&a->pages);
+}
+
+void atlas_free(atlas *a) {
+    iterator it;
+    surface **sur;
+    vector_iter_begin(&a->packed, &it);
+    while((sur = iter_next(&it)) != NULL) {
+        (*sur)->atlas_page = NULL;
+        surface_release(*sur);
+    }
+    vector_free(&a->packed);
+
+    surface **page;
+    vector_iter_begin(&a->pages, &it);
+    while((page = iter_next(&it)) != NULL) {
+        surface_free(*page);
+        free(*page);
+    }
+    vector_free(&a->pages);
+    vector_free(&a->pending);
+}
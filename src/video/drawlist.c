@@ -0,0 +1,142 @@
+#include <string.h>
+#include "video/drawlist.h"
+#include "video/video.h"
+
+// If more than this share of the screen has changed, it is simpler to redraw everything
+#define DRAWLIST_MAX_DIRTY_AREA (NATIVE_W * NATIVE_H * 2 / 3)
+
+void drawlist_create(drawlist *dl) {
+    vector_create(&dl->entries, sizeof(drawlist_entry));
+}
+
+void drawlist_free(drawlist *dl) {
+    vector_free(&dl->entries);
+}
+
+void drawlist_clear(drawlist *dl) {
+    vector_clear(&dl->entries);
+}
+
+void drawlist_add(drawlist *dl,
+                  surface *sur,
+                  SDL_Rect *dst,
+                  SDL_BlendMode blend_mode,
+                  int pal_offset,
+                  SDL_RendererFlip flip,
+                  uint8_t opacity,
+                  color tint,
+                  int background,
+                  int priority) {
+
+    // Entries are compared with memcmp, so padding must be zeroed too
+    drawlist_entry e;
+    memset(&e, 0, sizeof(drawlist_entry));
+    e.sur = sur;
+    e.sur_version = sur->version;
+    e.dst = *dst;
+    e.blend_mode = blend_mode;
+    e.pal_offset = pal_offset;
+    e.flip = flip;
+    e.opacity = opacity;
+    e.tint = tint;
+    e.background = background;
+    e.priority = priority;
+    vector_append(&dl->entries, &e);
+}
+
+unsigned int drawlist_size(drawlist *dl) {
+    return vector_size(&dl->entries);
+}
+
+drawlist_entry* drawlist_get(drawlist *dl, unsigned int idx) {
+    return vector_get(&dl->entries, idx);
+}
+
+static int drawlist_entry_equal(drawlist_entry *a, drawlist_entry *b) {
+    return memcmp(a, b, sizeof(drawlist_entry)) == 0;
+}
+
+static int rects_touch(const SDL_Rect *a, const SDL_Rect *b) {
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static void rect_merge(SDL_Rect *into, const SDL_Rect *r) {
+    int x1 = (into->x + into->w > r->x + r->w) ? into->x + into->w : r->x + r->w;
+    int y1 = (into->y + into->h > r->y + r->h) ? into->y + into->h : r->y + r->h;
+    into->x = (into->x < r->x) ? into->x : r->x;
+    into->y = (into->y < r->y) ? into->y : r->y;
+    into->w = x1 - into->x;
+    into->h = y1 - into->y;
+}
+
+// Adds an area to the set, merging it with any areas it touches.
+// Returns 1 if the set overflows.
+static int dirty_add(SDL_Rect *rects, int *count, int max_rects, const drawlist_entry *e) {
+    if(e->background) {
+        return 1;
+    }
+
+    // Only the part on screen matters
+    SDL_Rect screen = {0, 0, NATIVE_W, NATIVE_H};
+    SDL_Rect r;
+    if(!SDL_IntersectRect(&e->dst, &screen, &r)) {
+        return 0;
+    }
+
+    // Merging may make the area touch others, so keep going until it doesn't
+    int i = 0;
+    while(i < *count) {
+        if(rects_touch(&rects[i], &r)) {
+            rect_merge(&r, &rects[i]);
+            rects[i] = rects[--(*count)];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if(*count >= max_rects) {
+        return 1;
+    }
+    rects[(*count)++] = r;
+    return 0;
+}
+
+int drawlist_diff(drawlist *prev, drawlist *cur, SDL_Rect *rects, int max_rects) {
+    unsigned int n_prev = drawlist_size(prev);
+    unsigned int n_cur = drawlist_size(cur);
+
+    // Entries that are the same at the start and end of both frames are skipped
+    unsigned int start = 0;
+    while(start < n_prev && start < n_cur &&
+          drawlist_entry_equal(drawlist_get(prev, start), drawlist_get(cur, start))) {
+        start++;
+    }
+    unsigned int end = 0;
+    while(start + end < n_prev && start + end < n_cur &&
+          drawlist_entry_equal(drawlist_get(prev, n_prev - 1 - end), drawlist_get(cur, n_cur - 1 - end))) {
+        end++;
+    }
+
+    // Both where things were, and where they are now, have to be redrawn
+    int count = 0;
+    for(unsigned int i = start; i < n_prev - end; i++) {
+        if(dirty_add(rects, &count, max_rects, drawlist_get(prev, i))) {
+            return -1;
+        }
+    }
+    for(unsigned int i = start; i < n_cur - end; i++) {
+        if(dirty_add(rects, &count, max_rects, drawlist_get(cur, i))) {
+            return -1;
+        }
+    }
+
+    int area = 0;
+    for(int i = 0; i < count; i++) {
+        area += rects[i].w * rects[i].h;
+    }
+    if(area > DRAWLIST_MAX_DIRTY_AREA) {
+        return -1;
+    }
+    return count;
+}
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "video/pal_convert.h"
+#include "utils/log.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define PAL_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernel is built with a target attribute, so the rest of the file doesn't need -mavx2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && SDL_VERSION_ATLEAST(2,0,4)
+#define PAL_USE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN) && SDL_VERSION_ATLEAST(2,0,6)
+#define PAL_USE_NEON
+#include <arm_neon.h>
+#endif
+
+// Pixel count and rounds for pal_convert_bench()
+#define PAL_BENCH_PIXELS (320 * 200)
+#define PAL_BENCH_ROUNDS 200
+
+typedef struct pal_kernel_t {
+    const char *name;
+    pal_convert_func func;
+} pal_kernel;
+
+static pal_kernel kernel = {NULL, NULL};
+
+// Packs a color into a pixel with R,G,B,A byte order, regardless of endianness
+static uint32_t pal_pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    uint32_t px;
+    uint8_t *c = (uint8_t*)&px;
+    c[0] = r;
+    c[1] = g;
+    c[2] = b;
+    c[3] = a;
+    return px;
+}
+
+static void pal_convert_scalar(uint32_t *dst,
+                               const uint8_t *src,
+                               const uint8_t *stencil,
+                               int count,
+                               const uint32_t *lut) {
+    const uint32_t rgb = pal_pack(0xFF, 0xFF, 0xFF, 0);
+    for(int i = 0; i < count; i++) {
+        uint32_t keep = (stencil[i] == 1) ? 0xFFFFFFFF : rgb;
+        dst[i] = lut[src[i]] & keep;
+    }
+}
+
+#ifdef PAL_USE_SSE2
+// No gather in SSE2, so lookups are scalar. Stencil masking is done 16 pixels at a time.
+static void pal_convert_sse2(uint32_t *dst,
+                             const uint8_t *src,
+                             const uint8_t *stencil,
+                             int count,
+                             const uint32_t *lut) {
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i one = _mm_set1_epi8(1);
+    int i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i m8 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(stencil + i)), one);
+        __m128i m16_lo = _mm_unpacklo_epi8(m8, m8);
+        __m128i m16_hi = _mm_unpackhi_epi8(m8, m8);
+        __m128i keep[4];
+        keep[0] = _mm_or_si128(_mm_unpacklo_epi16(m16_lo, m16_lo), rgb);
+        keep[1] = _mm_or_si128(_mm_unpackhi_epi16(m16_lo, m16_lo), rgb);
+        keep[2] = _mm_or_si128(_mm_unpacklo_epi16(m16_hi, m16_hi), rgb);
+        keep[3] = _mm_or_si128(_mm_unpackhi_epi16(m16_hi, m16_hi), rgb);
+        for(int k = 0; k < 4; k++) {
+            const uint8_t *s = src + i + k * 4;
+            __m128i px = _mm_set_epi32(lut[s[3]], lut[s[2]], lut[s[1]], lut[s[0]]);
+            _mm_storeu_si128((__m128i*)(dst + i + k * 4), _mm_and_si128(px, keep[k]));
+        }
+    }
+    pal_convert_scalar(dst + i, src + i, stencil + i, count - i, lut);
+}
+#endif // PAL_USE_SSE2
+
+#ifdef PAL_USE_AVX2
+__attribute__((target("avx2")))
+static void pal_convert_avx2(uint32_t *dst,
+                             const uint8_t *src,
+                             const uint8_t *stencil,
+                             int count,
+                             const uint32_t *lut) {
+    const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        __m256i st = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(stencil + i)));
+        __m256i px = _mm256_i32gather_epi32((const int*)lut, idx, 4);
+        __m256i keep = _mm256_or_si256(_mm256_cmpeq_epi32(st, one), rgb);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_and_si256(px, keep));
+    }
+    pal_convert_scalar(dst + i, src + i, stencil + i, count - i, lut);
+}
+#endif // PAL_USE_AVX2
+
+#ifdef PAL_USE_NEON
+// A 256 entry table doesn't fit the NEON table lookups, so lookups are scalar here too
+static void pal_convert_neon(uint32_t *dst,
+                             const uint8_t *src,
+                             const uint8_t *stencil,
+                             int count,
+                             const uint32_t *lut) {
+    const uint32x4_t rgb = vdupq_n_u32(0x00FFFFFF);
+    const uint8x8_t one = vdup_n_u8(1);
+    uint32_t px[8];
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        uint16x8_t m16 = vmovl_u8(vceq_u8(vld1_u8(stencil + i), one));
+        uint32x4_t keep_lo = vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(m16)), 24), rgb);
+        uint32x4_t keep_hi = vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(m16)), 24), rgb);
+        for(int k = 0; k < 8; k++) {
+            px[k] = lut[src[i + k]];
+        }
+        vst1q_u32(dst + i, vandq_u32(vld1q_u32(px), keep_lo));
+        vst1q_u32(dst + i + 4, vandq_u32(vld1q_u32(px + 4), keep_hi));
+    }
+    pal_convert_scalar(dst + i, src + i, stencil + i, count - i, lut);
+}
+#endif // PAL_USE_NEON
+
+// Lists the kernels this CPU can run, fastest first
+static int pal_supported_kernels(pal_kernel *list) {
+    int n = 0;
+#ifdef PAL_USE_AVX2
+    if(SDL_HasAVX2()) {
+        list[n].name = "avx2";
+        list[n++].func = pal_convert_avx2;
+    }
+#endif
+#ifdef PAL_USE_SSE2
+    if(SDL_HasSSE2()) {
+        list[n].name = "sse2";
+        list[n++].func = pal_convert_sse2;
+    }
+#endif
+#ifdef PAL_USE_NEON
+    if(SDL_HasNEON()) {
+        list[n].name = "neon";
+        list[n++].func = pal_convert_neon;
+    }
+#endif
+    list[n].name = "scalar";
+    list[n++].func = pal_convert_scalar;
+    return n;
+}
+
+void pal_convert_init() {
+    pal_kernel list[4];
+    pal_supported_kernels(list);
+    kernel = list[0];
+    DEBUG("Palette conversion kernel: %s", kernel.name);
+}
+
+const char* pal_convert_kernel_name() {
+    if(kernel.func == NULL) {
+        pal_convert_init();
+    }
+    return kernel.name;
+}
+
+void pal_build_lut(uint32_t *lut, const screen_palette *pal, const char *remap_table, uint8_t pal_offset) {
+    for(int i = 0; i < 256; i++) {
+        uint8_t idx = (remap_table != NULL) ? (uint8_t)remap_table[i] : i;
+
+        // TODO: This is kind of a hack. Since the pal_offset
+        // is only ever used for player 2 har, we can safely
+        // make some assumptions. therefore, only apply offset,
+        // if the color we are handling is between 0 and 48 (har colors).
+        if(idx < 48) {
+            idx += pal_offset;
+        }
+        lut[i] = pal_pack(pal->data[idx][0], pal->data[idx][1], pal->data[idx][2], 0xFF);
+    }
+}
+
+void pal_convert(uint32_t *dst, const uint8_t *src, const uint8_t *stencil, int count, const uint32_t *lut) {
+    if(kernel.func == NULL) {
+        pal_convert_init();
+    }
+    kernel.func(dst, src, stencil, count, lut);
+}
+
+// The per-pixel loop that surface_to_rgba() used before the kernels, for comparison
+static void pal_convert_reference(char *dst,
+                                  const uint8_t *src,
+                                  const uint8_t *stencil,
+                                  int count,
+                                  const screen_palette *pal,
+                                  const char *remap_table,
+                                  uint8_t pal_offset) {
+    int n = 0;
+    uint8_t idx = 0;
+    for(int i = 0; i < count; i++) {
+        n = i * 4;
+        if(remap_table != NULL) {
+            idx = (uint8_t)remap_table[src[i]];
+        } else {
+            idx = src[i];
+        }
+        if(idx < 48) {
+            idx += pal_offset;
+        }
+        *(dst + n + 0) = pal->data[idx][0];
+        *(dst + n + 1) = pal->data[idx][1];
+        *(dst + n + 2) = pal->data[idx][2];
+        *(dst + n + 3) = (stencil[i] == 1) ? 0xFF : 0;
+    }
+}
+
+static double pal_bench_mpix(uint64_t start, uint64_t end) {
+    double secs = (double)(end - start) / SDL_GetPerformanceFrequency();
+    return (secs > 0) ? (double)PAL_BENCH_PIXELS * PAL_BENCH_ROUNDS / secs / 1000000.0 : 0;
+}
+
+int pal_convert_bench(pal_bench_result *results, int max_results) {
+    uint8_t *src = malloc(PAL_BENCH_PIXELS);
+    uint8_t *stencil = malloc(PAL_BENCH_PIXELS);
+    uint32_t *expected = malloc(PAL_BENCH_PIXELS * 4);
+    uint32_t *dst = malloc(PAL_BENCH_PIXELS * 4);
+    uint32_t lut[256];
+    screen_palette *pal = malloc(sizeof(screen_palette));
+    int n = 0;
+
+    // Sprite-like data; mostly visible pixels, all palette indices in use
+    uint32_t seed = 0x1234567;
+    for(int i = 0; i < 256; i++) {
+        seed = seed * 1103515245 + 12345;
+        pal->data[i][0] = seed >> 8;
+        pal->data[i][1] = seed >> 16;
+        pal->data[i][2] = seed >> 24;
+    }
+    for(int i = 0; i < PAL_BENCH_PIXELS; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = seed >> 16;
+        stencil[i] = ((seed >> 8) & 7) != 0;
+    }
+
+    if(n < max_results) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int r = 0; r < PAL_BENCH_ROUNDS; r++) {
+            pal_convert_reference((char*)expected, src, stencil, PAL_BENCH_PIXELS, pal, NULL, 48);
+        }
+        results[n].name = "reference";
+        results[n++].mpix_s = pal_bench_mpix(start, SDL_GetPerformanceCounter());
+    }
+
+    pal_kernel list[4];
+    int count = pal_supported_kernels(list);
+    for(int k = 0; k < count && n < max_results; k++) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int r = 0; r < PAL_BENCH_ROUNDS; r++) {
+            // The table is built every round, just like on every tcache miss
+            pal_build_lut(lut, pal, NULL, 48);
+            list[k].func(dst, src, stencil, PAL_BENCH_PIXELS, lut);
+        }
+        results[n].name = list[k].name;
+        results[n++].mpix_s = pal_bench_mpix(start, SDL_GetPerformanceCounter());
+        if(memcmp(dst, expected, PAL_BENCH_PIXELS * 4) != 0) {
+            PERROR("Palette conversion kernel '%s' output does not match the reference!", list[k].name);
+        }
+    }
+
+    free(pal);
+    free(dst);
+    free(expected);
+    free(stencil);
+    free(src);
+    return n;
+}
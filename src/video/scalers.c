@@ -0,0 +1,451 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "video/scalers.h"
+#include "utils/workers.h"
+#include "utils/log.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define SCALERS_USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define SCALERS_USE_NEON
+#include <arm_neon.h>
+#endif
+
+#define SCALERS_MIN_FACTOR 2
+#define SCALERS_MAX_FACTOR 4
+
+// Smallest amount of source pixels worth handing to another thread
+#define SCALERS_MIN_BAND_PIXELS 4096
+
+// Image size for scalers_bench()
+#define SCALERS_BENCH_W 320
+#define SCALERS_BENCH_H 200
+#define SCALERS_BENCH_ROUNDS 20
+
+// Luma and chroma, roughly as in hqx, plus alpha
+typedef struct yuva_t {
+    int y, u, v, a;
+} yuva;
+
+typedef struct scaler_job_t scaler_job;
+typedef void (*scaler_rows_func)(const scaler_job *job, int y0, int y1);
+
+struct scaler_job_t {
+    scaler_rows_func func;
+    const uint32_t *in;
+    uint32_t *out;
+    yuva *yuv; // Color space version of in, for the edge detecting scalers
+    int w;
+    int h;
+    int factor;
+};
+
+// Reused between calls. Scalers are only run from the rendering thread.
+static yuva *yuv_buf = NULL;
+static int yuv_buf_size = 0;
+
+// Edge blend weights for each corner of a scaled pixel, 0-128.
+// Index: [factor][corner][sy][sx]. Corners are top-left, top-right, bottom-left, bottom-right.
+static uint8_t corner_weights[SCALERS_MAX_FACTOR + 1][4][SCALERS_MAX_FACTOR][SCALERS_MAX_FACTOR];
+static int weights_ready = 0;
+
+static void scalers_init_weights() {
+    for(int f = SCALERS_MIN_FACTOR; f <= SCALERS_MAX_FACTOR; f++) {
+        for(int c = 0; c < 4; c++) {
+            for(int sy = 0; sy < f; sy++) {
+                for(int sx = 0; sx < f; sx++) {
+                    // Distance from the corner, in output pixels
+                    int lx = (c & 1) ? f - 1 - sx : sx;
+                    int ly = (c & 2) ? f - 1 - sy : sy;
+                    int t = f - 1 - lx - ly;
+                    corner_weights[f][c][sy][sx] = (t > 0) ? t * 128 / f : 0;
+                }
+            }
+        }
+    }
+    weights_ready = 1;
+}
+
+// Mixes two RGBA pixels; w is the weight of b, 0-128
+static inline uint32_t px_mix(uint32_t a, uint32_t b, int w) {
+#ifdef SCALERS_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i va = _mm_unpacklo_epi8(_mm_cvtsi32_si128(a), zero);
+    __m128i vb = _mm_unpacklo_epi8(_mm_cvtsi32_si128(b), zero);
+    __m128i r = _mm_add_epi16(_mm_mullo_epi16(va, _mm_set1_epi16(128 - w)),
+                              _mm_mullo_epi16(vb, _mm_set1_epi16(w)));
+    r = _mm_srli_epi16(r, 7);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+#elif defined(SCALERS_USE_NEON)
+    uint16x8_t va = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(a)));
+    uint16x8_t vb = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(b)));
+    uint16x8_t r = vmlaq_n_u16(vmulq_n_u16(va, 128 - w), vb, w);
+    return vget_lane_u32(vreinterpret_u32_u8(vshrn_n_u16(r, 7)), 0);
+#else
+    const uint8_t *ca = (const uint8_t*)&a;
+    const uint8_t *cb = (const uint8_t*)&b;
+    uint32_t out;
+    uint8_t *co = (uint8_t*)&out;
+    for(int i = 0; i < 4; i++) {
+        co[i] = (ca[i] * (128 - w) + cb[i] * w) >> 7;
+    }
+    return out;
+#endif
+}
+
+static inline yuva px_yuva(uint32_t px) {
+    const uint8_t *c = (const uint8_t*)&px;
+    yuva p;
+    p.y = (306 * c[0] + 601 * c[1] + 117 * c[2]) >> 10;
+    p.u = (-173 * c[0] - 339 * c[1] + 512 * c[2]) >> 10;
+    p.v = (512 * c[0] - 429 * c[1] - 83 * c[2]) >> 10;
+    p.a = c[3];
+    return p;
+}
+
+static inline int yuva_dist(const yuva *a, const yuva *b) {
+    return 48 * abs(a->y - b->y) + 7 * abs(a->u - b->u) + 6 * abs(a->v - b->v) + 64 * abs(a->a - b->a);
+}
+
+static inline int yuva_similar(const yuva *a, const yuva *b) {
+    return abs(a->y - b->y) <= 48
+        && abs(a->u - b->u) <= 7
+        && abs(a->v - b->v) <= 6
+        && abs(a->a - b->a) <= 16;
+}
+
+// Finds the 5x5 neighbourhood around (x, y), clamped to the image
+static inline void find_5x5(int w, int h, int x, int y, int *at) {
+    int cols[5];
+    for(int d = -2; d <= 2; d++) {
+        int sx = x + d;
+        cols[d + 2] = (sx < 0) ? 0 : ((sx >= w) ? w - 1 : sx);
+    }
+    for(int dy = -2; dy <= 2; dy++) {
+        int sy = y + dy;
+        sy = (sy < 0) ? 0 : ((sy >= h) ? h - 1 : sy);
+        for(int dx = 0; dx < 5; dx++) {
+            at[(dy + 2) * 5 + dx] = sy * w + cols[dx];
+        }
+    }
+}
+
+static void yuv_rows(const scaler_job *job, int y0, int y1) {
+    for(int i = y0 * job->w; i < y1 * job->w; i++) {
+        job->yuv[i] = px_yuva(job->in[i]);
+    }
+}
+
+// Writes one scaled pixel, blending in the edge color of each corner that has one
+static inline void write_block(uint32_t *out, int ow, int factor, uint32_t center,
+                               const int *has_edge, const uint32_t *edge) {
+    for(int sy = 0; sy < factor; sy++) {
+        uint32_t *o = out + sy * ow;
+        for(int sx = 0; sx < factor; sx++) {
+            uint32_t px = center;
+            int best = 0;
+            for(int c = 0; c < 4; c++) {
+                int wgt = corner_weights[factor][c][sy][sx];
+                if(has_edge[c] && wgt > best) {
+                    best = wgt;
+                    px = px_mix(center, edge[c], wgt);
+                }
+            }
+            o[sx] = px;
+        }
+    }
+}
+
+// Neighbour index in the 5x5 block, mirrored towards the corner being handled.
+// mx and my are 1 or -1; with both at 1 the corner is bottom-right.
+#define N(dx, dy) at[((my) * (dy) + 2) * 5 + (mx) * (dx) + 2]
+
+static void nearest_rows(const scaler_job *job, int y0, int y1) {
+    const uint32_t *in = job->in;
+    uint32_t *out = job->out;
+    int w = job->w;
+    int factor = job->factor;
+    int ow = w * factor;
+    for(int y = y0; y < y1; y++) {
+        const uint32_t *src = in + y * w;
+        uint32_t *dst = out + y * factor * ow;
+        int x = 0;
+#ifdef SCALERS_USE_SSE2
+        if(factor == 2) {
+            for(; x + 4 <= w; x += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+                _mm_storeu_si128((__m128i*)(dst + x * 2), _mm_unpacklo_epi32(v, v));
+                _mm_storeu_si128((__m128i*)(dst + x * 2 + 4), _mm_unpackhi_epi32(v, v));
+            }
+        } else if(factor == 4) {
+            for(; x + 4 <= w; x += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+                _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_shuffle_epi32(v, 0x00));
+                _mm_storeu_si128((__m128i*)(dst + x * 4 + 4), _mm_shuffle_epi32(v, 0x55));
+                _mm_storeu_si128((__m128i*)(dst + x * 4 + 8), _mm_shuffle_epi32(v, 0xAA));
+                _mm_storeu_si128((__m128i*)(dst + x * 4 + 12), _mm_shuffle_epi32(v, 0xFF));
+            }
+        }
+#elif defined(SCALERS_USE_NEON)
+        if(factor == 2) {
+            for(; x + 4 <= w; x += 4) {
+                uint32x4x2_t z = vzipq_u32(vld1q_u32(src + x), vld1q_u32(src + x));
+                vst1q_u32(dst + x * 2, z.val[0]);
+                vst1q_u32(dst + x * 2 + 4, z.val[1]);
+            }
+        }
+#endif
+        for(; x < w; x++) {
+            for(int k = 0; k < factor; k++) {
+                dst[x * factor + k] = src[x];
+            }
+        }
+
+        // Rest of the rows are copies of the first one
+        for(int k = 1; k < factor; k++) {
+            memcpy(dst + k * ow, dst, ow * sizeof(uint32_t));
+        }
+    }
+}
+
+// hqx-style: a corner gets the average of its two side neighbours blended in,
+// if those are similar to each other and the edge doesn't continue past them.
+static void hqx_rows(const scaler_job *job, int y0, int y1) {
+    const uint32_t *in = job->in;
+    const yuva *yuv = job->yuv;
+    int w = job->w;
+    int factor = job->factor;
+    int ow = w * factor;
+    int at[25];
+    int has_edge[4];
+    uint32_t edge[4];
+    for(int y = y0; y < y1; y++) {
+        for(int x = 0; x < w; x++) {
+            find_5x5(w, job->h, x, y, at);
+            for(int c = 0; c < 4; c++) {
+                int mx = (c & 1) ? 1 : -1;
+                int my = (c & 2) ? 1 : -1;
+
+                // Side neighbours of the corner, and the ones opposite to them
+                int side_x = N(1, 0), side_y = N(0, 1);
+                int opp_x = N(-1, 0), opp_y = N(0, -1);
+                has_edge[c] = yuva_similar(&yuv[side_x], &yuv[side_y])
+                           && !yuva_similar(&yuv[at[12]], &yuv[side_x])
+                           && !yuva_similar(&yuv[side_x], &yuv[opp_y])
+                           && !yuva_similar(&yuv[side_y], &yuv[opp_x]);
+                edge[c] = px_mix(in[side_x], in[side_y], 64);
+            }
+            write_block(job->out + y * factor * ow + x * factor, ow, factor, in[at[12]], has_edge, edge);
+        }
+    }
+}
+
+// xBR-style (level 1): compares weighted color distances across and along the
+// corner diagonal, and blends the closer side neighbour in where an edge runs through it.
+static void xbr_rows(const scaler_job *job, int y0, int y1) {
+    const uint32_t *in = job->in;
+    const yuva *yuv = job->yuv;
+    int w = job->w;
+    int factor = job->factor;
+    int ow = w * factor;
+    int at[25];
+    int has_edge[4];
+    uint32_t edge[4];
+    for(int y = y0; y < y1; y++) {
+        for(int x = 0; x < w; x++) {
+            find_5x5(w, job->h, x, y, at);
+            for(int c = 0; c < 4; c++) {
+                int mx = (c & 1) ? 1 : -1;
+                int my = (c & 2) ? 1 : -1;
+                const yuva *e = &yuv[at[12]];
+                const yuva *f = &yuv[N(1, 0)];
+                const yuva *hh = &yuv[N(0, 1)];
+                const yuva *i = &yuv[N(1, 1)];
+                int d_edge = yuva_dist(e, &yuv[N(1, -1)]) + yuva_dist(e, &yuv[N(-1, 1)])
+                           + yuva_dist(i, &yuv[N(2, 1)]) + yuva_dist(i, &yuv[N(1, 2)])
+                           + 4 * yuva_dist(hh, f);
+                int d_cross = yuva_dist(hh, &yuv[N(-1, 1)]) + yuva_dist(hh, &yuv[N(1, 2)])
+                            + yuva_dist(f, &yuv[N(2, 1)]) + yuva_dist(f, &yuv[N(1, -1)])
+                            + 4 * yuva_dist(e, i);
+                has_edge[c] = d_edge < d_cross;
+                edge[c] = (yuva_dist(e, f) <= yuva_dist(e, hh)) ? in[N(1, 0)] : in[N(0, 1)];
+            }
+            write_block(job->out + y * factor * ow + x * factor, ow, factor, in[at[12]], has_edge, edge);
+        }
+    }
+}
+
+#undef N
+
+static void scaler_band(void *userdata, int start, int end) {
+    scaler_job *job = userdata;
+    job->func(job, start, end);
+}
+
+static int scaler_run(scaler_rows_func func, const char *in, char *out, int w, int h, int factor) {
+    if(factor < SCALERS_MIN_FACTOR || factor > SCALERS_MAX_FACTOR) {
+        return 1;
+    }
+    if(!weights_ready) {
+        scalers_init_weights();
+    }
+    scaler_job job;
+    job.func = func;
+    job.in = (const uint32_t*)in;
+    job.out = (uint32_t*)out;
+    job.w = w;
+    job.h = h;
+    job.factor = factor;
+    job.yuv = NULL;
+    int min_rows = (w > 0) ? SCALERS_MIN_BAND_PIXELS / w : 1;
+    if(min_rows < 1) {
+        min_rows = 1;
+    }
+
+    // Edge detection compares each pixel many times, so convert them all first
+    if(func != nearest_rows) {
+        if(yuv_buf_size < w * h) {
+            yuv_buf_size = w * h;
+            yuv_buf = realloc(yuv_buf, yuv_buf_size * sizeof(yuva));
+        }
+        job.yuv = yuv_buf;
+        job.func = yuv_rows;
+        workers_run(scaler_band, &job, h, min_rows);
+        job.func = func;
+    }
+    workers_run(scaler_band, &job, h, min_rows);
+    return 0;
+}
+
+static int nearest_scale(const char *in, char *out, int w, int h, int factor) {
+    return scaler_run(nearest_rows, in, out, w, h, factor);
+}
+
+static int hqx_scale(const char *in, char *out, int w, int h, int factor) {
+    return scaler_run(hqx_rows, in, out, w, h, factor);
+}
+
+static int xbr_scale(const char *in, char *out, int w, int h, int factor) {
+    return scaler_run(xbr_rows, in, out, w, h, factor);
+}
+
+static int builtin_factors[] = {2, 3, 4};
+
+static int builtin_is_factor_available(int factor) {
+    return factor >= SCALERS_MIN_FACTOR && factor <= SCALERS_MAX_FACTOR;
+}
+
+static int builtin_get_factors_list(int **factors) {
+    *factors = builtin_factors;
+    return sizeof(builtin_factors) / sizeof(int);
+}
+
+static int builtin_get_color_format() {
+    return 0;
+}
+
+static const char* builtin_author() { return "OpenOMF"; }
+static const char* builtin_license() { return "MIT"; }
+static const char* builtin_type() { return "scaler"; }
+static const char* nearest_name() { return "Nearest"; }
+static const char* hqx_name() { return "HQX"; }
+static const char* xbr_name() { return "XBR"; }
+
+static base_plugin builtin_plugins[] = {
+    {NULL, nearest_name, builtin_author, builtin_license, builtin_type},
+    {NULL, hqx_name, builtin_author, builtin_license, builtin_type},
+    {NULL, xbr_name, builtin_author, builtin_license, builtin_type},
+};
+
+static int (*builtin_funcs[])(const char*, char*, int, int, int) = {
+    nearest_scale,
+    hqx_scale,
+    xbr_scale,
+};
+
+#define BUILTIN_COUNT (int)(sizeof(builtin_plugins) / sizeof(base_plugin))
+
+int scalers_get(scaler_plugin *scaler, const char *name) {
+    for(int i = 0; i < BUILTIN_COUNT; i++) {
+        if(strcmp(builtin_plugins[i].get_name(), name) == 0) {
+            scaler->base = &builtin_plugins[i];
+            scaler->is_factor_available = builtin_is_factor_available;
+            scaler->get_factors_list = builtin_get_factors_list;
+            scaler->get_color_format = builtin_get_color_format;
+            scaler->scale = builtin_funcs[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int scalers_get_list(list *tlist) {
+    for(int i = 0; i < BUILTIN_COUNT; i++) {
+        void *ptr = &builtin_plugins[i];
+        list_append(tlist, &ptr, sizeof(base_plugin*));
+    }
+    return BUILTIN_COUNT;
+}
+
+int scalers_bench(scaler_bench_result *results, int max_results) {
+    int in_size = SCALERS_BENCH_W * SCALERS_BENCH_H;
+    uint32_t *in = malloc(in_size * sizeof(uint32_t));
+    uint32_t *out = malloc(in_size * SCALERS_MAX_FACTOR * SCALERS_MAX_FACTOR * sizeof(uint32_t));
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    int n = 0;
+
+    // Blocky test image with some flat areas, so that edges get detected
+    for(int y = 0; y < SCALERS_BENCH_H; y++) {
+        for(int x = 0; x < SCALERS_BENCH_W; x++) {
+            uint32_t v = ((x / 7) * 2654435761u) ^ ((y / 5) * 40503u);
+            in[y * SCALERS_BENCH_W + x] = v | 0xFF000000;
+        }
+    }
+
+    for(int i = 0; i < BUILTIN_COUNT; i++) {
+        for(int f = SCALERS_MIN_FACTOR; f <= SCALERS_MAX_FACTOR && n < max_results; f++) {
+            uint64_t start = SDL_GetPerformanceCounter();
+            for(int r = 0; r < SCALERS_BENCH_ROUNDS; r++) {
+                builtin_funcs[i]((const char*)in, (char*)out, SCALERS_BENCH_W, SCALERS_BENCH_H, f);
+            }
+            double secs = (double)(SDL_GetPerformanceCounter() - start) / freq;
+            results[n].name = builtin_plugins[i].get_name();
+            results[n].factor = f;
+            results[n].mpix_s = (secs > 0) ? (double)in_size * f * f * SCALERS_BENCH_ROUNDS / secs / 1000000.0 : 0;
+            n++;
+        }
+    }
+
+    free(out);
+    free(in);
+    return n;
+}
+
+int scaler_scale_to_texture(scaler_plugin *scaler, SDL_Texture *tex, const char *in, int w, int h, int factor, char *tmp) {
+    void *pixels;
+    int pitch;
+    if(SDL_LockTexture(tex, NULL, &pixels, &pitch) != 0) {
+        PERROR("Failed to lock texture for scaling: %s", SDL_GetError());
+        return 1;
+    }
+    int row_bytes = w * factor * 4;
+    const char *src = in;
+    if(factor > 1) {
+        if(pitch == row_bytes) {
+            scaler_scale(scaler, in, pixels, w, h, factor);
+            src = NULL;
+        } else {
+            scaler_scale(scaler, in, tmp, w, h, factor);
+            src = tmp;
+        }
+    }
+    if(src != NULL) {
+        for(int y = 0; y < h * factor; y++) {
+            memcpy((char*)pixels + y * pitch, src + y * row_bytes, row_bytes);
+        }
+    }
+    SDL_UnlockTexture(tex);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "video/screen_palette.h"
+
+static void screen_palette_record(screen_palette *pal, int first, int last) {
+    pal->version++;
+    pal->changed_first[pal->version % SCREEN_PALETTE_HISTORY] = first;
+    pal->changed_last[pal->version % SCREEN_PALETTE_HISTORY] = last;
+    memcpy(pal->committed, pal->data, sizeof(pal->data));
+}
+
+void screen_palette_init(screen_palette *pal) {
+    memset(pal, 0, sizeof(screen_palette));
+    screen_palette_record(pal, 0, 255);
+}
+
+int screen_palette_commit(screen_palette *pal) {
+    int first = 0;
+    int last = 255;
+    while(first < 256 && memcmp(pal->data[first], pal->committed[first], 3) == 0) {
+        first++;
+    }
+    if(first == 256) {
+        return 0;
+    }
+    while(memcmp(pal->data[last], pal->committed[last], 3) == 0) {
+        last--;
+    }
+    screen_palette_record(pal, first, last);
+    return 1;
+}
+
+void screen_palette_invalidate(screen_palette *pal) {
+    screen_palette_record(pal, 0, 255);
+}
+
+int screen_palette_get_changes(const screen_palette *pal, unsigned int version, uint32_t *changed) {
+    memset(changed, 0, PAL_SET_WORDS * sizeof(uint32_t));
+
+    // Too old to tell what has changed since
+    if(pal->version - version >= SCREEN_PALETTE_HISTORY) {
+        return 1;
+    }
+
+    // Union of all ranges changed after the given version
+    for(unsigned int v = version + 1; v != pal->version + 1; v++) {
+        int first = pal->changed_first[v % SCREEN_PALETTE_HISTORY];
+        int last = pal->changed_last[v % SCREEN_PALETTE_HISTORY];
+        for(int i = first; i <= last; i++) {
+            PAL_SET_ADD(changed, i);
+        }
+    }
+    return 0;
+}
+
+int screen_palette_uses_changed(const uint32_t *changed, const uint32_t *used, uint8_t pal_offset) {
+    if(pal_offset == 0) {
+        for(int w = 0; w < PAL_SET_WORDS; w++) {
+            if(used[w] & changed[w]) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // Indices 0-47 are read from idx + pal_offset
+    for(int i = 0; i < 256; i++) {
+        if(!(used[i >> 5] & (1u << (i & 31)))) {
+            continue;
+        }
+        uint8_t idx = (i < 48) ? (uint8_t)(i + pal_offset) : i;
+        if(changed[idx >> 5] & (1u << (idx & 31))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int screen_palette_changed_since(const screen_palette *pal,
+                                 unsigned int version,
+                                 const uint32_t *used,
+                                 uint8_t pal_offset) {
+
+    if(version == pal->version) {
+        return 0;
+    }
+    uint32_t changed[PAL_SET_WORDS];
+    if(screen_palette_get_changes(pal, version, changed) != 0 || used == NULL) {
+        return 1;
+    }
+    return screen_palette_uses_changed(changed, used, pal_offset);
+}
@@ -2,6 +2,15 @@
 #include <string.h>
 #include <utils/log.h>
 #include "video/surface.h"
+#include "video/tcache.h"
+#include "video/pal_convert.h"
+
+// Surfaces are created on loader and simulation threads too, so versions are handed out atomically
+static SDL_atomic_t next_version = {1};
+
+static unsigned int surface_next_version() {
+    return (unsigned int)SDL_AtomicAdd(&next_version, 1);
+}
 
 void surface_create(surface *sur, int type, int w, int h) {
     if(type == SURFACE_TYPE_RGBA) {
@@ -14,6 +23,33 @@ void surface_create(surface *sur, int type, int w, int h) {
     sur->w = w;
     sur->h = h;
     sur->type = type;
+    sur->atlas_page = NULL;
+    sur->atlas_x = 0;
+    sur->atlas_y = 0;
+    sur->regions = NULL;
+    sur->region_count = 0;
+    sur->rle = NULL;
+    sur->version = surface_next_version();
+    memset(sur->pal_used, 0xFF, sizeof(sur->pal_used));
+    sur->tcache_slot = -1;
+    sur->tcache_gen = 0;
+    sur->refs = 1;
+}
+
+// Cached texture, and any frame it was drawn in, is out of date once the surface contents change
+static void surface_drop_texture(surface *sur) {
+    sur->version = surface_next_version();
+    if(sur->tcache_slot >= 0) {
+        tcache_release(sur);
+    }
+}
+
+// Finds the palette indices used by the surface
+static void surface_find_pal_used(surface *sur) {
+    memset(sur->pal_used, 0, sizeof(sur->pal_used));
+    for(int i = 0; i < sur->w * sur->h; i++) {
+        PAL_SET_ADD(sur->pal_used, sur->data[i]);
+    }
 }
 
 void surface_create_from_data(surface *sur, int type, int w, int h, const char *src) {
@@ -22,6 +58,7 @@ void surface_create_from_data(surface *sur, int type, int w, int h, const char *
     memcpy(sur->data, src, size);
     if(type == SURFACE_TYPE_PALETTE) {
         memset(sur->stencil, 1, w * h);
+        surface_find_pal_used(sur);
     }
 }
 
@@ -29,11 +66,161 @@ void surface_create_from_image(surface *sur, image *img) {
     surface_create_from_data(sur, SURFACE_TYPE_RGBA, img->w, img->h, img->data);
 }
 
+// Packs a paletted surface into runs of opaque pixels, if that takes less memory
+void surface_rle_pack(surface *sur) {
+    if(sur->type != SURFACE_TYPE_PALETTE || sur->rle != NULL || sur->w > 0xFFFF) {
+        return;
+    }
+
+    // Count runs and pixels first, so that everything fits in one allocation
+    int spans = 0;
+    int pixels = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *st = sur->stencil + y * sur->w;
+        for(int x = 0; x < sur->w; x++) {
+            if(st[x] == 1) {
+                pixels++;
+                if(x == 0 || st[x - 1] != 1) {
+                    spans++;
+                }
+            }
+        }
+    }
+    int bytes = sizeof(surface_rle)
+              + (sur->h + 1) * sizeof(uint32_t)
+              + spans * sizeof(surface_span)
+              + pixels;
+    if(bytes >= sur->w * sur->h * 2) {
+        return;
+    }
+
+    char *mem = malloc(bytes);
+    surface_rle *rle = (surface_rle*)mem;
+    rle->rows = (uint32_t*)(mem + sizeof(surface_rle));
+    rle->spans = (surface_span*)(rle->rows + sur->h + 1);
+    rle->pixels = (uint8_t*)(rle->spans + spans);
+    rle->bytes = bytes;
+
+    int span = 0;
+    int pixel = 0;
+    for(int y = 0; y < sur->h; y++) {
+        const char *st = sur->stencil + y * sur->w;
+        const char *data = sur->data + y * sur->w;
+        rle->rows[y] = span;
+        int x = 0;
+        while(x < sur->w) {
+            if(st[x] != 1) {
+                x++;
+                continue;
+            }
+            surface_span *sp = &rle->spans[span++];
+            sp->x = x;
+            sp->pixels = pixel;
+            while(x < sur->w && st[x] == 1) {
+                rle->pixels[pixel++] = data[x++];
+            }
+            sp->len = x - sp->x;
+        }
+    }
+    rle->rows[sur->h] = span;
+
+    free(sur->data);
+    free(sur->stencil);
+    sur->data = NULL;
+    sur->stencil = NULL;
+    sur->rle = rle;
+}
+
+// Writes the surface pixels and stencil into w*h areas of the given buffers. Works for both forms.
+void surface_rle_decode(surface *sur, char *data, char *stencil, int pitch) {
+    for(int y = 0; y < sur->h; y++) {
+        char *d = data + y * pitch;
+        char *st = stencil + y * pitch;
+        if(sur->rle == NULL) {
+            memcpy(d, sur->data + y * sur->w, sur->w);
+            memcpy(st, sur->stencil + y * sur->w, sur->w);
+            continue;
+        }
+        memset(d, 0, sur->w);
+        memset(st, 0, sur->w);
+        const surface_rle *rle = sur->rle;
+        for(uint32_t i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+            const surface_span *sp = &rle->spans[i];
+            memcpy(d + sp->x, rle->pixels + sp->pixels, sp->len);
+            memset(st + sp->x, 1, sp->len);
+        }
+    }
+}
+
+// Turns a run-length encoded surface back into plain data and stencil
+void surface_rle_unpack(surface *sur) {
+    if(sur->rle == NULL) {
+        return;
+    }
+    char *data = malloc(sur->w * sur->h);
+    char *stencil = malloc(sur->w * sur->h);
+    surface_rle_decode(sur, data, stencil, sur->w);
+    free(sur->rle);
+    sur->rle = NULL;
+    sur->data = data;
+    sur->stencil = stencil;
+}
+
+int surface_get_stencil(surface *sur, int x, int y) {
+    if(sur->type != SURFACE_TYPE_PALETTE || x < 0 || y < 0 || x >= sur->w || y >= sur->h) {
+        return 0;
+    }
+    if(sur->rle == NULL) {
+        return sur->stencil[y * sur->w + x];
+    }
+    const surface_rle *rle = sur->rle;
+    for(uint32_t i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+        const surface_span *sp = &rle->spans[i];
+        if(x < sp->x) {
+            break;
+        }
+        if(x < sp->x + sp->len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Memory taken by pixel data
+int surface_get_bytes(surface *sur) {
+    if(sur->rle != NULL) {
+        return sur->rle->bytes;
+    }
+    return sur->w * sur->h * ((sur->type == SURFACE_TYPE_PALETTE) ? 2 : 4);
+}
+
 void surface_free(surface *sur) {
+    surface_drop_texture(sur);
     free(sur->data);
     free(sur->stencil);
+    free(sur->rle);
+    free(sur->regions);
     sur->stencil = NULL;
     sur->data = NULL;
+    sur->rle = NULL;
+    sur->regions = NULL;
+    sur->region_count = 0;
+    sur->atlas_page = NULL;
+}
+
+// Surfaces allocated with malloc can be shared instead of copied.
+// Each holder releases its reference, and the last one frees the surface.
+surface* surface_ref(surface *sur) {
+    sur->refs++;
+    return sur;
+}
+
+void surface_release(surface *sur) {
+    if(--sur->refs > 0) {
+        return;
+    }
+    surface_free(sur);
+    free(sur);
 }
 
 int surface_get_type(surface *sur) {
@@ -41,6 +228,8 @@ int surface_get_type(surface *sur) {
 }
 
 void surface_clear(surface *sur) {
+    surface_drop_texture(sur);
+    surface_rle_unpack(sur);
     if(sur->type == SURFACE_TYPE_RGBA) {
         memset(sur->data, 0, sur->w*sur->h*4);
     } else {
@@ -54,6 +243,7 @@ void surface_fill(surface *sur, color c) {
     if(sur->type == SURFACE_TYPE_PALETTE) {
         return;
     }
+    surface_drop_texture(sur);
 
     // Fill
     for(int i = 0; i < sur->w * sur->h; i++) {
@@ -68,16 +258,29 @@ void surface_copy_ex(surface *dst, surface *src) {
     if(src->type != dst->type) {
         return;
     }
-    int size = src->w * src->h * ((src->type == SURFACE_TYPE_PALETTE) ? 1 : 4);
-    memcpy(dst->data, src->data, size);
-    if(src->stencil != NULL)
-        memcpy(dst->stencil, src->stencil, src->w * src->h);
+    surface_drop_texture(dst);
+    surface_rle_unpack(dst);
+    if(src->rle != NULL) {
+        surface_rle_decode(src, dst->data, dst->stencil, dst->w);
+    } else {
+        int size = src->w * src->h * ((src->type == SURFACE_TYPE_PALETTE) ? 1 : 4);
+        memcpy(dst->data, src->data, size);
+        if(src->stencil != NULL)
+            memcpy(dst->stencil, src->stencil, src->w * src->h);
+    }
+    memcpy(dst->pal_used, src->pal_used, sizeof(dst->pal_used));
 }
 
 // Copies a surface to a new surface
 // Note! New surface will be created here; there is no need to pre-create it
+// The copy is never run-length encoded, since copies are often modified.
 void surface_copy(surface *dst, surface *src) {
     surface_create(dst, src->type, src->w, src->h);
+    if(src->rle != NULL) {
+        surface_rle_decode(src, dst->data, dst->stencil, dst->w);
+        memcpy(dst->pal_used, src->pal_used, sizeof(dst->pal_used));
+        return;
+    }
 
     int size = src->w * src->h * ((src->type == SURFACE_TYPE_PALETTE) ? 1 : 4);
     memcpy(dst->data, src->data, size);
@@ -87,6 +290,7 @@ void surface_copy(surface *dst, surface *src) {
     } else {
         dst->stencil = NULL;
     }
+    memcpy(dst->pal_used, src->pal_used, sizeof(dst->pal_used));
 }
 
 // Copies a an area of old surface to an entirely new surface
@@ -103,6 +307,12 @@ void surface_sub(surface *dst,
     }
 
     // Copy!
+    surface_drop_texture(dst);
+    surface_rle_unpack(dst);
+    surface_rle_unpack(src);
+    for(int i = 0; i < PAL_SET_WORDS; i++) {
+        dst->pal_used[i] |= src->pal_used[i];
+    }
     int bytes = (src->type == SURFACE_TYPE_RGBA) ? 4 : 1;
     int src_offset,dst_offset;
     for(int y = 0; y < h; y++) {
@@ -126,6 +336,97 @@ void surface_sub(surface *dst,
     }
 }
 
+// Part of a blit that lands inside the destination. The source is read
+// from src_x, src_y onwards, backwards along any flipped axis.
+typedef struct blit_clip_t {
+    int dst_x;
+    int dst_y;
+    int w;
+    int h;
+    int src_x;
+    int src_y;
+    int step_y;
+    int dir_y;
+} blit_clip;
+
+static int surface_clip_blit(blit_clip *c,
+                             surface *dst,
+                             surface *src,
+                             int dst_x, int dst_y,
+                             SDL_RendererFlip flip) {
+    int x0 = (dst_x < 0) ? 0 : dst_x;
+    int y0 = (dst_y < 0) ? 0 : dst_y;
+    int x1 = (dst_x + src->w > dst->w) ? dst->w : dst_x + src->w;
+    int y1 = (dst_y + src->h > dst->h) ? dst->h : dst_y + src->h;
+    if(x0 >= x1 || y0 >= y1) {
+        return 0;
+    }
+    c->dst_x = x0;
+    c->dst_y = y0;
+    c->w = x1 - x0;
+    c->h = y1 - y0;
+    c->src_x = (flip & SDL_FLIP_HORIZONTAL) ? src->w - 1 - (x0 - dst_x) : x0 - dst_x;
+    c->src_y = (flip & SDL_FLIP_VERTICAL) ? src->h - 1 - (y0 - dst_y) : y0 - dst_y;
+    c->dir_y = (flip & SDL_FLIP_VERTICAL) ? -1 : 1;
+    c->step_y = c->dir_y * src->w;
+    return 1;
+}
+
+// Clips one run of an encoded source to c. Gives the offset of the first visible pixel
+// in the run, its destination column and the visible length. With hflip, the
+// destination columns run backwards from dst_col.
+static int rle_clip_span(const blit_clip *c, const surface_span *sp, int hflip,
+                         int *skip, int *dst_col, int *len) {
+    int lo = hflip ? c->src_x - c->w + 1 : c->src_x;
+    int hi = hflip ? c->src_x + 1 : c->src_x + c->w;
+    int a = (sp->x > lo) ? sp->x : lo;
+    int b = (sp->x + sp->len < hi) ? sp->x + sp->len : hi;
+    if(a >= b) {
+        return 0;
+    }
+    *skip = a - sp->x;
+    *dst_col = hflip ? c->dst_x + c->src_x - a : c->dst_x + a - c->src_x;
+    *len = b - a;
+    return 1;
+}
+
+// Row loops for the paletted blits. Flipped variants read the source backwards from s.
+static void alpha_row(uint8_t *d, uint8_t *ds, const uint8_t *s, const uint8_t *ss, int w) {
+    for(int i = 0; i < w; i++) {
+        uint8_t m = -(ss[i] != 0);
+        d[i] = (s[i] & m) | (d[i] & ~m);
+        ds[i] |= m & 1;
+    }
+}
+
+static void alpha_row_flip(uint8_t *d, uint8_t *ds, const uint8_t *s, const uint8_t *ss, int w) {
+    for(int i = 0; i < w; i++) {
+        uint8_t m = -(ss[-i] != 0);
+        d[i] = (s[-i] & m) | (d[i] & ~m);
+        ds[i] |= m & 1;
+    }
+}
+
+// Remap tables exist for source indices 0-15 only
+#define ADD_REMAP(remap, s, d) \
+    (((s) != 0 && (s) + 3 < 19) ? (remap)->remaps[(s) + 3][(d)] : (d))
+
+static void additive_row(uint8_t *d, const uint8_t *ds, const uint8_t *s, const palette *remap, int w) {
+    for(int i = 0; i < w; i++) {
+        if(ds[i]) {
+            d[i] = ADD_REMAP(remap, s[i], d[i]);
+        }
+    }
+}
+
+static void additive_row_flip(uint8_t *d, const uint8_t *ds, const uint8_t *s, const palette *remap, int w) {
+    for(int i = 0; i < w; i++) {
+        if(ds[i]) {
+            d[i] = ADD_REMAP(remap, s[-i], d[i]);
+        }
+    }
+}
+
 void surface_additive_blit(surface *dst,
                            surface *src,
                            int dst_x, int dst_y,
@@ -137,31 +438,53 @@ void surface_additive_blit(surface *dst,
         return;
     }
 
-    int src_offset,dst_offset;
-    uint8_t src_index, dst_index;
-    for(int y = 0; y < src->h; y++) {
-        for(int x = 0; x < src->w; x++) {
-            // If pixel offscreen, skip
-            if(dst_x + x >= dst->w
-                || dst_y + y >= dst->h
-                || dst_x + x < 0
-                || dst_y + y < 0) continue;
-
-            // Calculate pixel offsets
-            src_offset = ((flip & SDL_FLIP_HORIZONTAL) ? src->w - x : x) +
-                         ((flip & SDL_FLIP_VERTICAL) ? src->h - y : y) * src->w;
-            dst_offset = dst_x + x + (dst_y + y) * dst->w;
-
-            // Do blit, if pixel is visible on stencil
-            if(dst->stencil[dst_offset] == 1) {
-                if(src->data[src_offset] == 0)
-                    continue;
+    // Remapped colors can be anything
+    surface_drop_texture(dst);
+    memset(dst->pal_used, 0xFF, sizeof(dst->pal_used));
 
-                src_index = src->data[src_offset]+3;
-                dst_index = dst->data[dst_offset];
-                dst->data[dst_offset] = remap_pal->remaps[src_index][dst_index];
+    blit_clip c;
+    surface_rle_unpack(dst);
+    if(!surface_clip_blit(&c, dst, src, dst_x, dst_y, flip)) {
+        return;
+    }
+    int hflip = flip & SDL_FLIP_HORIZONTAL;
+
+    // Transparent pixels decode as index 0, which is never added, so only the runs are visited
+    if(src->rle != NULL) {
+        for(int y = 0; y < c.h; y++) {
+            int row = (c.dst_y + y) * dst->w;
+            uint8_t *d = (uint8_t*)dst->data + row;
+            uint8_t *ds = (uint8_t*)dst->stencil + row;
+            const surface_rle *rle = src->rle;
+            int row_y = c.src_y + y * c.dir_y;
+            int skip, col, len;
+            for(uint32_t i = rle->rows[row_y]; i < rle->rows[row_y + 1]; i++) {
+                if(!rle_clip_span(&c, &rle->spans[i], hflip, &skip, &col, &len)) {
+                    continue;
+                }
+                const uint8_t *pix = rle->pixels + rle->spans[i].pixels + skip;
+                if(hflip) {
+                    additive_row_flip(d + col - len + 1, ds + col - len + 1, pix + len - 1, remap_pal, len);
+                } else {
+                    additive_row(d + col, ds + col, pix, remap_pal, len);
+                }
             }
         }
+        return;
+    }
+
+    const uint8_t *s = (uint8_t*)src->data + c.src_y * src->w + c.src_x;
+    uint8_t *d = (uint8_t*)dst->data + c.dst_y * dst->w + c.dst_x;
+    uint8_t *ds = (uint8_t*)dst->stencil + c.dst_y * dst->w + c.dst_x;
+    for(int y = 0; y < c.h; y++) {
+        if(hflip) {
+            additive_row_flip(d, ds, s, remap_pal, c.w);
+        } else {
+            additive_row(d, ds, s, remap_pal, c.w);
+        }
+        s += c.step_y;
+        d += dst->w;
+        ds += dst->w;
     }
 }
 
@@ -175,24 +498,144 @@ void surface_alpha_blit(surface *dst,
         return;
     }
 
-    int src_offset,dst_offset;
+    blit_clip c;
+    surface_rle_unpack(dst);
+    if(!surface_clip_blit(&c, dst, src, dst_x, dst_y, flip)) {
+        return;
+    }
+    int hflip = flip & SDL_FLIP_HORIZONTAL;
+
+    // Encoded sources are copied a run at a time
+    if(src->rle != NULL) {
+        for(int y = 0; y < c.h; y++) {
+            int row = (c.dst_y + y) * dst->w;
+            uint8_t *d = (uint8_t*)dst->data + row;
+            uint8_t *ds = (uint8_t*)dst->stencil + row;
+            const surface_rle *rle = src->rle;
+            int row_y = c.src_y + y * c.dir_y;
+            int skip, col, len;
+            for(uint32_t i = rle->rows[row_y]; i < rle->rows[row_y + 1]; i++) {
+                if(!rle_clip_span(&c, &rle->spans[i], hflip, &skip, &col, &len)) {
+                    continue;
+                }
+                const uint8_t *pix = rle->pixels + rle->spans[i].pixels + skip;
+                if(hflip) {
+                    for(int k = 0; k < len; k++) {
+                        d[col - k] = pix[k];
+                    }
+                    memset(ds + col - len + 1, 1, len);
+                } else {
+                    memcpy(d + col, pix, len);
+                    memset(ds + col, 1, len);
+                }
+            }
+        }
+        return;
+    }
+
+    int offset = c.src_y * src->w + c.src_x;
+    const uint8_t *s = (uint8_t*)src->data + offset;
+    const uint8_t *ss = (uint8_t*)src->stencil + offset;
+    uint8_t *d = (uint8_t*)dst->data + c.dst_y * dst->w + c.dst_x;
+    uint8_t *ds = (uint8_t*)dst->stencil + c.dst_y * dst->w + c.dst_x;
+    for(int y = 0; y < c.h; y++) {
+        if(hflip) {
+            alpha_row_flip(d, ds, s, ss, c.w);
+        } else {
+            alpha_row(d, ds, s, ss, c.w);
+        }
+        s += c.step_y;
+        ss += c.step_y;
+        d += dst->w;
+        ds += dst->w;
+    }
+}
+
+// x * y / 255, rounded
+static inline int mul255(int x, int y) {
+    int t = x * y + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Blends one row of RGBA pixels over another, the same way as SDL_BLENDMODE_BLEND
+// does for opaque destinations.
+// Source is read backwards when step is -4.
+static void blend_row(uint8_t *d, const uint8_t *s, int step, int w, uint8_t opacity, color mod) {
+    int plain = (opacity == 0xFF && mod.r == 0xFF && mod.g == 0xFF && mod.b == 0xFF);
+    for(int i = 0; i < w; i++, d += 4, s += step) {
+        int a = plain ? s[3] : mul255(s[3], opacity);
+        if(a == 0) {
+            continue;
+        }
+        int r = plain ? s[0] : mul255(s[0], mod.r);
+        int g = plain ? s[1] : mul255(s[1], mod.g);
+        int b = plain ? s[2] : mul255(s[2], mod.b);
+        if(a == 0xFF) {
+            d[0] = r;
+            d[1] = g;
+            d[2] = b;
+            d[3] = 0xFF;
+        } else if(d[3] == 0xFF) {
+            int ia = 0xFF - a;
+            d[0] = mul255(r, a) + mul255(d[0], ia);
+            d[1] = mul255(g, a) + mul255(d[1], ia);
+            d[2] = mul255(b, a) + mul255(d[2], ia);
+        } else {
+            // Destination is see-through too, so that it can later be drawn over
+            // something else with the same result. Colors are weighted by alpha.
+            int da = mul255(d[3], 0xFF - a);
+            int oa = a + da;
+            d[0] = (r * a + d[0] * da) / oa;
+            d[1] = (g * a + d[1] * da) / oa;
+            d[2] = (b * a + d[2] * da) / oa;
+            d[3] = oa;
+        }
+    }
+}
+
+void surface_blend_blit(surface *dst,
+                        surface *src,
+                        int dst_x, int dst_y,
+                        SDL_RendererFlip flip,
+                        uint8_t opacity,
+                        color color_mod) {
+
+    // Both surfaces must be RGBA
+    if(dst->type != SURFACE_TYPE_RGBA || src->type != SURFACE_TYPE_RGBA) {
+        return;
+    }
+
+    blit_clip c;
+    if(!surface_clip_blit(&c, dst, src, dst_x, dst_y, flip)) {
+        return;
+    }
+    surface_drop_texture(dst);
+    const uint8_t *s = (uint8_t*)src->data + (c.src_y * src->w + c.src_x) * 4;
+    uint8_t *d = (uint8_t*)dst->data + (c.dst_y * dst->w + c.dst_x) * 4;
+    int step = (flip & SDL_FLIP_HORIZONTAL) ? -4 : 4;
+    for(int y = 0; y < c.h; y++) {
+        blend_row(d, s, step, c.w, opacity, color_mod);
+        s += c.step_y * 4;
+        d += dst->w * 4;
+    }
+}
+
+// Blends an RGBA surface over an RGBA buffer that is factor times its size.
+// Pixels are simply repeated, so that the source is not smoothed by any scaler.
+void surface_blend_scaled(char *dst, int dst_pitch, surface *src, int factor) {
+    if(src->type != SURFACE_TYPE_RGBA) {
+        return;
+    }
+    color white = color_create(0xFF, 0xFF, 0xFF, 0xFF);
     for(int y = 0; y < src->h; y++) {
-        for(int x = 0; x < src->w; x++) {
-            // If pixel offscreen, skip
-            if(dst_x + x >= dst->w
-                || dst_y + y >= dst->h
-                || dst_x + x < 0
-                || dst_y + y < 0) continue;
-
-            // Calculate offsets
-            src_offset = ((flip & SDL_FLIP_HORIZONTAL) ? src->w - 1 - x : x) +
-                         ((flip & SDL_FLIP_VERTICAL) ? src->h - 1 - y : y) * src->w;
-            dst_offset = dst_x + x + (dst_y + y) * dst->w;
-
-            // If pixel is visible on stencil, do blit
-            if(src->stencil[src_offset] == 1) {
-                dst->data[dst_offset] = src->data[src_offset];
-                dst->stencil[dst_offset] = 1;
+        const uint8_t *s = (uint8_t*)src->data + y * src->w * 4;
+        for(int x = 0; x < src->w; x++, s += 4) {
+            if(s[3] == 0) {
+                continue;
+            }
+            for(int k = 0; k < factor; k++) {
+                uint8_t *d = (uint8_t*)dst + (y * factor + k) * dst_pitch + x * factor * 4;
+                blend_row(d, s, 0, factor, 0xFF, white);
             }
         }
     }
@@ -207,13 +650,17 @@ void surface_convert_to_rgba(surface *sur, screen_palette *pal, int pal_offset)
 
     char *pixels = malloc(sur->w * sur->h * 4);
     surface_to_rgba(sur, pixels, pal, NULL, pal_offset);
+    surface_drop_texture(sur);
 
     // Free old data
     free(sur->data);
     free(sur->stencil);
+    free(sur->rle);
+    sur->rle = NULL;
     sur->data = pixels;
     sur->stencil = NULL;
     sur->type = SURFACE_TYPE_RGBA;
+    sur->atlas_page = NULL;
 }
 
 // Creates a new RGBA surface
@@ -225,28 +672,77 @@ void surface_to_rgba(surface *sur,
 
     if(sur->type == SURFACE_TYPE_RGBA) {
         memcpy(dst, sur->data, sur->w * sur->h * 4);
-    } else {
-        int n = 0;
-        uint8_t idx = 0;
-        for(int i = 0; i < sur->w * sur->h; i++) {
-            n = i * 4;
-            if(remap_table != NULL) {
-                idx = (uint8_t)remap_table[(uint8_t)sur->data[i]];
-            } else {
-                idx = (uint8_t)sur->data[i];
+    } else if(sur->rle != NULL) {
+        // Transparent pixels are cleared, and only the runs are looked up
+        uint32_t lut[256];
+        pal_build_lut(lut, pal, remap_table, pal_offset);
+        uint32_t *out = (uint32_t*)dst;
+        memset(out, 0, sur->w * sur->h * 4);
+        const surface_rle *rle = sur->rle;
+        for(int y = 0; y < sur->h; y++) {
+            for(uint32_t i = rle->rows[y]; i < rle->rows[y + 1]; i++) {
+                const surface_span *sp = &rle->spans[i];
+                uint32_t *d = out + y * sur->w + sp->x;
+                const uint8_t *p = rle->pixels + sp->pixels;
+                for(int k = 0; k < sp->len; k++) {
+                    d[k] = lut[p[k]];
+                }
             }
-            // TODO: This is kind of a hack. Since the pal_offset
-            // is only ever used for player 2 har, we can safely
-            // make some assumptions. therefore, only apply offset,
-            // if the color we are handling is between 0 and 48 (har colors).
-            if(idx < 48) {
-                idx += pal_offset;
+        }
+    } else {
+        uint32_t lut[256];
+        pal_build_lut(lut, pal, remap_table, pal_offset);
+        pal_convert((uint32_t*)dst,
+                    (const uint8_t*)sur->data,
+                    (const uint8_t*)sur->stencil,
+                    sur->w * sur->h,
+                    lut);
+    }
+}
+
+// Converts an area of the surface to RGBA. Rows of dst are rect->w pixels long.
+void surface_to_rgba_rect(surface *sur,
+                          char *dst,
+                          const SDL_Rect *rect,
+                          screen_palette *pal,
+                          char *remap_table,
+                          uint8_t pal_offset) {
+
+    if(sur->type == SURFACE_TYPE_RGBA) {
+        for(int y = 0; y < rect->h; y++) {
+            memcpy(dst + y * rect->w * 4, sur->data + ((rect->y + y) * sur->w + rect->x) * 4, rect->w * 4);
+        }
+        return;
+    }
+
+    uint32_t lut[256];
+    pal_build_lut(lut, pal, remap_table, pal_offset);
+    uint32_t *out = (uint32_t*)dst;
+    if(sur->rle != NULL) {
+        // Runs are clipped to the area
+        memset(out, 0, rect->w * rect->h * 4);
+        const surface_rle *rle = sur->rle;
+        for(int y = 0; y < rect->h; y++) {
+            int sy = rect->y + y;
+            for(uint32_t i = rle->rows[sy]; i < rle->rows[sy + 1]; i++) {
+                const surface_span *sp = &rle->spans[i];
+                int x0 = (sp->x > rect->x) ? sp->x : rect->x;
+                int x1 = (sp->x + sp->len < rect->x + rect->w) ? sp->x + sp->len : rect->x + rect->w;
+                const uint8_t *p = rle->pixels + sp->pixels;
+                for(int x = x0; x < x1; x++) {
+                    out[y * rect->w + x - rect->x] = lut[p[x - sp->x]];
+                }
             }
-            *(dst + n + 0) = pal->data[idx][0];
-            *(dst + n + 1) = pal->data[idx][1];
-            *(dst + n + 2) = pal->data[idx][2];
-            *(dst + n + 3) = (sur->stencil[i] == 1) ? 0xFF : 0;
         }
+        return;
+    }
+    for(int y = 0; y < rect->h; y++) {
+        int offset = (rect->y + y) * sur->w + rect->x;
+        pal_convert(out + y * rect->w,
+                    (const uint8_t*)sur->data + offset,
+                    (const uint8_t*)sur->stencil + offset,
+                    rect->w,
+                    lut);
     }
 }
 
@@ -1,59 +1,479 @@
 #include <stdlib.h>
+#include <string.h>
 #include "video/tcache.h"
-#include "utils/hashmap.h"
 #include "utils/log.h"
+#include "utils/tracer.h"
+#include "video/scalers.h"
 
-#define CACHE_LIFETIME 25
+#ifdef STANDALONE_SERVER
+void tcache_init(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler) {}
+void tcache_reinit(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler) {}
+void tcache_clear() {}
+void tcache_close() {}
+SDL_Texture* tcache_get(surface *sur,
+                        screen_palette *pal,
+                        char *remap_table,
+                        uint8_t pal_offset,
+                        int priority) {
+    return NULL;
+}
+void tcache_release(surface *sur) {}
+void tcache_set_budget(size_t bytes) {}
+void tcache_set_upload_budget(size_t bytes) {}
+int tcache_frame_end() {
+    return 0;
+}
+void tcache_get_stats(tcache_stats *stats) {
+    memset(stats, 0, sizeof(tcache_stats));
+}
+
+#else
+#define TCACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define TCACHE_NONE -1
 
-typedef struct tcache_entry_key_t {
-    surface *c_surface;
-    char *c_remap_table;
-    uint16_t w,h;
-    uint8_t c_pal_offset;
-} tcache_entry_key;
+// Scaled pixels depend on source pixels at most this far away (xBR reads a 5x5 area)
+#define TCACHE_SCALER_MARGIN 2
 
-typedef struct tcache_entry_value_t {
+// Each cached texture lives in a slot. Surfaces remember their slot index and
+// the generation of the slot when it was given to them; freeing a slot bumps
+// its generation, so old handles never match a reused slot.
+// A surface drawn with several palette offsets or remap tables (eg. the same
+// atlas page for both players' HARs) has a slot for each, chained together.
+typedef struct tcache_slot_t {
     SDL_Texture *tex;
-    unsigned int age;
+    surface *sur;
+    char *remap_table;
+    uint8_t pal_offset;
     unsigned int pal_version;
-} tcache_entry_value;
+    unsigned int gen;
+    unsigned int last_frame;
+    size_t bytes;
+    int prev; // LRU list, most recently used first
+    int next; // LRU list, or the free list for unused slots
+    int sibling; // Next slot of the same surface
+
+    // A slot is created before its first upload, if that upload gets deferred
+    uint8_t uploaded;
+
+    // Waiting in the upload queue
+    uint8_t queued;
+    uint8_t priority;
+} tcache_slot;
+
+typedef struct tcache_queued_t {
+    int idx;
+    unsigned int gen;
+} tcache_queued;
 
 typedef struct tcache_t {
-    hashmap entries;
-    unsigned int hits;
-    unsigned int misses;
+    tcache_slot *slots;
+    int slot_count;
+    int free_head;
+    int lru_head;
+    int lru_tail;
+    size_t resident_bytes;
+    size_t budget_bytes;
+    unsigned int frame;
+    unsigned int frame_hits; // Current frame; moved to stats at frame end
+    unsigned int frame_misses;
+    unsigned int frame_evictions;
+    unsigned int frame_deferred;
+    size_t frame_upload_bytes;
+    int frame_overrun;
+    size_t upload_budget_bytes;
+    tcache_stats stats;
+
+    // Deferred uploads, in the order they were requested
+    tcache_queued *queue;
+    int queue_count;
+    int queue_size;
+    screen_palette *pal; // Palette the queued uploads are done with
     uint8_t scale_factor;
     scaler_plugin *scaler;
     SDL_Renderer *renderer;
+
+    // Work buffers for scaling, kept between misses
+    char *raw;
+    size_t raw_size;
+    char *scaled;
+    size_t scaled_size;
 } tcache;
 
 static tcache *cache = NULL;
 
-// Helper method for getting cache entry
-tcache_entry_value* tcache_add_entry(tcache_entry_key *key, tcache_entry_value *val) {
-    return hashmap_put(&cache->entries,
-                      (void*)key, sizeof(tcache_entry_key),
-                      (void*)val, sizeof(tcache_entry_value));
+static void tcache_lru_unlink(int idx) {
+    tcache_slot *slot = &cache->slots[idx];
+    if(slot->prev != TCACHE_NONE) {
+        cache->slots[slot->prev].next = slot->next;
+    } else {
+        cache->lru_head = slot->next;
+    }
+    if(slot->next != TCACHE_NONE) {
+        cache->slots[slot->next].prev = slot->prev;
+    } else {
+        cache->lru_tail = slot->prev;
+    }
+}
+
+static void tcache_lru_push(int idx) {
+    tcache_slot *slot = &cache->slots[idx];
+    slot->prev = TCACHE_NONE;
+    slot->next = cache->lru_head;
+    if(cache->lru_head != TCACHE_NONE) {
+        cache->slots[cache->lru_head].prev = idx;
+    } else {
+        cache->lru_tail = idx;
+    }
+    cache->lru_head = idx;
+}
+
+// Removes a slot from the chain of its surface
+static void tcache_chain_unlink(int idx) {
+    tcache_slot *slot = &cache->slots[idx];
+    surface *sur = slot->sur;
+    if(sur->tcache_slot == idx) {
+        sur->tcache_slot = slot->sibling;
+        sur->tcache_gen = (slot->sibling != TCACHE_NONE) ? cache->slots[slot->sibling].gen : 0;
+        return;
+    }
+    for(int i = sur->tcache_slot; i != TCACHE_NONE; i = cache->slots[i].sibling) {
+        if(cache->slots[i].sibling == idx) {
+            cache->slots[i].sibling = slot->sibling;
+            return;
+        }
+    }
+}
+
+static void tcache_free_slot(int idx) {
+    tcache_slot *slot = &cache->slots[idx];
+    tcache_lru_unlink(idx);
+    SDL_DestroyTexture(slot->tex);
+    cache->resident_bytes -= slot->bytes;
+    cache->stats.entries--;
+    slot->tex = NULL;
+    slot->sur = NULL;
+    slot->queued = 0;
+    slot->gen++;
+    slot->next = cache->free_head;
+    cache->free_head = idx;
+}
+
+static int tcache_alloc_slot() {
+    if(cache->free_head == TCACHE_NONE) {
+        // Out of slots, double the amount
+        int old_count = cache->slot_count;
+        int new_count = (old_count > 0) ? old_count * 2 : 64;
+        cache->slots = realloc(cache->slots, new_count * sizeof(tcache_slot));
+        for(int i = new_count - 1; i >= old_count; i--) {
+            cache->slots[i].tex = NULL;
+            cache->slots[i].sur = NULL;
+            cache->slots[i].gen = 1;
+            cache->slots[i].next = cache->free_head;
+            cache->free_head = i;
+        }
+        cache->slot_count = new_count;
+    }
+    int idx = cache->free_head;
+    cache->free_head = cache->slots[idx].next;
+    return idx;
+}
+
+// Evicts least recently used textures until the new one fits, or only textures from this frame remain
+static void tcache_make_room(size_t bytes) {
+    while(cache->lru_tail != TCACHE_NONE && cache->resident_bytes + bytes > cache->budget_bytes) {
+        if(cache->slots[cache->lru_tail].last_frame == cache->frame) {
+            break;
+        }
+        tcache_chain_unlink(cache->lru_tail);
+        tcache_free_slot(cache->lru_tail);
+        cache->stats.evictions++;
+        cache->frame_evictions++;
+    }
 }
 
-// Helper method for setting cache entry
-tcache_entry_value* tcache_get_entry(tcache_entry_key *key) {
-    tcache_entry_value *val = NULL;
-    unsigned int tmp_size;
-    hashmap_get(&cache->entries,
-                (void*)key, sizeof(tcache_entry_key),
-                (void**)&val, &tmp_size);
-    return val;
+// Returns the first slot of the surface, or TCACHE_NONE if it has none
+static int tcache_first_slot(surface *sur) {
+    if(sur->tcache_slot < 0 || sur->tcache_slot >= cache->slot_count) {
+        return TCACHE_NONE;
+    }
+    tcache_slot *slot = &cache->slots[sur->tcache_slot];
+
+    // The owner check catches surfaces that have been copied by value
+    if(slot->gen != sur->tcache_gen || slot->sur != sur) {
+        return TCACHE_NONE;
+    }
+    return sur->tcache_slot;
+}
+
+// Returns the slot of the surface for this offset and remap table, or TCACHE_NONE if it has none
+static int tcache_find_slot(surface *sur, char *remap_table, uint8_t pal_offset) {
+    for(int i = tcache_first_slot(sur); i != TCACHE_NONE; i = cache->slots[i].sibling) {
+        if(cache->slots[i].pal_offset == pal_offset && cache->slots[i].remap_table == remap_table) {
+            return i;
+        }
+    }
+    return TCACHE_NONE;
+}
+
+static char* tcache_buffer(char **buf, size_t *buf_size, size_t size) {
+    if(*buf_size < size) {
+        *buf = realloc(*buf, size);
+        *buf_size = size;
+    }
+    return *buf;
+}
+
+// Converts the surface to RGBA, and scales it straight into the texture if the pitch allows
+static void tcache_upload_scaled(surface *sur,
+                                 SDL_Texture *tex,
+                                 screen_palette *pal,
+                                 char *remap_table,
+                                 uint8_t pal_offset) {
+    int factor = cache->scale_factor;
+    char *raw = tcache_buffer(&cache->raw, &cache->raw_size, sur->w * sur->h * 4);
+    surface_to_rgba(sur, raw, pal, remap_table, pal_offset);
+
+    char *scaled = NULL;
+    if(factor > 1) {
+        scaled = tcache_buffer(&cache->scaled, &cache->scaled_size, (size_t)sur->w * factor * 4 * sur->h * factor);
+    }
+    uint64_t scale_start = tracer_begin();
+    scaler_scale_to_texture(cache->scaler, tex, raw, sur->w, sur->h, factor, scaled);
+    tracer_end("video", "scaler", scale_start);
+}
+
+// Grows the rect by the margin, but not past the edges of the surface
+static void tcache_grow_rect(SDL_Rect *dst, const SDL_Rect *src, const surface *sur, int margin) {
+    int x1 = (src->x + src->w + margin < sur->w) ? src->x + src->w + margin : sur->w;
+    int y1 = (src->y + src->h + margin < sur->h) ? src->y + src->h + margin : sur->h;
+    dst->x = (src->x > margin) ? src->x - margin : 0;
+    dst->y = (src->y > margin) ? src->y - margin : 0;
+    dst->w = x1 - dst->x;
+    dst->h = y1 - dst->y;
+}
+
+// Area of the texture that is redrawn for a region. When scaling, the pixels next to the
+// region are redrawn too, since the scaler blends the region's edges into them.
+static void tcache_region_rect(SDL_Rect *rect, const surface_region *r, const surface *sur) {
+    SDL_Rect area = {r->x, r->y, r->w, r->h};
+    tcache_grow_rect(rect, &area, sur, (cache->scale_factor > 1) ? TCACHE_SCALER_MARGIN : 0);
+}
+
+// Redraws one region of the texture of a slot
+static void tcache_upload_region(tcache_slot *slot, screen_palette *pal, const surface_region *r) {
+    int factor = cache->scale_factor;
+    SDL_Rect rect;
+    tcache_region_rect(&rect, r, slot->sur);
+
+    // The scaler needs to see as many source pixels around the redrawn area, for the edges to come out the same
+    SDL_Rect src = rect;
+    if(factor > 1) {
+        tcache_grow_rect(&src, &rect, slot->sur, TCACHE_SCALER_MARGIN);
+    }
+    char *raw = tcache_buffer(&cache->raw, &cache->raw_size, src.w * src.h * 4);
+    surface_to_rgba_rect(slot->sur, raw, &src, pal, slot->remap_table, slot->pal_offset);
+
+    const char *pixels = raw;
+    int pitch = src.w * 4;
+    if(factor > 1) {
+        pitch *= factor;
+        char *scaled = tcache_buffer(&cache->scaled, &cache->scaled_size, (size_t)pitch * src.h * factor);
+        uint64_t scale_start = tracer_begin();
+        scaler_scale(cache->scaler, raw, scaled, src.w, src.h, factor);
+        tracer_end("video", "scaler", scale_start);
+        pixels = scaled + (rect.y - src.y) * factor * pitch + (rect.x - src.x) * factor * 4;
+        rect.x *= factor;
+        rect.y *= factor;
+        rect.w *= factor;
+        rect.h *= factor;
+    }
+    if(SDL_UpdateTexture(slot->tex, &rect, pixels, pitch) != 0) {
+        PERROR("Failed to update texture region: %s", SDL_GetError());
+    }
+}
+
+// Finds the regions of an atlas page that use palette entries changed since the last upload
+// of the slot. Returns 0 if the whole texture should be redrawn instead. Otherwise fills in
+// the bytes a redraw of the changed regions takes, and redraws them too if upload is set.
+static int tcache_dirty_regions(tcache_slot *slot, screen_palette *pal, int upload, size_t *bytes) {
+    // Remapped colors are not tracked
+    if(!slot->uploaded || slot->sur->regions == NULL || slot->remap_table != NULL) {
+        return 0;
+    }
+    uint32_t changed[PAL_SET_WORDS];
+    if(screen_palette_get_changes(pal, slot->pal_version, changed) != 0) {
+        return 0;
+    }
+    *bytes = 0;
+    for(int i = 0; i < slot->sur->region_count; i++) {
+        const surface_region *r = &slot->sur->regions[i];
+        if(screen_palette_uses_changed(changed, r->pal_used, slot->pal_offset)) {
+            SDL_Rect rect;
+            tcache_region_rect(&rect, r, slot->sur);
+            *bytes += (size_t)rect.w * rect.h * cache->scale_factor * cache->scale_factor * 4;
+        }
+    }
+
+    // Redrawn areas overlap a bit when scaling, so this can add up to more than the whole page
+    if(*bytes >= slot->bytes) {
+        return 0;
+    }
+    for(int i = 0; upload && i < slot->sur->region_count; i++) {
+        const surface_region *r = &slot->sur->regions[i];
+        if(screen_palette_uses_changed(changed, r->pal_used, slot->pal_offset)) {
+            tcache_upload_region(slot, pal, r);
+        }
+    }
+    return 1;
+}
+
+// Bytes the next upload of a slot takes with the given palette
+static size_t tcache_upload_bytes(tcache_slot *slot, screen_palette *pal) {
+    size_t bytes;
+    if(tcache_dirty_regions(slot, pal, 0, &bytes)) {
+        return bytes;
+    }
+    return slot->bytes;
+}
+
+// Redraws the texture of a slot with the current palette
+static void tcache_upload(tcache_slot *slot, screen_palette *pal) {
+    size_t bytes;
+    if(!tcache_dirty_regions(slot, pal, 1, &bytes)) {
+        if(cache->scale_factor > 1) {
+            tcache_upload_scaled(slot->sur, slot->tex, pal, slot->remap_table, slot->pal_offset);
+        } else {
+            surface_to_texture(slot->sur, slot->tex, pal, slot->remap_table, slot->pal_offset);
+        }
+        bytes = slot->bytes;
+    }
+    slot->pal_version = pal->version;
+    slot->uploaded = 1;
+    slot->queued = 0;
+    cache->frame_upload_bytes += bytes;
+}
+
+// Creates a texture for the surface in a new slot. Returns slot index, or TCACHE_NONE on error.
+static int tcache_create_slot(surface *sur, char *remap_table, uint8_t pal_offset) {
+    int w = sur->w * cache->scale_factor;
+    int h = sur->h * cache->scale_factor;
+    size_t bytes = (size_t)w * h * 4;
+    tcache_make_room(bytes);
+
+    SDL_Texture *tex = SDL_CreateTexture(cache->renderer,
+                                         SDL_PIXELFORMAT_ABGR8888,
+                                         SDL_TEXTUREACCESS_STREAMING,
+                                         w, h);
+    if(tex == NULL) {
+        PERROR("Unable to create texture: %s", SDL_GetError());
+        return TCACHE_NONE;
+    }
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+
+    // Making room may have evicted other slots of this surface, so the chain is looked up after it
+    int first = tcache_first_slot(sur);
+    int idx = tcache_alloc_slot();
+    tcache_slot *slot = &cache->slots[idx];
+    slot->tex = tex;
+    slot->sur = sur;
+    slot->remap_table = remap_table;
+    slot->pal_offset = pal_offset;
+    slot->sibling = first;
+    slot->bytes = bytes;
+    slot->uploaded = 0;
+    slot->queued = 0;
+    tcache_lru_push(idx);
+    cache->resident_bytes += bytes;
+    cache->stats.entries++;
+    sur->tcache_slot = idx;
+    sur->tcache_gen = slot->gen;
+    return idx;
+}
+
+// Tells whether an upload of this size should wait for a later frame
+static int tcache_over_budget(size_t bytes, int priority) {
+    if(cache->upload_budget_bytes == 0 || cache->frame_upload_bytes + bytes <= cache->upload_budget_bytes) {
+        return 0;
+    }
+    cache->frame_overrun = 1;
+
+    // The first upload of a frame always goes through, so that textures larger
+    // than the whole budget get drawn eventually.
+    return priority != TCACHE_PRIORITY_REQUIRED && cache->frame_upload_bytes > 0;
+}
+
+static void tcache_enqueue(int idx, int priority) {
+    tcache_slot *slot = &cache->slots[idx];
+    if(slot->queued) {
+        if(priority > slot->priority) {
+            slot->priority = priority;
+        }
+        return;
+    }
+    if(cache->queue_count >= cache->queue_size) {
+        cache->queue_size = (cache->queue_size > 0) ? cache->queue_size * 2 : 64;
+        cache->queue = realloc(cache->queue, cache->queue_size * sizeof(tcache_queued));
+    }
+    cache->queue[cache->queue_count].idx = idx;
+    cache->queue[cache->queue_count].gen = slot->gen;
+    cache->queue_count++;
+    slot->queued = 1;
+    slot->priority = priority;
+}
+
+static int tcache_queued_valid(const tcache_queued *q) {
+    tcache_slot *slot = &cache->slots[q->idx];
+    return slot->gen == q->gen && slot->queued;
+}
+
+// Does queued uploads, highest priority first, until the budget runs out
+static int tcache_drain() {
+    if(cache->queue_count == 0) {
+        return 0;
+    }
+    uint64_t trace_start = tracer_begin();
+    int updated = 0;
+    for(int prio = TCACHE_PRIORITY_REQUIRED; prio >= TCACHE_PRIORITY_NORMAL; prio--) {
+        for(int i = 0; i < cache->queue_count; i++) {
+            tcache_queued *q = &cache->queue[i];
+            if(!tcache_queued_valid(q)) {
+                continue;
+            }
+            tcache_slot *slot = &cache->slots[q->idx];
+            if(slot->priority != prio) {
+                continue;
+            }
+            if(cache->upload_budget_bytes > 0 && cache->frame_upload_bytes > 0 &&
+               cache->frame_upload_bytes + tcache_upload_bytes(slot, cache->pal) > cache->upload_budget_bytes) {
+                continue;
+            }
+            tcache_upload(slot, cache->pal);
+            updated = 1;
+        }
+    }
+
+    // Drop everything that got done or freed
+    int n = 0;
+    for(int i = 0; i < cache->queue_count; i++) {
+        if(tcache_queued_valid(&cache->queue[i])) {
+            cache->queue[n++] = cache->queue[i];
+        }
+    }
+    cache->queue_count = n;
+    tracer_end("video", "tcache_drain", trace_start);
+    return updated;
 }
 
 void tcache_init(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scaler) {
     cache = malloc(sizeof(tcache));
-    hashmap_create(&cache->entries, 6);
+    memset(cache, 0, sizeof(tcache));
+    cache->free_head = TCACHE_NONE;
+    cache->lru_head = TCACHE_NONE;
+    cache->lru_tail = TCACHE_NONE;
+    cache->budget_bytes = TCACHE_DEFAULT_BUDGET;
     cache->renderer = renderer;
     cache->scaler = scaler;
     cache->scale_factor = scale_factor;
-    cache->hits = 0;
-    cache->misses = 0;
     DEBUG("Texture cache initialized.");
 }
 
@@ -64,99 +484,153 @@ void tcache_reinit(SDL_Renderer *renderer, int scale_factor, scaler_plugin *scal
     tcache_clear();
 }
 
+// Surfaces are not touched here; bumping the generations is enough to invalidate their handles
 void tcache_clear() {
-    iterator it;
-    hashmap_iter_begin(&cache->entries, &it);
-    hashmap_pair *pair;
-    while((pair = iter_next(&it)) != NULL) {
-        tcache_entry_value *entry = pair->val;
-        SDL_DestroyTexture(entry->tex);
-    }
-    hashmap_clear(&cache->entries);
-}
-
-void tcache_tick() {
-    iterator it;
-    hashmap_iter_begin(&cache->entries, &it);
-    hashmap_pair *pair;
-    while((pair = iter_next(&it)) != NULL) {
-        tcache_entry_value *entry = pair->val;
-        entry->age++;
-        if(entry->age > CACHE_LIFETIME) {
-            SDL_DestroyTexture(entry->tex);
-            hashmap_delete(&cache->entries, &it);
-        }
+    while(cache->lru_head != TCACHE_NONE) {
+        tcache_free_slot(cache->lru_head);
+    }
+    cache->queue_count = 0;
+}
+
+void tcache_release(surface *sur) {
+    if(cache == NULL) {
+        return;
+    }
+    int idx = tcache_first_slot(sur);
+    while(idx != TCACHE_NONE) {
+        int next = cache->slots[idx].sibling;
+        tcache_free_slot(idx);
+        idx = next;
+    }
+    sur->tcache_slot = TCACHE_NONE;
+}
+
+void tcache_set_budget(size_t bytes) {
+    cache->budget_bytes = bytes;
+    DEBUG("Texture cache budget set to %u kB.", (unsigned int)(bytes / 1024));
+}
+
+void tcache_set_upload_budget(size_t bytes) {
+    cache->upload_budget_bytes = bytes;
+    DEBUG("Texture upload budget set to %u kB per frame.", (unsigned int)(bytes / 1024));
+}
+
+int tcache_frame_end() {
+    cache->frame++;
+    cache->stats.frame_hits = cache->frame_hits;
+    cache->stats.frame_misses = cache->frame_misses;
+    cache->stats.frame_evictions = cache->frame_evictions;
+    cache->stats.frame_deferred = cache->frame_deferred;
+    cache->stats.frame_upload_bytes = cache->frame_upload_bytes;
+    if(cache->frame_overrun) {
+        cache->stats.overruns++;
     }
+    cache->frame_hits = 0;
+    cache->frame_misses = 0;
+    cache->frame_evictions = 0;
+    cache->frame_deferred = 0;
+    cache->frame_upload_bytes = 0;
+    cache->frame_overrun = 0;
+
+    // Queued uploads are counted against the next frame
+    return tcache_drain();
+}
+
+void tcache_get_stats(tcache_stats *stats) {
+    *stats = cache->stats;
+    stats->resident_bytes = cache->resident_bytes;
+    stats->budget_bytes = cache->budget_bytes;
+    stats->upload_budget_bytes = cache->upload_budget_bytes;
+    stats->queued = cache->queue_count;
 }
 
 void tcache_close() {
     DEBUG("Texture cache:");
-    DEBUG(" * Cache misses: %d", cache->misses);
-    DEBUG(" * Cache hits: %d", cache->hits);
+    DEBUG(" * Cache misses: %d", cache->stats.misses);
+    DEBUG(" * Cache hits: %d", cache->stats.hits);
+    DEBUG(" * Evictions: %d", cache->stats.evictions);
+    DEBUG(" * Deferred uploads: %d", cache->stats.deferred);
+    DEBUG(" * Upload budget overruns: %d", cache->stats.overruns);
     tcache_clear();
-    hashmap_free(&cache->entries);
+    free(cache->slots);
+    free(cache->queue);
+    free(cache->raw);
+    free(cache->scaled);
     free(cache);
+    cache = NULL;
 }
 
 SDL_Texture* tcache_get(surface *sur,
                         screen_palette *pal,
                         char *remap_table,
-                        uint8_t pal_offset) {
-
-    // Form a key
-    tcache_entry_key key;
-    key.c_pal_offset = (sur->type == SURFACE_TYPE_RGBA) ? 0 : pal_offset;
-    key.c_remap_table = (sur->type == SURFACE_TYPE_RGBA) ? 0 : remap_table;
-    key.c_surface = sur;
-    key.w = sur->w;
-    key.h = sur->h;
-
-    // Attempt to find appropriate surface
-    tcache_entry_value *val = tcache_get_entry(&key);
-    if(val != NULL && (val->pal_version == pal->version || sur->type == SURFACE_TYPE_RGBA)) {
-        val->age = 0;
-        cache->hits++;
-        return val->tex;
-    }
-
-    // If there was no fitting surface tex in the cache at all,
-    // then we need to create one
-    if(val == NULL) {
-        tcache_entry_value new_entry;
-        new_entry.tex = SDL_CreateTexture(cache->renderer,
-                                          SDL_PIXELFORMAT_ABGR8888,
-                                          SDL_TEXTUREACCESS_STREAMING,
-                                          sur->w * cache->scale_factor,
-                                          sur->h * cache->scale_factor);
-        SDL_SetTextureBlendMode(new_entry.tex, SDL_BLENDMODE_BLEND);
-        val = tcache_add_entry(&key, &new_entry);
+                        uint8_t pal_offset,
+                        int priority) {
+
+    // RGBA surfaces don't depend on palette
+    if(sur->type == SURFACE_TYPE_RGBA) {
+        pal_offset = 0;
+        remap_table = NULL;
     }
 
-    // We have a texture either from the cache, or we just created one.
-    // Either one, it needs to be updated. Let's do it now.
-    // Also, scale surface if necessary
-    if(cache->scale_factor > 1) {
-        char *raw = malloc(sur->w * sur->h * 4);
-        surface scaled;
-        surface_create(&scaled,
-                       SURFACE_TYPE_RGBA,
-                       sur->w * cache->scale_factor,
-                       sur->h * cache->scale_factor);
-
-        surface_to_rgba(sur, raw, pal, remap_table, pal_offset);
-        scaler_scale(cache->scaler, raw, scaled.data, sur->w, sur->h, cache->scale_factor);
-        surface_to_texture(&scaled, val->tex, pal, remap_table, pal_offset);
-        surface_free(&scaled);
-        free(raw);
+    // Each offset and remap table has a texture of its own, so that a surface can be
+    // drawn several ways in a frame without redrawing textures that are still being used.
+    int idx = tcache_find_slot(sur, remap_table, pal_offset);
+    tcache_slot *slot = (idx != TCACHE_NONE) ? &cache->slots[idx] : NULL;
+    if(slot != NULL && slot->uploaded) {
+        // If the palette has changed, but not at any of the entries this surface uses,
+        // the texture is still good. Remapped colors are not tracked, so any change counts for them.
+        if(sur->type == SURFACE_TYPE_RGBA ||
+           !screen_palette_changed_since(pal,
+                                         slot->pal_version,
+                                         (remap_table == NULL) ? sur->pal_used : NULL,
+                                         pal_offset)) {
+            tcache_lru_unlink(idx);
+            tcache_lru_push(idx);
+            slot->last_frame = cache->frame;
+            slot->pal_version = pal->version;
+            slot->queued = 0;
+            cache->stats.hits++;
+            cache->frame_hits++;
+            return slot->tex;
+        }
+    }
+
+    uint64_t trace_start = tracer_begin();
+
+    // If the surface has no texture, then we need to create one
+    if(slot == NULL) {
+        idx = tcache_create_slot(sur, remap_table, pal_offset);
+        if(idx == TCACHE_NONE) {
+            return NULL;
+        }
+        slot = &cache->slots[idx];
     } else {
-        surface_to_texture(sur, val->tex, pal, remap_table, pal_offset);
+        tcache_lru_unlink(idx);
+        tcache_lru_push(idx);
+    }
+    slot->last_frame = cache->frame;
+
+    // Over the upload budget, the old texture is used for now (or nothing,
+    // if there is no old one), and the upload is done in a later frame.
+    if(tcache_over_budget(tcache_upload_bytes(slot, pal), priority)) {
+        tcache_enqueue(idx, priority);
+        cache->pal = pal;
+        cache->stats.deferred++;
+        cache->frame_deferred++;
+        tracer_end("video", "tcache_defer", trace_start);
+        return slot->uploaded ? slot->tex : NULL;
     }
 
-    // Set correct age and palette version
-    val->age = 0;
-    val->pal_version = pal->version;
+    // We have a texture either from the cache, or we just created one.
+    // Either one, it needs to be updated. Let's do it now.
+    // Also, scale surface if necessary
+    tcache_upload(slot, pal);
 
     // Do some statistics stuff
-    cache->misses++;
-    return val->tex;
+    cache->stats.misses++;
+    cache->frame_misses++;
+    tracer_end("video", "tcache_miss", trace_start);
+    return slot->tex;
 }
+
+#endif // STANDALONE_SERVER
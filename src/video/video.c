@@ -1,6 +1,10 @@
 #include "video/video.h"
 #include "video/image.h"
 #include "video/tcache.h"
+#include "video/scalers.h"
+#include "video/pal_convert.h"
+#include "utils/workers.h"
+#include "utils/tracer.h"
 #include "utils/log.h"
 #include "utils/list.h"
 #include "resources/palette.h"
@@ -8,9 +12,96 @@
 #include "video/video_hw.h"
 #include "video/video_soft.h"
 #include "plugins/plugins.h"
+#include "profiler.h"
 #include <SDL2/SDL.h>
 #include <stdlib.h>
 
+#ifdef STANDALONE_SERVER
+// The standalone server has no window or renderer. Palettes are still
+// kept up to date, since scenes and HARs modify them while ticking.
+// Simulations may run one game per thread, so each thread gets its own.
+static __thread palette base_palette;
+static __thread screen_palette cur_palette;
+
+int video_init(int window_w,
+               int window_h,
+               int fullscreen,
+               int vsync,
+               const char* scaler_name,
+               int scale_factor) {
+    screen_palette_init(&cur_palette);
+    return 0;
+}
+int video_reinit(int window_w,
+                 int window_h,
+                 int fullscreen,
+                 int vsync,
+                 const char* scaler_name,
+                 int scale_factor) {
+    return 0;
+}
+void video_reinit_renderer() {}
+void video_render_reset() {}
+void video_get_state(int *w, int *h, int *fs, int *vsync) {
+    if(w != NULL) *w = NATIVE_W;
+    if(h != NULL) *h = NATIVE_H;
+    if(fs != NULL) *fs = 0;
+    if(vsync != NULL) *vsync = 0;
+}
+void video_move_target(int x, int y) {}
+void video_set_render_priority(int priority) {}
+void video_render_sprite(surface *sur, int x, int y, unsigned int render_mode, int pal_offset) {}
+void video_render_sprite_size(surface *sur, int sx, int sy, int sw, int sh) {}
+void video_render_sprite_flip_scale(surface *sur, int x, int y, unsigned int render_mode,
+                                    int pal_offset, unsigned int flip_mode, float y_percent) {}
+void video_render_sprite_tint(surface *sur, int x, int y, color c, int pal_offset) {}
+void video_render_sprite_flip_scale_opacity(surface *sur, int x, int y, unsigned int render_mode,
+                                            int pal_offset, unsigned int flip_mode, float y_percent,
+                                            uint8_t opacity) {}
+void video_render_sprite_flip_scale_opacity_tint(surface *sur, int x, int y, unsigned int render_mode,
+                                                 int pal_offset, unsigned int flip_mode, float y_percent,
+                                                 uint8_t opacity, color tint) {}
+void video_select_renderer(int renderer) {}
+void video_set_frame_scaling(int enabled) {}
+void video_render_background(surface *sur) {}
+void video_render_prepare() {}
+void video_render_finish() {}
+void video_close() {}
+void video_screenshot(image *img) {
+    image_create(img, NATIVE_W, NATIVE_H);
+}
+int video_area_capture(surface *sur, int x, int y, int w, int h) {
+    return 1;
+}
+void video_set_fade(float fade) {}
+
+void video_set_base_palette(const palette *src) {
+    memcpy(&base_palette, src, sizeof(palette));
+    memcpy(cur_palette.data, base_palette.data, 768);
+    screen_palette_commit(&cur_palette);
+}
+
+palette *video_get_base_palette() {
+    return &base_palette;
+}
+
+void video_force_pal_refresh() {
+    memcpy(cur_palette.data, base_palette.data, 768);
+    screen_palette_invalidate(&cur_palette);
+}
+
+void video_copy_pal_range(const palette *src, int src_start, int dst_start, int amount) {
+    memcpy(cur_palette.data[0] + dst_start * 3,
+           src->data[0] + src_start * 3,
+           amount * 3);
+    screen_palette_commit(&cur_palette);
+}
+
+screen_palette* video_get_pal_ref() {
+    return &cur_palette;
+}
+
+#else
 static video_state state;
 
 void reset_targets() {
@@ -20,15 +111,43 @@ void reset_targets() {
     state.target = SDL_CreateTexture(state.renderer,
                                      SDL_PIXELFORMAT_ABGR8888,
                                      SDL_TEXTUREACCESS_TARGET,
-                                     NATIVE_W * state.scale_factor,
-                                     NATIVE_H * state.scale_factor);
+                                     NATIVE_W * state.render_scale,
+                                     NATIVE_H * state.render_scale);
 
     // Update target with black pixels
-    int size = NATIVE_W * state.scale_factor * NATIVE_H * state.scale_factor * 4;
+    int size = NATIVE_W * state.render_scale * NATIVE_H * state.render_scale * 4;
     char *pixels = malloc(size);
     memset(pixels, 0, size);
-    SDL_UpdateTexture(state.target, NULL, pixels, NATIVE_W * state.scale_factor * 4);
+    SDL_UpdateTexture(state.target, NULL, pixels, NATIVE_W * state.render_scale * 4);
     free(pixels);
+
+    // Frame scaling needs a texture for the scaled frame, and buffers to scale with
+    if(state.post_tex != NULL) {
+        SDL_DestroyTexture(state.post_tex);
+        state.post_tex = NULL;
+    }
+    free(state.post_in);
+    free(state.post_out);
+    state.post_in = NULL;
+    state.post_out = NULL;
+    if(state.frame_scaling && state.scale_factor > 1) {
+        state.post_tex = SDL_CreateTexture(state.renderer,
+                                           SDL_PIXELFORMAT_ABGR8888,
+                                           SDL_TEXTUREACCESS_STREAMING,
+                                           NATIVE_W * state.scale_factor,
+                                           NATIVE_H * state.scale_factor);
+        if(state.post_tex == NULL) {
+            PERROR("Could not create frame scaling texture: %s", SDL_GetError());
+            return;
+        }
+        state.post_in = malloc(NATIVE_W * NATIVE_H * 4);
+        state.post_out = malloc(NATIVE_W * NATIVE_H * 4 * state.scale_factor * state.scale_factor);
+    }
+}
+
+// Scale of everything drawn into the target
+static void update_render_scale() {
+    state.render_scale = state.frame_scaling ? 1 : state.scale_factor;
 }
 
 int video_load_scaler(const char* name, int scale_factor) {
@@ -56,7 +175,11 @@ int video_init(int window_w,
     state.fs = fullscreen;
     state.vsync = vsync;
     state.fade = 1.0f;
+    state.renderer_gen = 0;
     state.target = NULL;
+    state.post_tex = NULL;
+    state.post_in = NULL;
+    state.post_out = NULL;
     state.target_move_x = 0;
     state.target_move_y = 0;
 
@@ -69,12 +192,12 @@ int video_init(int window_w,
         DEBUG("Scaler \"%s\" loaded w/ factor %d", scaler_name, scale_factor);
         state.scale_factor = scale_factor;
     }
+    update_render_scale();
 
     // Clear palettes
     state.cur_palette = malloc(sizeof(screen_palette));
     state.base_palette = malloc(sizeof(palette));
-    state.cur_palette->version = 1;
-    memset(state.cur_palette->data, 0, 768);
+    screen_palette_init(state.cur_palette);
 
     // Open window
     state.window = SDL_CreateWindow(
@@ -127,13 +250,27 @@ int video_init(int window_w,
     // Set rendertargets
     reset_targets();
 
+    // Pick palette conversion code for this CPU
+    pal_convert_init();
+
+    // Threads for scaling
+    workers_init(0);
+
     // Init texture cache
-    tcache_init(state.renderer, state.scale_factor, &state.scaler);
+    tcache_init(state.renderer, state.render_scale, &state.scaler);
 
     // Init hardware renderer
     state.cur_renderer = VIDEO_RENDERER_HW;
     video_hw_init(&state);
 
+    // Nothing drawn yet
+    drawlist_create(&state.draws[0]);
+    drawlist_create(&state.draws[1]);
+    state.cur_draws = 0;
+    state.redraw = 1;
+    state.render_priority = VIDEO_PRIORITY_NORMAL;
+    state.draw_priority = TCACHE_PRIORITY_NORMAL;
+
     // Get renderer data
     SDL_RendererInfo rinfo;
     SDL_GetRendererInfo(state.renderer, &rinfo);
@@ -161,13 +298,26 @@ void video_reinit_renderer() {
          renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
     }
     state.renderer = SDL_CreateRenderer(state.window, -1, renderer_flags);
+    state.renderer_gen++;
     SDL_RenderSetLogicalSize(state.renderer,
                              NATIVE_W * state.scale_factor,
                              NATIVE_H * state.scale_factor);
-    tcache_reinit(state.renderer, state.scale_factor, &state.scaler);
+    update_render_scale();
+    tcache_reinit(state.renderer, state.render_scale, &state.scaler);
 
      // Reset rendertarget
     reset_targets();
+    state.redraw = 1;
+}
+
+// Called when the renderer has lost the contents of its textures (SDL_RENDER_TARGETS_RESET,
+// SDL_RENDER_DEVICE_RESET). Idle frames are not redrawn otherwise, so everything is made again.
+void video_render_reset() {
+    DEBUG("Render targets were reset, redrawing.");
+    tcache_clear();
+    state.cb.render_reinit(&state);
+    reset_targets();
+    state.redraw = 1;
 }
 
 int video_reinit(int window_w,
@@ -243,11 +393,30 @@ int video_reinit(int window_w,
     return 0;
 }
 
+void video_set_frame_scaling(int enabled) {
+    if(enabled == state.frame_scaling) {
+        return;
+    }
+    state.frame_scaling = enabled;
+
+    // Before video_init(), the setting is just stored
+    if(state.renderer == NULL) {
+        return;
+    }
+    video_reinit_renderer();
+    state.cb.render_reinit(&state);
+    DEBUG("Frame scaling %s.", enabled ? "on" : "off");
+}
+
 void video_move_target(int x, int y) {
     state.target_move_x = x * state.scale_factor;
     state.target_move_y = y * state.scale_factor;
 }
 
+void video_set_render_priority(int priority) {
+    state.render_priority = priority;
+}
+
 void video_get_state(int *w, int *h, int *fs, int *vsync) {
     if(w != NULL) {
         *w = state.w;
@@ -269,6 +438,7 @@ void video_select_renderer(int renderer) {
     }
     state.cb.render_close(&state);
     state.cur_renderer = renderer;
+    state.redraw = 1;
     switch(renderer) {
         case VIDEO_RENDERER_QUIRKS:
             video_soft_init(&state);
@@ -284,6 +454,7 @@ void video_set_fade(float fade) {
 }
 
 void video_screenshot(image *img) {
+    state.cb.render_flush(&state);
     image_create(img, state.w, state.h);
     int ret = SDL_RenderReadPixels(state.renderer, NULL, SDL_PIXELFORMAT_ABGR8888, img->data, img->w * 4);
     if(ret != 0) {
@@ -305,7 +476,8 @@ int video_area_capture(surface *sur, int x, int y, int w, int h) {
     // Create a new surface
     surface_create(sur, SURFACE_TYPE_RGBA, r.w, r.h);
 
-    // Read pixels
+    // Read pixels. Anything still queued has to be drawn first.
+    state.cb.render_flush(&state);
     int ret = SDL_RenderReadPixels(state.renderer, &r, SDL_PIXELFORMAT_ABGR8888, sur->data, sur->w * 4);
     if(ret != 0) {
         surface_free(sur);
@@ -318,13 +490,13 @@ int video_area_capture(surface *sur, int x, int y, int w, int h) {
 
 void video_force_pal_refresh() {
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
-    state.cur_palette->version++;
+    screen_palette_invalidate(state.cur_palette);
 }
 
 void video_set_base_palette(const palette *src) {
     memcpy(state.base_palette, src, sizeof(palette));
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
-    state.cur_palette->version++;
+    screen_palette_commit(state.cur_palette);
 }
 
 palette *video_get_base_palette() {
@@ -332,10 +504,10 @@ palette *video_get_base_palette() {
 }
 
 void video_copy_pal_range(const palette *src, int src_start, int dst_start, int amount) {
-    memcpy(state.cur_palette->data + dst_start * 3,
-           src->data + src_start * 3,
+    memcpy(state.cur_palette->data[0] + dst_start * 3,
+           src->data[0] + src_start * 3,
            amount * 3);
-    state.cur_palette->version++;
+    screen_palette_commit(state.cur_palette);
 }
 
 screen_palette* video_get_pal_ref() {
@@ -345,12 +517,13 @@ screen_palette* video_get_pal_ref() {
 void video_render_prepare() {
     // Reset palette
     memcpy(state.cur_palette->data, state.base_palette->data, 768);
-    SDL_SetRenderTarget(state.renderer, state.target);
-    state.cb.render_prepare(&state);
+    drawlist_clear(&state.draws[state.cur_draws]);
 }
 
 void video_render_background(surface *sur) {
-    state.cb.render_background(&state, sur);
+    SDL_Rect dst = {0, 0, NATIVE_W, NATIVE_H};
+    drawlist_add(&state.draws[state.cur_draws], sur, &dst, SDL_BLENDMODE_BLEND, 0, 0, 0xFF,
+                 color_create(0xFF, 0xFF, 0xFF, 0xFF), 1, VIDEO_PRIORITY_NORMAL);
 }
 
 void video_render_sprite_tint(
@@ -368,13 +541,14 @@ void video_render_sprite_tint(
     dst.y = sy;
 
     // Render
-    state.cb.render_fsot(
-        &state,
+    drawlist_add(
+        &state.draws[state.cur_draws],
         sur,
         &dst,
         SDL_BLENDMODE_BLEND,
         pal_offset,
-        0, 255, c); // pal_offset, opacity, tint
+        0, 255, c, 0, // pal_offset, opacity, tint
+        state.render_priority);
 }
 
 // Wrapper
@@ -449,15 +623,17 @@ void video_render_sprite_size(
     dst.y = sy;
 
     // Render
-    state.cb.render_fsot(
-        &state,
+    drawlist_add(
+        &state.draws[state.cur_draws],
         sur,
         &dst,
         SDL_BLENDMODE_BLEND, // blendmode
         0, // Pal offset
         0, // flip
         0xFF, // opacity
-        color_create(0xFF, 0xFF, 0xFF, 0xFF)); // tint
+        color_create(0xFF, 0xFF, 0xFF, 0xFF), // tint
+        0,
+        state.render_priority);
 }
 
 void video_render_sprite_flip_scale_opacity_tint(
@@ -489,18 +665,110 @@ void video_render_sprite_flip_scale_opacity_tint(
         blend_mode = SDL_BLENDMODE_ADD;
 
     // Render
-    state.cb.render_fsot(&state, sur, &dst, blend_mode, pal_offset, flip, opacity, tint);
+    drawlist_add(&state.draws[state.cur_draws], sur, &dst, blend_mode, pal_offset, flip, opacity, tint, 0,
+                 state.render_priority);
 }
 
-// Called on every game tick
-void video_tick() {
-    tcache_tick();
+// Reads back the finished frame from the target, and scales it into post_tex
+static void video_post_scale() {
+    uint64_t trace_start = tracer_begin();
+    if(SDL_RenderReadPixels(state.renderer, NULL, SDL_PIXELFORMAT_ABGR8888, state.post_in, NATIVE_W * 4) != 0) {
+        PERROR("Unable to read pixels from rendertarget: %s", SDL_GetError());
+        return;
+    }
+
+    scaler_scale_to_texture(&state.scaler, state.post_tex, state.post_in, NATIVE_W, NATIVE_H,
+                            state.scale_factor, state.post_out);
+    tracer_end("video", "post_scale", trace_start);
+}
+
+// Draws the recorded draws that touch the clip area, or all of them
+static void video_replay(SDL_Rect *clip) {
+    drawlist *dl = &state.draws[state.cur_draws];
+    for(unsigned int i = 0; i < drawlist_size(dl); i++) {
+        drawlist_entry *e = drawlist_get(dl, i);
+        if(clip != NULL && !SDL_HasIntersection(&e->dst, clip)) {
+            continue;
+        }
+        state.draw_priority = (e->priority == VIDEO_PRIORITY_HIGH) ? TCACHE_PRIORITY_HIGH : TCACHE_PRIORITY_NORMAL;
+        if(e->background) {
+            state.cb.render_background(&state, e->sur);
+        } else {
+            // Renderers may modify dst
+            SDL_Rect dst = e->dst;
+            state.cb.render_fsot(&state, e->sur, &dst, e->blend_mode, e->pal_offset, e->flip, e->opacity, e->tint);
+        }
+    }
+}
+
+// Redraws one area of the target, leaving the rest as it was
+static void video_redraw_rect(SDL_Rect *r) {
+    SDL_Rect clip;
+    clip.x = r->x * state.render_scale;
+    clip.y = r->y * state.render_scale;
+    clip.w = r->w * state.render_scale;
+    clip.h = r->h * state.render_scale;
+    SDL_RenderSetClipRect(state.renderer, &clip);
+    SDL_SetRenderDrawBlendMode(state.renderer, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(state.renderer, 0, 0, 0, 0);
+    SDL_RenderFillRect(state.renderer, &clip);
+    video_replay(r);
+    state.cb.render_flush(&state);
+    SDL_RenderSetClipRect(state.renderer, NULL);
+}
+
+// Draws the recorded frame into the target, if it differs from the one already there
+static void video_draw_frame() {
+    SDL_Rect rects[DRAWLIST_MAX_RECTS];
+    int dirty = -1;
+    if(!state.redraw && state.drawn_pal_version == state.cur_palette->version) {
+        dirty = drawlist_diff(&state.draws[!state.cur_draws],
+                              &state.draws[state.cur_draws],
+                              rects, DRAWLIST_MAX_RECTS);
+    }
+
+    // Software renderer can only draw whole frames
+    if(dirty > 0 && state.cur_renderer != VIDEO_RENDERER_HW) {
+        dirty = -1;
+    }
+
+    if(dirty != 0) {
+        SDL_SetRenderTarget(state.renderer, state.target);
+        state.cb.render_prepare(&state);
+        if(dirty < 0) {
+            video_replay(NULL);
+            profiler_count(PROF_COUNT_REDRAWN_PIXELS, NATIVE_W * NATIVE_H);
+        } else {
+            for(int i = 0; i < dirty; i++) {
+                video_redraw_rect(&rects[i]);
+                profiler_count(PROF_COUNT_REDRAWN_PIXELS, rects[i].w * rects[i].h);
+            }
+        }
+
+        // Tell software/hardware renderer to finish up whatever it was doing
+        state.cb.render_finish(&state);
+
+        // With frame scaling, the frame drawn at native size is scaled up here
+        if(state.post_tex != NULL) {
+            video_post_scale();
+        }
+    }
+
+    // Last frame is compared against the next one
+    state.redraw = 0;
+    state.drawn_pal_version = state.cur_palette->version;
+    state.cur_draws = !state.cur_draws;
 }
 
 // Called after frame has been rendered
 void video_render_finish() {
-    // Tell software/hardware renderer to finish up whatever it was doing
-    state.cb.render_finish(&state);
+    video_draw_frame();
+
+    // Textures updated from the upload queue are not seen by the draw lists
+    if(tcache_frame_end()) {
+        state.redraw = 1;
+    }
+    SDL_Texture *frame = (state.post_tex != NULL) ? state.post_tex : state.target;
 
     // Set our rendertarget to screen buffer.
     SDL_SetRenderTarget(state.renderer, NULL);
@@ -511,7 +779,7 @@ void video_render_finish() {
 
     // Handle fading by color modulation
     uint8_t v = 255.0f * state.fade;
-    SDL_SetTextureColorMod(state.target, v, v, v);
+    SDL_SetTextureColorMod(frame, v, v, v);
 
     // Set screen position. take into account scaling and target moves (screen shakes)
     SDL_Rect dst;
@@ -519,26 +787,32 @@ void video_render_finish() {
     dst.y = state.target_move_y * state.scale_factor;
     dst.w = NATIVE_W * state.scale_factor;
     dst.h = NATIVE_H * state.scale_factor;
-    SDL_RenderCopy(state.renderer, state.target, NULL, &dst);
+    SDL_RenderCopy(state.renderer, frame, NULL, &dst);
 
     // Reset color modulation to normal
-    SDL_SetTextureColorMod(state.target, 0xFF, 0xFF, 0xFF);
+    SDL_SetTextureColorMod(frame, 0xFF, 0xFF, 0xFF);
 
-    // Flip buffers. If vsync is off, we should sleep here
-    // so hat our main loop doesn't eat up all cpu :)
+    // Flip buffers. If vsync is off, the frame pacer in the main loop does the waiting.
     SDL_RenderPresent(state.renderer);
-    if(!state.vsync) {
-        SDL_Delay(1);
-    }
 }
 
 void video_close() {
     state.cb.render_close(&state);
+    drawlist_free(&state.draws[0]);
+    drawlist_free(&state.draws[1]);
     SDL_DestroyTexture(state.target);
+    if(state.post_tex != NULL) {
+        SDL_DestroyTexture(state.post_tex);
+    }
+    free(state.post_in);
+    free(state.post_out);
     SDL_DestroyRenderer(state.renderer);
     SDL_DestroyWindow(state.window);
     free(state.cur_palette);
     free(state.base_palette);
     tcache_close();
+    workers_close();
     INFO("Video deinit.");
 }
+
+#endif // STANDALONE_SERVER
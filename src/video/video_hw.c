@@ -1,13 +1,60 @@
+#include <stdlib.h>
 #include "video/video_hw.h"
 #include "video/tcache.h"
 #include "utils/log.h"
+#include "profiler.h"
 
-void hw_render_close(video_state *state) {
+// SDL_RenderGeometry() is only available since SDL 2.0.18. Without it, sprites are drawn one by one.
+#if SDL_VERSION_ATLEAST(2,0,18)
+#define HW_USE_BATCHING
+#endif
+
+// Max quads per submitted batch
+#define HW_BATCH_SIZE 1024
+
+#ifdef HW_USE_BATCHING
+typedef struct hw_renderer_t {
+    // Consecutive sprites that use the same texture and blend mode
+    // are collected here, and submitted together.
+    SDL_Texture *tex;
+    SDL_BlendMode blend_mode;
+    unsigned int pal_version;
+    int quads;
+    SDL_Vertex vertices[HW_BATCH_SIZE * 4];
+    int indices[HW_BATCH_SIZE * 6];
+} hw_renderer;
 
+static void hw_render_flush(video_state *state) {
+    hw_renderer *hw = state->userdata;
+    if(hw->quads == 0) {
+        return;
+    }
+
+    // Vertex colors carry the tint and opacity, so reset the texture modulation
+    SDL_SetTextureAlphaMod(hw->tex, 0xFF);
+    SDL_SetTextureColorMod(hw->tex, 0xFF, 0xFF, 0xFF);
+    SDL_SetTextureBlendMode(hw->tex, hw->blend_mode);
+    SDL_RenderGeometry(state->renderer, hw->tex, hw->vertices, hw->quads * 4, hw->indices, hw->quads * 6);
+    profiler_count(PROF_COUNT_DRAW_CALLS, 1);
+    hw->quads = 0;
 }
+#else
+static void hw_render_flush(video_state *state) {
 
-void hw_render_reinit(video_state *state) {
+}
+#endif // HW_USE_BATCHING
 
+void hw_render_close(video_state *state) {
+    free(state->userdata);
+    state->userdata = NULL;
+}
+
+void hw_render_reinit(video_state *state) {
+#ifdef HW_USE_BATCHING
+    // Textures may have been destroyed
+    hw_renderer *hw = state->userdata;
+    hw->quads = 0;
+#endif
 }
 
 void hw_render_prepare(video_state *state) {
@@ -15,25 +62,27 @@ void hw_render_prepare(video_state *state) {
 }
 
 void hw_render_finish(video_state *state) {
-
+    hw_render_flush(state);
 }
 
 void hw_scale_rect(video_state *state, SDL_Rect *rct) {
-    rct->w = rct->w * state->scale_factor;
-    rct->h = rct->h * state->scale_factor;
-    rct->x = rct->x * state->scale_factor;
-    rct->y = rct->y * state->scale_factor;
+    rct->w = rct->w * state->render_scale;
+    rct->h = rct->h * state->render_scale;
+    rct->x = rct->x * state->render_scale;
+    rct->y = rct->y * state->render_scale;
 }
 
 void hw_render_background(
                     video_state *state,
                     surface *sur) {
 
-    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, 0);
+    hw_render_flush(state);
+    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, 0, TCACHE_PRIORITY_REQUIRED);
     SDL_SetTextureColorMod(tex, 0xFF, 0xFF, 0xFF);
     SDL_SetTextureAlphaMod(tex, 0xFF);
     SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
     SDL_RenderCopy(state->renderer, tex, NULL, NULL);
+    profiler_count(PROF_COUNT_DRAW_CALLS, 1);
 }
 
 void hw_render_sprite_fsot(
@@ -47,11 +96,81 @@ void hw_render_sprite_fsot(
                     color color_mod) {
 
     hw_scale_rect(state, dst);
-    SDL_Texture *tex = tcache_get(sur, state->cur_palette, NULL, pal_offset);
+
+    // Packed surfaces are drawn from their atlas page
+    SDL_Texture *tex;
+    SDL_Rect src;
+    surface *tex_sur;
+    if(sur->atlas_page != NULL) {
+        tex_sur = sur->atlas_page;
+        src.x = sur->atlas_x;
+        src.y = sur->atlas_y;
+    } else {
+        tex_sur = sur;
+        src.x = 0;
+        src.y = 0;
+    }
+    src.w = sur->w;
+    src.h = sur->h;
+    profiler_count(PROF_COUNT_SPRITES, 1);
+
+#ifdef HW_USE_BATCHING
+    hw_renderer *hw = state->userdata;
+
+    // Texture contents may change if the palette has, so anything using the old contents goes out first
+    if(hw->quads > 0 && hw->pal_version != state->cur_palette->version) {
+        hw_render_flush(state);
+    }
+    tex = tcache_get(tex_sur, state->cur_palette, NULL, pal_offset, state->draw_priority);
+    if(tex == NULL) {
+        // Upload was deferred, and there is no old texture to draw with
+        return;
+    }
+    if(hw->quads > 0 && (hw->tex != tex || hw->blend_mode != blend_mode || hw->quads == HW_BATCH_SIZE)) {
+        hw_render_flush(state);
+    }
+    hw->tex = tex;
+    hw->blend_mode = blend_mode;
+    hw->pal_version = state->cur_palette->version;
+
+    // Texture coordinates, flipped as needed
+    float u0 = (float)src.x / tex_sur->w;
+    float v0 = (float)src.y / tex_sur->h;
+    float u1 = (float)(src.x + src.w) / tex_sur->w;
+    float v1 = (float)(src.y + src.h) / tex_sur->h;
+    if(flip_mode & SDL_FLIP_HORIZONTAL) {
+        float t = u0; u0 = u1; u1 = t;
+    }
+    if(flip_mode & SDL_FLIP_VERTICAL) {
+        float t = v0; v0 = v1; v1 = t;
+    }
+
+    SDL_Color c = {color_mod.r, color_mod.g, color_mod.b, opacity};
+    SDL_Vertex *v = &hw->vertices[hw->quads * 4];
+    v[0].position.x = dst->x;          v[0].position.y = dst->y;
+    v[1].position.x = dst->x + dst->w; v[1].position.y = dst->y;
+    v[2].position.x = dst->x + dst->w; v[2].position.y = dst->y + dst->h;
+    v[3].position.x = dst->x;          v[3].position.y = dst->y + dst->h;
+    v[0].tex_coord.x = u0; v[0].tex_coord.y = v0;
+    v[1].tex_coord.x = u1; v[1].tex_coord.y = v0;
+    v[2].tex_coord.x = u1; v[2].tex_coord.y = v1;
+    v[3].tex_coord.x = u0; v[3].tex_coord.y = v1;
+    for(int i = 0; i < 4; i++) {
+        v[i].color = c;
+    }
+    hw->quads++;
+#else
+    tex = tcache_get(tex_sur, state->cur_palette, NULL, pal_offset, state->draw_priority);
+    if(tex == NULL) {
+        return;
+    }
+    hw_scale_rect(state, &src);
     SDL_SetTextureAlphaMod(tex, opacity);
     SDL_SetTextureColorMod(tex, color_mod.r, color_mod.g, color_mod.b);
     SDL_SetTextureBlendMode(tex, blend_mode);
-    SDL_RenderCopyEx(state->renderer, tex, NULL, dst, 0, NULL, flip_mode);
+    SDL_RenderCopyEx(state->renderer, tex, &src, dst, 0, NULL, flip_mode);
+    profiler_count(PROF_COUNT_DRAW_CALLS, 1);
+#endif // HW_USE_BATCHING
 }
 
 
@@ -60,7 +179,27 @@ void video_hw_init(video_state *state) {
     state->cb.render_reinit = hw_render_reinit;
     state->cb.render_prepare = hw_render_prepare;
     state->cb.render_finish = hw_render_finish;
+    state->cb.render_flush = hw_render_flush;
     state->cb.render_fsot = hw_render_sprite_fsot;
     state->cb.render_background = hw_render_background;
+
+#ifdef HW_USE_BATCHING
+    // Quad indices never change, so they are set up once
+    hw_renderer *hw = malloc(sizeof(hw_renderer));
+    hw->tex = NULL;
+    hw->quads = 0;
+    for(int i = 0; i < HW_BATCH_SIZE; i++) {
+        int *idx = &hw->indices[i * 6];
+        idx[0] = i * 4 + 0;
+        idx[1] = i * 4 + 1;
+        idx[2] = i * 4 + 2;
+        idx[3] = i * 4 + 0;
+        idx[4] = i * 4 + 2;
+        idx[5] = i * 4 + 3;
+    }
+    state->userdata = hw;
+#else
+    state->userdata = NULL;
+#endif
     DEBUG("Switched to hardware renderer.");
 }
@@ -1,72 +1,120 @@
 #include <stdlib.h>
+#include <string.h>
 #include "video/video_soft.h"
+#include "video/pal_convert.h"
+#include "video/scalers.h"
 #include "utils/log.h"
 
+// Everything is composited at native size, and scaled up once per frame
+#define SOFT_W 320
+#define SOFT_H 200
+
 typedef struct soft_renderer_t {
-    char *tmp_normal;
+    surface lower; // Paletted sprites and backgrounds
+    surface higher; // RGBA sprites (text, menus), drawn over the lower layer after scaling
+    int higher_used; // Whether anything was drawn to higher this frame
+    surface frame; // Lower layer in RGBA
     char *tmp_scaling;
-    surface lower;
-    SDL_Surface *higher;
+    uint32_t lut[256];
+
+    // Streaming texture the finished frame is uploaded to
+    SDL_Texture *tex;
+    unsigned int tex_gen;
+    int tex_scale;
 } soft_renderer;
 
-SDL_Surface* surface_from_pixels(char *pixels, int w, int h) {
-    return SDL_CreateRGBSurfaceFrom(pixels,
-                                    w, h,
-                                    32,
-                                    w*4,
-                                    0x000000FF,
-                                    0x0000FF00,
-                                    0x00FF0000,
-                                    0xFF000000);
-}
+// (Re)creates the frame texture, if the renderer or scale has changed since it was made
+static int soft_check_texture(video_state *state, soft_renderer *sr) {
+    if(sr->tex != NULL && sr->tex_gen == state->renderer_gen && sr->tex_scale == state->render_scale) {
+        return 0;
+    }
 
+    // Textures of an old renderer were destroyed along with it
+    if(sr->tex != NULL && sr->tex_gen == state->renderer_gen) {
+        SDL_DestroyTexture(sr->tex);
+    }
+    free(sr->tmp_scaling);
+    sr->tmp_scaling = NULL;
+
+    sr->tex = SDL_CreateTexture(state->renderer,
+                                SDL_PIXELFORMAT_ABGR8888,
+                                SDL_TEXTUREACCESS_STREAMING,
+                                SOFT_W * state->render_scale,
+                                SOFT_H * state->render_scale);
+    if(sr->tex == NULL) {
+        PERROR("Could not create software renderer texture: %s", SDL_GetError());
+        return 1;
+    }
+    SDL_SetTextureBlendMode(sr->tex, SDL_BLENDMODE_BLEND);
+    sr->tex_gen = state->renderer_gen;
+    sr->tex_scale = state->render_scale;
+    if(state->render_scale > 1) {
+        sr->tmp_scaling = malloc(SOFT_W * SOFT_H * 4 * state->render_scale * state->render_scale);
+    }
+    return 0;
+}
 
 void soft_render_close(video_state *state) {
     soft_renderer *sr = state->userdata;
-    SDL_FreeSurface(sr->higher);
+    if(sr->tex != NULL && sr->tex_gen == state->renderer_gen) {
+        SDL_DestroyTexture(sr->tex);
+    }
     surface_free(&sr->lower);
-    free(sr->tmp_normal);
+    surface_free(&sr->higher);
+    surface_free(&sr->frame);
     free(sr->tmp_scaling);
     free(sr);
 }
 
 void soft_render_reinit(video_state *state) {
-
+    // Renderer, scale factor or frame scaling may have changed
+    soft_check_texture(state, state->userdata);
 }
 
 void soft_render_prepare(video_state *state) {
     soft_renderer *sr = state->userdata;
-    SDL_FillRect(sr->higher, NULL, SDL_MapRGBA(sr->higher->format, 0, 0, 0, 0));
+    if(sr->higher_used) {
+        memset(sr->higher.data, 0, SOFT_W * SOFT_H * 4);
+        sr->higher_used = 0;
+    }
 }
 
-void soft_render_finish(video_state *state) {
-    soft_renderer *sr = state->userdata;
-    SDL_Texture *tex;
-    SDL_Surface *low_s;
+void soft_render_flush(video_state *state) {
 
-    // Blit lower
-    surface_to_rgba(&sr->lower, sr->tmp_normal, state->cur_palette, NULL, 0);
+}
 
-    // Scale if necessary
-    if(state->scale_factor > 1) {
-        int nw = 320 * state->scale_factor;
-        int nh = 200 * state->scale_factor;
-        scaler_scale(&state->scaler, sr->tmp_normal, sr->tmp_scaling, 320, 200, state->scale_factor);
-        low_s = surface_from_pixels(sr->tmp_scaling, nw, nh);
-    } else {
-        low_s = surface_from_pixels(sr->tmp_normal, 320, 200);
+void soft_render_finish(video_state *state) {
+    soft_renderer *sr = state->userdata;
+    if(soft_check_texture(state, sr)) {
+        return;
     }
 
-    // Make a texture
-    tex = SDL_CreateTextureFromSurface(state->renderer, low_s);
-    SDL_RenderCopy(state->renderer, tex, NULL, NULL);
-    SDL_DestroyTexture(tex);
-    SDL_FreeSurface(low_s);
+    // Whole lower layer is converted with one lookup table
+    pal_build_lut(sr->lut, state->cur_palette, NULL, 0);
+    pal_convert((uint32_t*)sr->frame.data,
+                (const uint8_t*)sr->lower.data,
+                (const uint8_t*)sr->lower.stencil,
+                SOFT_W * SOFT_H,
+                sr->lut);
+    if(sr->higher_used && state->render_scale == 1) {
+        surface_blend_blit(&sr->frame, &sr->higher, 0, 0, 0, 0xFF, color_create(0xFF, 0xFF, 0xFF, 0xFF));
+    }
 
-    // Blit upper
-    tex = SDL_CreateTextureFromSurface(state->renderer, sr->higher);
-    SDL_RenderCopy(state->renderer, tex, NULL, NULL);
-    SDL_DestroyTexture(tex);
+    // The higher layer is not run through the scaler, so that text stays sharp; it is
+    // blended over the scaled frame instead, which can't be done in the write-only texture.
+    if(sr->higher_used && state->render_scale > 1) {
+        int row_bytes = SOFT_W * state->render_scale * 4;
+        scaler_scale(&state->scaler, sr->frame.data, sr->tmp_scaling, SOFT_W, SOFT_H, state->render_scale);
+        surface_blend_scaled(sr->tmp_scaling, row_bytes, &sr->higher, state->render_scale);
+        if(SDL_UpdateTexture(sr->tex, NULL, sr->tmp_scaling, row_bytes) != 0) {
+            PERROR("Failed to update software renderer texture: %s", SDL_GetError());
+            return;
+        }
+    } else if(scaler_scale_to_texture(&state->scaler, sr->tex, sr->frame.data, SOFT_W, SOFT_H,
+                                      state->render_scale, sr->tmp_scaling) != 0) {
+        return;
+    }
+    SDL_RenderCopy(state->renderer, sr->tex, NULL, NULL);
 }
 
 void soft_render_background(
@@ -99,34 +147,25 @@ void soft_render_sprite_fsot(
             surface_alpha_blit(&sr->lower, sur, dst->x, dst->y, flip_mode);
         }
     } else {
-        surface_to_rgba(sur, sr->tmp_normal, state->cur_palette, NULL, 0);
-        SDL_Surface *s = surface_from_pixels(sr->tmp_normal, sur->w, sur->h);
-        SDL_SetSurfaceAlphaMod(s, opacity);
-        SDL_SetSurfaceColorMod(s, color_mod.r, color_mod.g, color_mod.b);
-        SDL_SetSurfaceBlendMode(s, SDL_BLENDMODE_BLEND);
-        SDL_BlitSurface(s, NULL, sr->higher, dst);
+        surface_blend_blit(&sr->higher, sur, dst->x, dst->y, flip_mode, opacity, color_mod);
+        sr->higher_used = 1;
     }
 }
 
 void video_soft_init(video_state *state) {
     soft_renderer *sr = malloc(sizeof(soft_renderer));
-    sr->higher = SDL_CreateRGBSurface(0,
-                                    320,
-                                    200,
-                                    32,
-                                    0x000000FF,
-                                    0x0000FF00,
-                                    0x00FF0000,
-                                    0xFF000000);
-    SDL_SetSurfaceRLE(sr->higher, 1);
-    surface_create(&sr->lower, SURFACE_TYPE_PALETTE, 320, 200);
-
-    // Preallocate memory for more efficient drawing
-    sr->tmp_normal = malloc(320 * 200 * 4);
+    surface_create(&sr->lower, SURFACE_TYPE_PALETTE, SOFT_W, SOFT_H);
+    memset(sr->lower.data, 0, SOFT_W * SOFT_H);
+    memset(sr->lower.stencil, 0, SOFT_W * SOFT_H);
+    surface_create(&sr->higher, SURFACE_TYPE_RGBA, SOFT_W, SOFT_H);
+    memset(sr->higher.data, 0, SOFT_W * SOFT_H * 4);
+    sr->higher_used = 0;
+    surface_create(&sr->frame, SURFACE_TYPE_RGBA, SOFT_W, SOFT_H);
     sr->tmp_scaling = NULL;
-    if(state->scale_factor > 1) {
-        sr->tmp_scaling = malloc(320 * 200 * 4 * state->scale_factor * state->scale_factor);
-    }
+    sr->tex = NULL;
+    sr->tex_gen = 0;
+    sr->tex_scale = 0;
+    soft_check_texture(state, sr);
 
     // Set as userdata
     state->userdata = sr;
@@ -136,6 +175,7 @@ void video_soft_init(video_state *state) {
     state->cb.render_reinit = soft_render_reinit;
     state->cb.render_prepare = soft_render_prepare;
     state->cb.render_finish = soft_render_finish;
+    state->cb.render_flush = soft_render_flush;
     state->cb.render_fsot = soft_render_sprite_fsot;
     state->cb.render_background = soft_render_background;
     DEBUG("Switched to software renderer.");
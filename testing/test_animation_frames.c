@@ -0,0 +1,134 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <shadowdive/stringparser.h>
+#include <resources/animation_frames.h>
+
+// Strings as they appear in the AF and BK files
+static const char *test_strings[] = {
+    "A5",
+    "bs100A1-bf0A15",
+    "s10A2-m12A4-d1B3-C20",
+    "brA1-rB2-fC3-x+5y-3D4",
+    "x=160y=150A10-ox-20oy10B5-jf2C1",
+};
+
+#define TEST_STRING_COUNT (sizeof(test_strings) / sizeof(test_strings[0]))
+
+static sd_stringparser* test_parser(const char *str) {
+    sd_stringparser *parser = sd_stringparser_create();
+    sd_stringparser_set_string(parser, str);
+    return parser;
+}
+
+void test_animation_frames_compile(void) {
+    for(unsigned int s = 0; s < TEST_STRING_COUNT; s++) {
+        sd_stringparser *parser = test_parser(test_strings[s]);
+        animation_frames *af = animation_frames_compile(test_strings[s]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(af);
+        CU_ASSERT(af->count == sd_stringparser_num_frames(parser));
+
+        sd_stringparser_frame f;
+        int start = 0;
+        for(int i = 0; i < af->count; i++) {
+            CU_ASSERT(sd_stringparser_peek(parser, i, &f) == 0);
+            CU_ASSERT(af->frames[i].id == i);
+            CU_ASSERT(af->frames[i].letter == f.letter);
+            CU_ASSERT(af->frames[i].duration == f.duration);
+            CU_ASSERT(af->frames[i].start_tick == start);
+            start += f.duration;
+        }
+        CU_ASSERT(af->ticks_len == start);
+
+        animation_frames_free(af);
+        sd_stringparser_delete(parser);
+    }
+}
+
+void test_animation_frames_tags(void) {
+    for(unsigned int s = 0; s < TEST_STRING_COUNT; s++) {
+        sd_stringparser *parser = test_parser(test_strings[s]);
+        animation_frames *af = animation_frames_compile(test_strings[s]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(af);
+
+        const sd_stringparser_tag_value *v;
+        for(int i = 0; i < af->count; i++) {
+            for(int t = 0; t < TAG_COUNT; t++) {
+                int is_set = (sd_stringparser_get_tag(parser, i, animation_frames_tag_name(t), &v) == 0 && v->is_set);
+                CU_ASSERT(animation_frame_isset(&af->frames[i], t) == is_set);
+                if(is_set) {
+                    CU_ASSERT(animation_frame_get(&af->frames[i], t) == v->value);
+                } else {
+                    CU_ASSERT(animation_frame_get(&af->frames[i], t) == 0);
+                }
+            }
+        }
+
+        animation_frames_free(af);
+        sd_stringparser_delete(parser);
+    }
+}
+
+// Delays used to be written into the parser frame durations, like this
+static void test_parser_set_delay(sd_stringparser *parser, int frames, int delay) {
+    sd_stringparser_frame f;
+    int per_frame = delay / frames;
+    int rem = delay % frames;
+    for(int i = 0; i < frames; i++) {
+        if(sd_stringparser_peek(parser, i, &f) != 0) {
+            break;
+        }
+        int duration = f.duration + per_frame;
+        if(rem) {
+            duration++;
+            rem--;
+        }
+        sd_stringparser_set_frame_duration(parser, i, duration);
+    }
+}
+
+void test_animation_frames_delay(void) {
+    static const int delays[] = {0, 1, 7, 40};
+    for(unsigned int s = 0; s < TEST_STRING_COUNT; s++) {
+        animation_frames *af = animation_frames_compile(test_strings[s]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(af);
+
+        // Also more frames than there are, as player_set_delay() does when nothing limits them
+        for(int frames = 1; frames <= af->count + 1; frames++) {
+            for(unsigned int k = 0; k < sizeof(delays) / sizeof(delays[0]); k++) {
+                sd_stringparser *parser = test_parser(test_strings[s]);
+                test_parser_set_delay(parser, frames, delays[k]);
+                animation_delay d;
+                animation_delay_spread(&d, af, frames, delays[k]);
+
+                sd_stringparser_frame f;
+                int start = 0;
+                for(int i = 0; i < af->count; i++) {
+                    sd_stringparser_peek(parser, i, &f);
+                    CU_ASSERT(animation_frames_duration(af, &d, i) == f.duration);
+                    CU_ASSERT(animation_frames_start(af, &d, i) == start);
+                    start += f.duration;
+                }
+                sd_stringparser_delete(parser);
+            }
+        }
+
+        // The shared table itself is never changed
+        CU_ASSERT(af->frames[0].start_tick == 0);
+        animation_frames_free(af);
+    }
+}
+
+void test_animation_frames_custom(void) {
+    animation_frames *a = animation_frames_get_custom("A5");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+    CU_ASSERT(animation_frames_get_custom("A5") == a);
+    CU_ASSERT(animation_frames_get_custom("A6") != a);
+    animation_frames_clear_custom();
+}
+
+void animation_frames_test_suite(CU_pSuite suite) {
+    if(CU_add_test(suite, "Test for frames, durations and start ticks", test_animation_frames_compile) == NULL) { return; }
+    if(CU_add_test(suite, "Test for tags and their values", test_animation_frames_tags) == NULL) { return; }
+    if(CU_add_test(suite, "Test for delay spreading", test_animation_frames_delay) == NULL) { return; }
+    if(CU_add_test(suite, "Test for custom string cache", test_animation_frames_custom) == NULL) { return; }
+}
@@ -4,6 +4,8 @@
 void str_test_suite(CU_pSuite suite);
 void hashmap_test_suite(CU_pSuite suite);
 void vector_test_suite(CU_pSuite suite);
+void pool_test_suite(CU_pSuite suite);
+void animation_frames_test_suite(CU_pSuite suite);
 
 int main(int argc, char **argv) {
     if(CU_initialize_registry() != CUE_SUCCESS) {
@@ -23,6 +25,14 @@ int main(int argc, char **argv) {
     if(vector_suite == NULL) goto end;
     vector_test_suite(vector_suite);
 
+    CU_pSuite pool_suite = CU_add_suite("Pool", NULL, NULL);
+    if(pool_suite == NULL) goto end;
+    pool_test_suite(pool_suite);
+
+    CU_pSuite animation_frames_suite = CU_add_suite("Animation frames", NULL, NULL);
+    if(animation_frames_suite == NULL) goto end;
+    animation_frames_test_suite(animation_frames_suite);
+
     // Run tests
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
@@ -0,0 +1,72 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <string.h>
+#include <utils/pool.h>
+
+#define TEST_BLOCK_COUNT 100
+
+pool test_pool;
+void *test_blocks[TEST_BLOCK_COUNT];
+
+void test_pool_create(void) {
+    pool_create(&test_pool, 24, 16);
+    CU_ASSERT(pool_used(&test_pool) == 0);
+    CU_ASSERT(pool_capacity(&test_pool) == 0);
+}
+
+void test_pool_alloc(void) {
+    for(int i = 0; i < TEST_BLOCK_COUNT; i++) {
+        test_blocks[i] = pool_alloc(&test_pool);
+        CU_ASSERT_PTR_NOT_NULL(test_blocks[i]);
+        memset(test_blocks[i], i, 24);
+        CU_ASSERT(pool_used(&test_pool) == i+1);
+    }
+    CU_ASSERT(pool_capacity(&test_pool) >= TEST_BLOCK_COUNT);
+
+    // Writing one block must not have touched any other
+    for(int i = 0; i < TEST_BLOCK_COUNT; i++) {
+        unsigned char *b = test_blocks[i];
+        CU_ASSERT(b[0] == i && b[23] == i);
+    }
+}
+
+void test_pool_release(void) {
+    unsigned int capacity = pool_capacity(&test_pool);
+    for(int i = 0; i < TEST_BLOCK_COUNT; i += 2) {
+        pool_release(&test_pool, test_blocks[i]);
+    }
+    CU_ASSERT(pool_used(&test_pool) == TEST_BLOCK_COUNT/2);
+
+    // Released blocks are reused before the pool grows
+    for(int i = 0; i < TEST_BLOCK_COUNT; i += 2) {
+        test_blocks[i] = pool_alloc(&test_pool);
+        CU_ASSERT_PTR_NOT_NULL(test_blocks[i]);
+    }
+    CU_ASSERT(pool_used(&test_pool) == TEST_BLOCK_COUNT);
+    CU_ASSERT(pool_capacity(&test_pool) == capacity);
+}
+
+void test_pool_reset(void) {
+    unsigned int capacity = pool_capacity(&test_pool);
+    pool_reset(&test_pool);
+    CU_ASSERT(pool_used(&test_pool) == 0);
+    for(int i = 0; i < TEST_BLOCK_COUNT; i++) {
+        CU_ASSERT_PTR_NOT_NULL(pool_alloc(&test_pool));
+    }
+    CU_ASSERT(pool_capacity(&test_pool) == capacity);
+}
+
+void test_pool_free(void) {
+    pool_free(&test_pool);
+    CU_ASSERT(pool_used(&test_pool) == 0);
+    CU_ASSERT(pool_capacity(&test_pool) == 0);
+}
+
+void pool_test_suite(CU_pSuite suite) {
+    // Add tests
+    if(CU_add_test(suite, "Test for pool create", test_pool_create) == NULL) { return; }
+    if(CU_add_test(suite, "Test for pool alloc", test_pool_alloc) == NULL) { return; }
+    if(CU_add_test(suite, "Test for pool release", test_pool_release) == NULL) { return; }
+    if(CU_add_test(suite, "Test for pool reset", test_pool_reset) == NULL) { return; }
+    if(CU_add_test(suite, "Test for pool free operation", test_pool_free) == NULL) { return; }
+}